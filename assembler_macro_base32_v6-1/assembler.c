@@ -0,0 +1,546 @@
+/*
+The assembler library.
+This file runs the whole assembling process on a source in memory, and creates the outputs in memory buffers.
+All the state is kept in an assemblerContext, so a process can assemble many sources with it.
+*/
+
+#define _POSIX_C_SOURCE 200112L /* For vsnprintf and clock_gettime */
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* ====== Externs ====== */
+extern const command g_cmdArr[];
+
+/* ====== Base 32 ====== */
+/* The digits are !@#$%^&*<>abcdefghijklmnopqrstuv, so a 10 bits word is 2 digits. */
+#define BASE32_ROW(d) \
+	{ d, '!' }, { d, '@' }, { d, '#' }, { d, '$' }, { d, '%' }, { d, '^' }, { d, '&' }, { d, '*' }, \
+	{ d, '<' }, { d, '>' }, { d, 'a' }, { d, 'b' }, { d, 'c' }, { d, 'd' }, { d, 'e' }, { d, 'f' }, \
+	{ d, 'g' }, { d, 'h' }, { d, 'i' }, { d, 'j' }, { d, 'k' }, { d, 'l' }, { d, 'm' }, { d, 'n' }, \
+	{ d, 'o' }, { d, 'p' }, { d, 'q' }, { d, 'r' }, { d, 's' }, { d, 't' }, { d, 'u' }, { d, 'v' }
+
+/* The base 32 representation (2 chars, not '\0' terminated) of each number in [0, MEMORY_SIZE) */
+const char g_base32Pairs[MEMORY_SIZE][BASE32_WORD_LENGTH] =
+{
+	BASE32_ROW('!'), BASE32_ROW('@'), BASE32_ROW('#'), BASE32_ROW('$'), BASE32_ROW('%'), BASE32_ROW('^'), BASE32_ROW('&'), BASE32_ROW('*'),
+	BASE32_ROW('<'), BASE32_ROW('>'), BASE32_ROW('a'), BASE32_ROW('b'), BASE32_ROW('c'), BASE32_ROW('d'), BASE32_ROW('e'), BASE32_ROW('f'),
+	BASE32_ROW('g'), BASE32_ROW('h'), BASE32_ROW('i'), BASE32_ROW('j'), BASE32_ROW('k'), BASE32_ROW('l'), BASE32_ROW('m'), BASE32_ROW('n'),
+	BASE32_ROW('o'), BASE32_ROW('p'), BASE32_ROW('q'), BASE32_ROW('r'), BASE32_ROW('s'), BASE32_ROW('t'), BASE32_ROW('u'), BASE32_ROW('v')
+};
+
+/* ====== Methods ====== */
+
+/* Makes sure there is a room for 'length' more chars in buf. Returns if it succeeded. */
+bool reserveText(textBuffer *buf, size_t length)
+{
+	size_t newCapacity;
+	char *newData;
+
+	if (buf->length + length <= buf->capacity)
+	{
+		return TRUE;
+	}
+
+	/* Grow geometrically, so appending is amortized O(1) */
+	newCapacity = buf->capacity ? buf->capacity * 2 : 256;
+	while (newCapacity < buf->length + length)
+	{
+		newCapacity *= 2;
+	}
+
+	newData = (char *)realloc(buf->data, newCapacity);
+	if (!newData)
+	{
+		return FALSE;
+	}
+
+	buf->data = newData;
+	buf->capacity = newCapacity;
+	return TRUE;
+}
+
+/* Adds 'length' chars of str to the end of buf. Returns if it succeeded. */
+bool appendText(textBuffer *buf, const char *str, size_t length)
+{
+	if (length == 0)
+	{
+		return TRUE;
+	}
+	if (!reserveText(buf, length))
+	{
+		return FALSE;
+	}
+
+	memcpy(buf->data + buf->length, str, length);
+	buf->length += length;
+	return TRUE;
+}
+
+/* Adds a formatted string (like printf) to the end of buf. Returns if it succeeded. */
+bool appendFormat(textBuffer *buf, const char *format, ...)
+{
+	va_list args;
+	int length;
+
+	/* Find the length of the formatted string */
+	va_start(args, format);
+	length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+
+	/* +1 for the '\0' vsnprintf adds at the end */
+	if (length < 0 || !reserveText(buf, length + 1))
+	{
+		return FALSE;
+	}
+
+	va_start(args, format);
+	vsnprintf(buf->data + buf->length, length + 1, format, args);
+	va_end(args);
+
+	buf->length += length;
+	return TRUE;
+}
+
+/* Returns 'size' bytes from the arena, or NULL if there isn't enough memory. */
+void *arenaAlloc(memoryArena *arena, size_t size)
+{
+	arenaBlock *block = arena->current, *newBlock;
+	size_t blockSize;
+	void *ptr;
+
+	/* Keep the allocations aligned for any type */
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	/* Move to the next kept block if the current one is full */
+	while (block && block->used + size > block->size && block->next && block->next->size >= size)
+	{
+		block = block->next;
+		block->used = 0;
+	}
+
+	if (!block || block->used + size > block->size)
+	{
+		/* Add a new block after the current one (a big allocation gets a block of its own) */
+		blockSize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+		newBlock = (arenaBlock *)malloc(sizeof(arenaBlock) + blockSize);
+		if (!newBlock)
+		{
+			return NULL;
+		}
+
+		newBlock->size = blockSize;
+		newBlock->used = 0;
+		newBlock->data = (char *)(newBlock + 1);
+		if (block)
+		{
+			newBlock->next = block->next;
+			block->next = newBlock;
+		}
+		else
+		{
+			newBlock->next = NULL;
+			arena->first = newBlock;
+		}
+		block = newBlock;
+	}
+
+	arena->current = block;
+	ptr = block->data + block->used;
+	block->used += size;
+	return ptr;
+}
+
+/* Returns a '\0' terminated copy of the first 'length' chars of str in the arena, or NULL if there isn't enough memory. */
+char *arenaCopy(memoryArena *arena, const char *str, size_t length)
+{
+	char *newString = (char *)arenaAlloc(arena, length + 1);
+
+	if (newString)
+	{
+		memcpy(newString, str, length);
+		newString[length] = '\0';
+	}
+	return newString;
+}
+
+/* Returns a copy of str in the arena, or NULL if there isn't enough memory. */
+char *arenaString(memoryArena *arena, const char *str)
+{
+	return arenaCopy(arena, str, strlen(str));
+}
+
+/* Releases all the allocations of the arena at once (the blocks are kept for the next allocations). */
+void arenaRelease(memoryArena *arena)
+{
+	arena->current = arena->first;
+	if (arena->first)
+	{
+		arena->first->used = 0;
+	}
+}
+
+/* Frees all the blocks of the arena. */
+void arenaFree(memoryArena *arena)
+{
+	arenaBlock *block = arena->first, *next;
+
+	while (block)
+	{
+		next = block->next;
+		free(block);
+		block = next;
+	}
+
+	arena->first = NULL;
+	arena->current = NULL;
+}
+
+/* Adds a JSON string of 'length' chars (with the quotes and the escapes) to the end of buf. */
+void appendJsonString(textBuffer *buf, const char *str, size_t length)
+{
+	size_t i, start = 0;
+
+	appendText(buf, "\"", 1);
+	for (i = 0; i < length; i++)
+	{
+		if (str[i] == '"' || str[i] == '\\' || (unsigned char)str[i] < ' ')
+		{
+			appendText(buf, str + start, i - start);
+			if (str[i] == '"' || str[i] == '\\')
+			{
+				appendFormat(buf, "\\%c", str[i]);
+			}
+			else
+			{
+				appendFormat(buf, "\\u%04x", (unsigned char)str[i]);
+			}
+			start = i + 1;
+		}
+	}
+	appendText(buf, str + start, length - start);
+	appendText(buf, "\"", 1);
+}
+
+/* Returns the time of a monotonic clock in seconds. */
+double getTime()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Adds a message of a line to the messages of the context, and passes it to ctx->onDiagnostic. */
+void addDiagnostic(assemblerContext *ctx, int lineNum, bool isWarning, const char *format, va_list args)
+{
+	/* A message has at most one source line in it, so a longer message is only cut */
+	char message[MAX_MESSAGE_LENGTH];
+	int length = vsnprintf(message, sizeof(message), format, args);
+
+	if (length < 0)
+	{
+		return;
+	}
+	if (length >= (int)sizeof(message))
+	{
+		length = sizeof(message) - 1;
+	}
+
+	appendFormat(&ctx->messages, "[%s] At line %d: ", isWarning ? "Warning" : "Error", lineNum);
+	appendText(&ctx->messages, message, length);
+	appendText(&ctx->messages, "\n", 1);
+
+	if (ctx->onDiagnostic)
+	{
+		ctx->onDiagnostic(ctx->diagnosticArg, lineNum, isWarning, message, length);
+	}
+}
+
+/* Adds an error with the line number to the messages of the context. */
+void printError(assemblerContext *ctx, int lineNum, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	addDiagnostic(ctx, lineNum, FALSE, format, args);
+	va_end(args);
+}
+
+/* Adds a warning with the line number to the messages of the context. */
+void printWarning(assemblerContext *ctx, int lineNum, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	addDiagnostic(ctx, lineNum, TRUE, format, args);
+	va_end(args);
+}
+
+/* Adds a number in base 32 (2 chars, 10 bits) to the end of buf. */
+void appendBase32(textBuffer *buf, int num)
+{
+	appendText(buf, g_base32Pairs[num & (MEMORY_SIZE - 1)], BASE32_WORD_LENGTH);
+}
+
+/* Adds a number in base 32 without leading zeros, aligned to the right of a field of 'width' chars. */
+void appendBase32Number(textBuffer *buf, int num, int width)
+{
+	const char *pair = g_base32Pairs[num & (MEMORY_SIZE - 1)];
+	int digits = (pair[0] == BASE32_ZERO) ? 1 : 2;
+
+	while (width-- > digits)
+	{
+		appendText(buf, " ", 1);
+	}
+	appendText(buf, pair + BASE32_WORD_LENGTH - digits, digits);
+}
+
+/* Returns the value of a base 32 number of 'length' digits, or -1 if it isn't a base 32 number. */
+int base32ToInt(const char *digits, size_t length)
+{
+	const char *base32Digits = "!@#$%^&*<>abcdefghijklmnopqrstuv";
+	const char *digit;
+	int num = 0;
+
+	if (length == 0)
+	{
+		return -1;
+	}
+
+	while (length--)
+	{
+		digit = (*digits != '\0') ? strchr(base32Digits, *digits) : NULL;
+		if (!digit)
+		{
+			return -1;
+		}
+		num = num * 32 + (int)(digit - base32Digits);
+		digits++;
+	}
+
+	return num;
+}
+
+/* Adds the .ob file content of a memory image of IC code words and DC data words to the end of buf. */
+void appendObjectText(textBuffer *buf, const int *memory, int IC, int DC)
+{
+	/* Each word is a line of OBJECT_LINE_LENGTH chars: the address at OBJECT_ADDRESS_POS and the word at OBJECT_WORD_POS */
+	static const char lineTemplate[OBJECT_LINE_LENGTH + 1] = "\n       !!\t\t  !!";
+	int i, numOfWords = IC + DC;
+	char *out;
+
+	/* Print header (the code and the data lengths) */
+	appendText(buf, OBJECT_TITLE, strlen(OBJECT_TITLE));
+	appendBase32Number(buf, IC, 12);
+	appendBase32Number(buf, DC, 5);
+
+	/* Print the memory straight into the buffer - a table load and a store for each number */
+	if (!reserveText(buf, (size_t)numOfWords * OBJECT_LINE_LENGTH))
+	{
+		return;
+	}
+
+	out = buf->data + buf->length;
+	for (i = 0; i < numOfWords; i++)
+	{
+		memcpy(out, lineTemplate, OBJECT_LINE_LENGTH);
+		memcpy(out + OBJECT_ADDRESS_POS, g_base32Pairs[(FIRST_ADDRESS + i) & (MEMORY_SIZE - 1)], BASE32_WORD_LENGTH);
+		memcpy(out + OBJECT_WORD_POS, g_base32Pairs[memory[i] & (MEMORY_SIZE - 1)], BASE32_WORD_LENGTH);
+		out += OBJECT_LINE_LENGTH;
+	}
+	buf->length += (size_t)numOfWords * OBJECT_LINE_LENGTH;
+}
+
+/* Adds a line of a .ent or a .ext file (the name and the address in base 32) to the end of buf. */
+void appendSymbolLine(textBuffer *buf, const char *name, int address)
+{
+	/* Separate from the previous line */
+	if (buf->length)
+	{
+		appendText(buf, "\n", 1);
+	}
+
+	appendText(buf, name, strlen(name));
+	appendText(buf, "\t\t", 2);
+	appendBase32(buf, address);
+}
+
+/* Creates the .ob file content, which contains the assembled lines in base 32. */
+void createObjectFile(assemblerContext *ctx)
+{
+	appendObjectText(&ctx->objectOut, ctx->memoryArr, ctx->IC, ctx->DC);
+}
+
+/* Creates the .ent file content, which contains the addresses for the .entry labels in base 32. */
+void createEntriesFile(assemblerContext *ctx)
+{
+	int i;
+	lineInfo *entryLine;
+
+	for (i = 0; i < ctx->entryLabelsNum; i++)
+	{
+		entryLine = &ctx->linesArr[ctx->entryLines[i]];
+		appendSymbolLine(&ctx->entriesOut, entryLine->lineStr, getLabel(ctx, entryLine->lineStr)->address);
+	}
+}
+
+/* Creates the .ext file content, which contains the addresses for the extern labels operands in base 32. */
+/* The uses of the extern labels were collected while the second read encoded them. */
+void createExternFile(assemblerContext *ctx)
+{
+	int i;
+
+	for (i = 0; i < ctx->externNum; i++)
+	{
+		appendSymbolLine(&ctx->externOut, ctx->labelArr[ctx->externArr[i].labelId].name, ctx->externArr[i].address);
+	}
+}
+
+/* Resets all the state of the context, so it's ready for a new source. */
+void resetContext(assemblerContext *ctx)
+{
+	/* Release the text of all the lines and the parser temporaries at once */
+	arenaRelease(&ctx->arena);
+	ctx->linesFound = 0;
+
+	/* Reset the labels, the entry lines, the macros (and their hash indexes) and the extern uses */
+	ctx->labelNum = 0;
+	ctx->entryLabelsNum = 0;
+	ctx->macroNum = 0;
+	ctx->macroBodies.length = 0;
+	ctx->externNum = 0;
+	clearIndexes(ctx);
+
+	/* Reset the memory */
+	ctx->IC = 0;
+	ctx->DC = 0;
+
+	/* Empty the outputs (the arrays and the buffers keep their memory for the next source) */
+	ctx->expandedSource.length = 0;
+	ctx->objectOut.length = 0;
+	ctx->entriesOut.length = 0;
+	ctx->externOut.length = 0;
+	ctx->binaryOut.length = 0;
+	ctx->messages.length = 0;
+}
+
+/* Initializes an empty context. */
+void initContext(assemblerContext *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+/* Frees all the memory the context is holding. */
+void freeContext(assemblerContext *ctx)
+{
+	resetContext(ctx);
+
+	free(ctx->labelArr);
+	free(ctx->labelIndex);
+	free(ctx->entryLines);
+	free(ctx->entryIndex);
+	free(ctx->macroArr);
+	free(ctx->macroIndex);
+	free(ctx->macroBodies.data);
+	free(ctx->dataArr);
+	free(ctx->linesArr);
+	free(ctx->externArr);
+	free(ctx->memoryArr);
+	arenaFree(&ctx->arena);
+	free(ctx->expandedSource.data);
+	free(ctx->objectOut.data);
+	free(ctx->entriesOut.data);
+	free(ctx->externOut.data);
+	free(ctx->binaryOut.data);
+	free(ctx->messages.data);
+	initContext(ctx);
+}
+
+/* Creates the contents of the output files of a source that was read without errors. Returns the number of errors. */
+int createOutputs(assemblerContext *ctx)
+{
+	createObjectFile(ctx);
+	createExternFile(ctx);
+	createEntriesFile(ctx);
+
+	/* The binary object file is converted from the text outputs, so the two are always convertible */
+	if (ctx->createBinaryObject && !textToBinaryObject(&ctx->objectOut, &ctx->entriesOut, &ctx->externOut, &ctx->binaryOut))
+	{
+		appendFormat(&ctx->messages, "[Error] Not enough memory - malloc falied.\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* Returns the time if there are stats, so the phases aren't timed without them. */
+double getStatsTime(assemblerContext *ctx)
+{
+	return ctx->stats ? getTime() : 0;
+}
+
+/* Assembles the source in 'buffer' (of 'length' chars). */
+/* The outputs (.ob, .ent and .ext contents, and the messages) are left in ctx until the next call. */
+/* The .am content is created only if ctx->keepExpandedSource is set. */
+/* The .ob, .ent and .ext outputs are created only if there are no errors. Returns the number of errors. */
+/* If ctx->stats isn't NULL, the times of the phases and the counters of the source are added to it. */
+int assemble(const char *buffer, size_t length, assemblerContext *ctx)
+{
+	macroExpander expander;
+	size_t lineLength;
+	int numOfErrors = 0;
+	double start, expandTime = ctx->stats ? ctx->stats->expandTime : 0;
+
+	resetContext(ctx);
+
+	/* First Read (the macros are expanded while the lines are read) */
+	start = getStatsTime(ctx);
+	initMacroExpander(&expander, buffer, length);
+	numOfErrors += firstFileRead(ctx, &expander);
+
+	/* The first read stops when the memory is full - expand the rest so the .am content is complete */
+	if (ctx->keepExpandedSource)
+	{
+		while (nextExpandedLine(ctx, &expander, &lineLength) != NULL)
+		{
+			/* Each line is added to ctx->expandedSource */
+		}
+	}
+
+	/* The expansion is timed by nextExpandedLine, so its time is taken out of the first read */
+	if (ctx->stats)
+	{
+		ctx->stats->firstReadTime += getTime() - start - (ctx->stats->expandTime - expandTime);
+		start = getTime();
+	}
+
+	/* Second Read */
+	numOfErrors += secondFileRead(ctx);
+
+	if (ctx->stats)
+	{
+		ctx->stats->secondReadTime += getTime() - start;
+		start = getTime();
+	}
+
+	/* Create Output Files */
+	if (numOfErrors == 0)
+	{
+		numOfErrors += createOutputs(ctx);
+	}
+
+	if (ctx->stats)
+	{
+		ctx->stats->outputTime += getTime() - start;
+		ctx->stats->lines += ctx->linesFound;
+		ctx->stats->labels += ctx->labelNum;
+		ctx->stats->codeWords += ctx->IC;
+		ctx->stats->dataWords += ctx->DC;
+	}
+
+	return numOfErrors;
+}
\ No newline at end of file
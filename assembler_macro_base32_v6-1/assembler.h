@@ -7,6 +7,7 @@ Contains macros, data structures and methods declaration.
 	#define ASSEMBLER_H
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 
 /* ======== Macros ======== */
@@ -17,16 +18,50 @@ Contains macros, data structures and methods declaration.
 #define TRUE				1
 
 /* Given Constants */
-#define MAX_DATA_NUM		1000
 #define FIRST_ADDRESS		100 
 #define MAX_LINE_LENGTH		80
 #define MAX_LABEL_LENGTH	30
 #define MEMORY_WORD_LENGTH	10
 #define MAX_REGISTER_DIGIT	7
+#define MEMORY_SIZE			(1 << MEMORY_WORD_LENGTH) /* The addresses are 10 bits words */
 
 /* Defining Constants */
-#define MAX_LINES_NUM		700
-#define MAX_LABELS_NUM		MAX_LINES_NUM 
+#define CMD_NAME_LENGTH		3
+#define CMD_HASH_SIZE		32 /* Power of 2 */
+#define DIRC_HASH_SIZE		8 /* Power of 2 */
+#define MIN_INDEX_SIZE		64 /* Power of 2. The hash indexes grow to keep at least twice the slots than labels */
+#define MIN_ARRAY_CAPACITY	64
+#define BASE32_WORD_LENGTH	2 /* The number of base 32 digits in a memory word */
+#define BASE32_ZERO			'!' /* The base 32 digit of 0 */
+#define OBJECT_TITLE		"Base32 address  Base32 code\n" /* The first line of the .ob file */
+#define OBJECT_LINE_LENGTH	16 /* The length of a word line in the .ob file */
+#define OBJECT_ADDRESS_POS	8 /* The position of the address in a word line */
+#define OBJECT_WORD_POS		14 /* The position of the word in a word line */
+#define MAX_MESSAGE_LENGTH	256 /* The max length of an error message */
+#define ARENA_BLOCK_SIZE	65536 /* The default size of an arena block */
+#define CACHE_VERSION		"3" /* Change it when the outputs change, so the old cache entries aren't used */
+#define CACHE_KEY_LENGTH	40 /* The max length of a cache key */
+#define OBJECT_MAGIC		"AO32" /* The first bytes of a binary object file */
+#define OBJECT_VERSION		1
+#define OBJECT_BYTE_ORDER	0x0102 /* Tells if the binary object was written with the byte order of the reader */
+#define SCAN_WORD_BITS		32 /* The bits used in each word of a line mask */
+#define SCAN_WORDS			((MAX_LINE_LENGTH + SCAN_WORD_BITS) / SCAN_WORD_BITS) /* The words of a line mask (a bit for each char and the '\0') */
+#define SCAN_PADDING		32 /* The '\0' chars after a scanned line, so it's read in whole blocks of up to 32 chars */
+#define ERA_BITS			2 /* The low bits of a memory word that hold its era */
+#define WORD_MASK			(MEMORY_SIZE - 1) /* The bits of a memory word */
+#define NUM_OF_REGISTERS	(MAX_REGISTER_DIGIT + 1)
+#define SIM_STACK_SIZE		256 /* The max depth of jsr calls in the simulator */
+#define SIM_SLOT(address)	((address) + 2) /* The slot of an address in the simulator (2 slots before address 0) */
+#define SIM_SCRATCH_SLOT	SIM_SLOT(MEMORY_SIZE + 3) /* 3 slots that are never run (the invalidated slots of the register writes) */
+#define SIM_SLOTS			(SIM_SCRATCH_SLOT + 3)
+#define SIM_LANES			32 /* The machines run together by the lockstep simulator (the bits of an unsigned long) */
+#define SIGN_BIT(bits)			(1 << ((bits) - 1))
+#define SIGN_EXTEND(num, bits)	((((num) & ((1 << (bits)) - 1)) ^ SIGN_BIT(bits)) - SIGN_BIT(bits)) /* The signed value of the low bits of num */
+
+/* Perfect hashes of the command and directive names. */
+/* The factors were chosen so each name in g_cmdArr / g_dircArr gets its own slot. */
+#define CMD_HASH(name)		(((unsigned char)(name)[0] * 3 + (unsigned char)(name)[1] * 28 + (unsigned char)(name)[2]) & (CMD_HASH_SIZE - 1))
+#define DIRC_HASH(name)		(((unsigned char)(name)[0] + (unsigned char)(name)[3]) & (DIRC_HASH_SIZE - 1))
 
 /* ======== Data Structures ======== */
 typedef unsigned int bool; /* Only get TRUE or FALSE values */
@@ -37,7 +72,7 @@ typedef unsigned int bool; /* Only get TRUE or FALSE values */
 typedef struct
 {
 	int address;					/* The address it contains */
-	char name[MAX_LABEL_LENGTH];	/* The name of the label */					
+	char name[MAX_LABEL_LENGTH + 1];	/* The name of the label (+1 for the '\0') */					
 	bool isExtern;					/* Extern flag */
 	bool isData;					/* Data flag (.data or .string) */
 } labelInfo;
@@ -54,17 +89,29 @@ typedef struct
 	char *name;
 	unsigned int opcode : 4;
 	int numOfParams;
+	int srcTypes;		/* The legal source operand types (OP_TYPE_BIT flags) */
+	int destTypes;		/* The legal destination operand types (OP_TYPE_BIT flags) */
 } command;
 
 /* Operands */
 typedef enum { NUMBER = 0, LABEL = 1,  STRUCT = 2, REGISTER = 3, INVALID = -1 } opType;
 
+#define OP_TYPE_BIT(type)	(1 << (type))
+#define NO_OP_TYPES			0
+#define ALL_OP_TYPES		(OP_TYPE_BIT(NUMBER) | OP_TYPE_BIT(LABEL) | OP_TYPE_BIT(STRUCT) | OP_TYPE_BIT(REGISTER))
+#define WRITABLE_OP_TYPES	(OP_TYPE_BIT(LABEL) | OP_TYPE_BIT(STRUCT) | OP_TYPE_BIT(REGISTER))
+#define ADDRESS_OP_TYPES	(OP_TYPE_BIT(LABEL) | OP_TYPE_BIT(STRUCT))
+
 typedef struct
 {
 	int value;				/* Value */
-	char *str;				/* String */
+	char *str;				/* String (a view into the line) */
+	size_t length;			/* The length of str */
 	opType type;			/* Type */
 	int address;			/* The adress of the operand in the memory */
+	const char *structLabel;	/* The label of a STRUCT operand (a view into str, not '\0' terminated) */
+	size_t structLabelLength;	/* The length of structLabel */
+	int structField;		/* The field of a STRUCT operand (1 or 2) */
 } operandInfo;
 
 /* Line */
@@ -72,10 +119,10 @@ typedef struct
 {
 	int lineNum;				/* The number of the line in the file */
 	int address;				/* The address of the first word in the line */
-	char *originalString;		/* The original pointer, allocated by malloc */
+	char *originalString;		/* The original pointer, allocated in the arena of the context */
 	char *lineStr;				/* The text it contains (changed while using parseLine) */
 	bool isError;				/* Represent whether there is an error or not */
-	labelInfo *label;			/* A poniter to the lines label in labelArr */
+	int labelId;				/* The id of the lines label in labelArr (-1 if there isn't) */
 
 	char *commandStr;			/* The string of the command or directive */
 
@@ -85,12 +132,24 @@ typedef struct
 	operandInfo op2;			/* The 2nd operand */
 } lineInfo;
 
-/* macro list */
-typedef struct macroList{
-	char name[255];
-	char line[255];
-    struct macroList *next;
-} macroList;
+/* The classes of chars in the masks of a scanned line */
+typedef enum { CHAR_SPACE, CHAR_END, CHAR_COLON, CHAR_COMMA, CHAR_QUOTE, CHAR_SEMICOLON, CHAR_HASH, NUM_OF_CHAR_CLASSES } charClass;
+
+/* The masks of the classes of chars in the line being parsed (bit i of a mask is for text[i]) */
+/* CHAR_END is for the '\0' chars: the end of the line, and the ends of the tokens the parser cut */
+typedef struct
+{
+	char *text;						/* The line */
+	unsigned long masks[NUM_OF_CHAR_CLASSES][SCAN_WORDS];
+} lineScan;
+
+/* Macro */
+typedef struct
+{
+	char *name;					/* The name of the macro, allocated in the arena of the context */
+	size_t bodyStart;			/* The offset of the body lines in ctx->macroBodies */
+	size_t bodyLength;			/* The length of the body lines (a '\n' after each line) */
+} macroInfo;
 
 /* === Second Read  === */
 
@@ -126,39 +185,413 @@ typedef struct /* 10 bits */
 
 } memoryWord;
 
+/* A use of an extern label in the code */
+typedef struct
+{
+	int labelId;				/* The id of the extern label in ctx->labelArr */
+	int address;				/* The address of the word that uses it */
+} externRef;
+
+/* === Binary Object === */
+
+/* The header of a binary object file (the .obj file). */
+/* The file is used in place after it's mapped into memory: the tables are at the given offsets (from the start */
+/* of the file), and every offset is aligned to the size of its elements. The numbers are in the byte order */
+/* of the machine that wrote the file (checked with byteOrder). */
+typedef struct
+{
+	char magic[4];					/* OBJECT_MAGIC */
+	unsigned short byteOrder;		/* OBJECT_BYTE_ORDER */
+	unsigned short version;			/* OBJECT_VERSION */
+	unsigned short firstAddress;	/* The address of the first word */
+	unsigned short IC;				/* The number of code words */
+	unsigned short DC;				/* The number of data words (after the code words) */
+	unsigned short reserved;
+	unsigned int numOfEntries;
+	unsigned int numOfExterns;
+	unsigned int numOfRelocations;
+	unsigned int wordsOffset;		/* unsigned short[IC + DC] - the memory image (a 10 bits word in each) */
+	unsigned int relocationsOffset;	/* unsigned short[numOfRelocations] - the indexes of the relocatable code words */
+	unsigned int entriesOffset;		/* objectSymbol[numOfEntries] - the .ent lines */
+	unsigned int externsOffset;		/* objectSymbol[numOfExterns] - the .ext lines */
+	unsigned int namesOffset;		/* The '\0' terminated names of the symbols */
+	unsigned int namesSize;
+} objectHeader;
+
+/* A symbol of a binary object file */
+typedef struct
+{
+	unsigned int nameOffset;		/* The offset of the name from namesOffset */
+	unsigned short address;
+	unsigned short reserved;
+} objectSymbol;
+
+/* === Assembler Context === */
+
+/* A growable text buffer (used for the output files and the messages) */
+typedef struct
+{
+	char *data;				/* The text (not '\0' terminated) */
+	size_t length;			/* The length of the text */
+	size_t capacity;		/* The allocated size of data */
+} textBuffer;
+
+/* Reads lines from a source buffer in memory */
+typedef struct
+{
+	const char *pos;		/* The next char to read */
+	const char *end;		/* The end of the buffer */
+} sourceReader;
+
+/* Streams the lines of a source after the macros expansion */
+typedef struct
+{
+	sourceReader reader;		/* The raw source */
+	sourceReader body;			/* The rest of the body of the macro call being expanded (empty if none) */
+} macroExpander;
+
+/* A block of memory in an arena */
+typedef struct arenaBlock
+{
+	struct arenaBlock *next;	/* The next block in the arena */
+	size_t size;				/* The size of data */
+	size_t used;				/* How many bytes of data are allocated */
+	char *data;					/* The memory of the block (right after the block header) */
+} arenaBlock;
+
+/* A bump allocator. Allocations are never freed one by one - the whole arena is released at once. */
+/* The blocks are kept when the arena is released, so a reused arena doesn't call malloc again. */
+typedef struct
+{
+	arenaBlock *first;			/* The first block (NULL if nothing was allocated yet) */
+	arenaBlock *current;		/* The block the allocations are taken from */
+} memoryArena;
+
+/* The counters of assembling sources (only filled when ctx->stats isn't NULL) */
+typedef struct
+{
+	double expandTime;				/* The macros expansion (seconds) */
+	double firstReadTime;			/* The first read, without the macros expansion */
+	double secondReadTime;
+	double outputTime;				/* Creating and writing the output files */
+	unsigned long files;
+	unsigned long cachedFiles;		/* The files that were taken from the cache */
+	unsigned long lines;			/* The lines after the macros expansion */
+	unsigned long labels;
+	unsigned long macroCalls;		/* The macro calls that were expanded */
+	unsigned long codeWords;		/* IC */
+	unsigned long dataWords;		/* DC */
+	unsigned long symbolLookups;	/* The searches in the labels table */
+	unsigned long bytesRead;
+	unsigned long bytesWritten;
+} assemblerStats;
+
+/* Adds 1 to a counter of ctx->stats (if there are stats) */
+#define COUNT_STAT(ctx, counter)	((ctx)->stats ? (void)(ctx)->stats->counter++ : (void)0)
+
+/* Called for each error and warning of a line with its message (not '\0' terminated), and the context's diagnosticArg */
+typedef void (*diagnosticFunc)(void *arg, int lineNum, bool isWarning, const char *message, size_t length);
+
+/* All the state of assembling one source. */
+/* Each context is independent, so one process can assemble many sources (even at the same time). */
+/* The arrays grow geometrically with the source, and keep their memory when the context is reused. */
+typedef struct
+{
+	/* Labels */
+	labelInfo *labelArr;
+	int labelNum;
+	int labelCapacity;
+	int *labelIndex;				/* Hash index of labelArr (id + 1, 0 is an empty slot) */
+	int labelIndexSize;				/* Power of 2 */
+
+	/* Entry Lines */
+	int *entryLines;				/* The ids of the .entry lines in linesArr */
+	int entryLabelsNum;
+	int entryCapacity;
+	int *entryIndex;				/* Hash index of entryLines (id + 1, 0 is an empty slot) */
+	int entryIndexSize;				/* Power of 2 */
+
+	/* Data */
+	int *dataArr;
+	int dataCapacity;
+
+	/* Lines */
+	lineInfo *linesArr;
+	int linesFound;
+	int linesCapacity;
+
+	/* Macros */
+	macroInfo *macroArr;
+	int macroNum;
+	int macroCapacity;
+	int *macroIndex;				/* Hash index of macroArr (id + 1, 0 is an empty slot) */
+	int macroIndexSize;				/* Power of 2 */
+	textBuffer macroBodies;			/* The body lines of all the macros, each body is contiguous */
+
+	/* The text of the lines and the parser temporaries */
+	memoryArena arena;
+	lineScan scan;					/* The classes of the chars of the line being parsed */
+
+	/* Extern References (in the order they are encoded) */
+	externRef *externArr;
+	int externNum;
+	int externCapacity;
+
+	/* Memory */
+	int *memoryArr;
+	int memoryCapacity;
+	int IC;
+	int DC;
+
+	/* Outputs */
+	bool keepExpandedSource;		/* Fill expandedSource while assembling (a debug output) */
+	textBuffer expandedSource;		/* The source after the macros expansion (the .am file) */
+	textBuffer objectOut;			/* The .ob file */
+	textBuffer entriesOut;			/* The .ent file (empty if there aren't entry labels) */
+	textBuffer externOut;			/* The .ext file (empty if there aren't extern operands) */
+	bool createBinaryObject;		/* Fill binaryOut too */
+	textBuffer binaryOut;			/* The binary object file (the .obj file) */
+	textBuffer messages;			/* The errors and warnings */
+	diagnosticFunc onDiagnostic;	/* Also gets each error and warning (NULL if not needed) */
+	void *diagnosticArg;
+	assemblerStats *stats;			/* The counters are added to it (NULL if they aren't needed) */
+} assemblerContext;
+
+/* === Thread Pool === */
+
+/* A job of the thread pool, called with the job id, the id of the worker running it, and the pool argument */
+typedef void (*jobFunc)(int jobId, int workerId, void *arg);
+
+/* === Simulator === */
+
+/* The operations of the simulator: the opcodes of g_cmdArr (in the same order), and then the special slots */
+typedef enum
+{
+	SIM_MOV, SIM_CMP, SIM_ADD, SIM_SUB, SIM_NOT, SIM_CLR, SIM_LEA, SIM_INC,
+	SIM_DEC, SIM_JMP, SIM_BNE, SIM_GET, SIM_PRN, SIM_JSR, SIM_RST, SIM_HLT,
+	SIM_DECODE, SIM_BAD_INSTRUCTION, SIM_BAD_ADDRESS, NUM_OF_SIM_OPS
+} simOp;
+
+/* Why the simulator stopped (SIM_TIMEOUT is set by the callers that limit the time of a run) */
+typedef enum { SIM_HALTED, SIM_STEP_LIMIT, SIM_ILLEGAL_INSTRUCTION, SIM_ILLEGAL_ADDRESS, SIM_STACK_OVERFLOW, SIM_STACK_UNDERFLOW, SIM_TIMEOUT, NUM_OF_SIM_RESULTS } simResult;
+
+/* A predecoded instruction, with its operands resolved into pointers */
+typedef struct
+{
+	int op;							/* The opcode or a simOp */
+	int *src;						/* The source value: a register, a memory word, or imm[0] */
+	int *dst;						/* The destination value: a register, a memory word, or imm[1] */
+	int dirty;						/* The first of the 3 slots decoded again after dst is written */
+	int next;						/* The address of the next instruction */
+	int imm[2];						/* The immediate values (and the addresses of lea and the jumps) */
+} simInstruction;
+
+/* The counters of a profiled run of the simulator, by the slot of each address (see SIM_SLOT) */
+typedef struct
+{
+	unsigned long runs[SIM_SLOTS];	/* The times the instruction at each address ran */
+	unsigned long taken[SIM_SLOTS];	/* The times the instruction at each address jumped (to an address other than its next) */
+} simProfile;
+
+/* The state of the simulated machine */
+typedef struct
+{
+	int memory[MEMORY_SIZE];		/* The 10 bits words */
+	int registers[NUM_OF_REGISTERS];
+	bool zeroFlag;					/* Set by cmp, used by bne */
+	int pc;
+	int stack[SIM_STACK_SIZE];		/* The return addresses of jsr */
+	int stackSize;
+	simInstruction slots[SIM_SLOTS];	/* The decoded instruction at each address (see SIM_SLOT) */
+	unsigned long steps;			/* The instructions that were run */
+	sourceReader input;				/* The numbers read by get */
+	textBuffer output;				/* The numbers printed by prn */
+	simProfile *profile;			/* Counts the instructions of runMachine (NULL if they aren't counted) */
+} simMachine;
+
+/* The compiled code of the JIT, for the blocks of one image */
+typedef struct
+{
+	void *blocks[MEMORY_SIZE];		/* The code of the block that starts at each address (NULL if it isn't compiled) */
+	unsigned char isCode[MEMORY_SIZE];	/* If the word at each address is a part of a compiled block */
+	unsigned long stepsLeft;		/* The steps left, passed to and from the compiled code */
+	int notZero;					/* The zero flag (0 if it's set), passed to and from the compiled code */
+	unsigned char *code;			/* The executable memory: the shared code, and then the blocks */
+	size_t codeSize;
+	size_t codeUsed;
+	size_t sharedSize;				/* The size of the shared code (the entry at its start, the dispatch and the exits) */
+	size_t dispatch;				/* The offset of the code that jumps to the block of the address in eax */
+	size_t exitLookup;				/* The offset of the exit for an address without a block */
+	size_t exitInterpret;			/* The offset of the exit for an instruction that runs on the interpreter */
+	int numOfBlocks;				/* The blocks that were compiled since the image was loaded */
+	int numOfFlushes;				/* The times the code was thrown away since the image was loaded */
+} simJit;
+
+/* An instruction of the lockstep simulator, shared by its lanes, with its operands resolved into rows of lanes */
+typedef struct
+{
+	int op;							/* The opcode or a simOp (SIM_DECODE until it runs for the first time) */
+	unsigned short *src;			/* The source row: a register, a memory word, or imm[0] */
+	unsigned short *dst;			/* The destination row: a register, a memory word, or imm[1] */
+	int dstAddress;				/* The address of a memory destination (-1 if it isn't a memory word) */
+	int target;					/* The address of a direct jump (-1 if it jumps to a register) */
+	int next;					/* The address of the next instruction */
+	unsigned long writtenLanes;	/* The lanes that wrote to its words before it was decoded */
+	unsigned short imm[2][SIM_LANES];	/* The immediate values in each lane (and the addresses of lea) */
+} lockstepInstruction;
+
+/* The lanes of the lockstep simulator: the machines of one image, each with its own input, as rows of lanes */
+typedef struct
+{
+	unsigned short memory[MEMORY_SIZE][SIM_LANES];	/* The 10 bits words, in 16 bits lanes */
+	unsigned short registers[NUM_OF_REGISTERS][SIM_LANES];
+	unsigned short notZero[SIM_LANES];	/* The zero flag (0 if it's set) */
+	unsigned short active[SIM_LANES];	/* 0xFFFF in the lanes that are running, and 0 in the others */
+	unsigned long running;			/* The bits of the lanes that are running */
+	unsigned short at[SIM_LANES];	/* The address each lane runs next when they aren't together (above the memory when it stopped) */
+	int pc[SIM_LANES];				/* The pc of each lane when it stopped */
+	int stack[SIM_LANES][SIM_STACK_SIZE];	/* The return addresses of jsr */
+	int stackSize[SIM_LANES];
+	unsigned long idle[SIM_LANES];	/* The steps each lane waited for the other lanes */
+	unsigned short waited[SIM_LANES];	/* The steps each lane waited that weren't added to idle yet */
+	unsigned long steps[SIM_LANES];	/* The instructions each lane ran (when it stopped) */
+	simResult result[SIM_LANES];	/* Why each lane stopped */
+	sourceReader input[SIM_LANES];	/* The numbers read by get in each lane */
+	textBuffer output[SIM_LANES];	/* The numbers printed by prn in each lane */
+	unsigned long writtenLanes[MEMORY_SIZE];	/* The lanes that wrote to each word */
+	bool isCode[MEMORY_SIZE];		/* If the word at each address is a part of a decoded instruction */
+	lockstepInstruction code[MEMORY_SIZE];	/* The shared instruction at each address */
+	lockstepInstruction badAddress;	/* The instruction past the end of the memory */
+	simMachine image;				/* The image, decoded by the simulator into the shared instructions */
+	simMachine lane;				/* Runs a lane on its own after it changed its code */
+} lockstepMachine;
 
 /* ======== Methods Declaration ======== */
 /* utility.c methods */
-int getCmdId(char *cmdName);
-labelInfo *getLabel(char *labelName);
-void trimLeftStr(char **ptStr);
-void trimStr(char **ptStr);
-char *getFirstTok(char *str, char **endOfTok);
-char * getLabelStruct(char *val);
-bool isOneWord(char *str);
-bool isWhiteSpaces(char *str);
-bool isLegalLabel(char *label, int lineNum, bool printErrors);
-bool isStruct(char *val, int lineNum, bool printErrors);
-bool isExistingLabel(char *label);
-bool isExistingEntryLabel(char *labelName);
-bool isRegister(char *str, int *value);
-bool isCommentOrEmpty(lineInfo *line);
-char *getFirstOperand(char *line, char **endOfOp, bool *foundComma);
+int getCmdId(const char *cmdName, size_t length);
+int getDircId(char *dircName);
+labelInfo *getLabel(assemblerContext *ctx, char *labelName);
+labelInfo *getLabelView(assemblerContext *ctx, const char *labelName, size_t length);
+bool isLegalLabel(assemblerContext *ctx, char *label, int lineNum, bool printErrors);
+bool isLegalLabelView(assemblerContext *ctx, const char *label, size_t length, int lineNum, bool printErrors);
+bool parseStructOperand(assemblerContext *ctx, operandInfo *operand, int lineNum);
+bool isExistingLabel(assemblerContext *ctx, char *label);
+bool isExistingEntryLabel(assemblerContext *ctx, char *labelName);
+bool addLabelToIndex(assemblerContext *ctx, int labelId);
+void removeLabelFromIndex(assemblerContext *ctx, int labelId);
+bool addEntryToIndex(assemblerContext *ctx, int entryId);
+void clearIndexes(assemblerContext *ctx);
+void *reserveArray(void *arr, int *capacity, int needed, size_t elemSize);
+bool isRegister(const char *str, size_t length, int *value);
+bool isCommentOrEmpty(assemblerContext *ctx, lineInfo *line);
 bool isDirective(char *cmd);
-bool isLegalStringParam(char **strParam, int lineNum);
-bool isLegalNum(char *numStr, int numOfBits, int lineNum, int *value);
-int addToMacroList(macroList **head, char *label, char *val);
-int removeMacros(char *filename);
-
+bool isLegalStringParam(assemblerContext *ctx, char **strParam, int lineNum);
+bool isLegalNum(assemblerContext *ctx, char *numStr, int numOfBits, int lineNum, int *value);
+macroInfo *getMacro(assemblerContext *ctx, const char *macroName);
+macroInfo *addMacro(assemblerContext *ctx, const char *macroName);
+const char *getTokenSlice(const char *str, const char *end, size_t *tokLength);
+void initMacroExpander(macroExpander *expander, const char *source, size_t length);
+const char *expandLine(assemblerContext *ctx, macroExpander *expander, size_t *length);
+const char *nextExpandedLine(assemblerContext *ctx, macroExpander *expander, size_t *length);
+
+/* lineScan.c methods */
+void scanLine(lineScan *scan, char *text, size_t length);
+void setLineChar(lineScan *scan, char *pos, char c);
+char *findChars(lineScan *scan, char *from, charClass type);
+char *skipChars(lineScan *scan, char *from, charClass type);
+char *findLastOtherChar(lineScan *scan, char *from, char *to, charClass type);
+bool isCharClass(lineScan *scan, const char *pos, charClass type);
+void trimLeftStr(lineScan *scan, char **ptStr);
+void trimStr(lineScan *scan, char **ptStr);
+char *getFirstTok(lineScan *scan, char *str, char **endOfTok);
+bool isOneWord(lineScan *scan, char *str);
+bool isWhiteSpaces(lineScan *scan, char *str);
+char *getFirstOperand(lineScan *scan, char *line, char **endOfOp, bool *foundComma);
 
 /* firstRead.c methods */
-int firstFileRead(FILE *file, lineInfo *linesArr, int *linesFound, int *IC, int *DC);
+const char *nextLine(sourceReader *reader, size_t *length);
+void parseLine(assemblerContext *ctx, lineInfo *line, const char *lineStr, size_t length, int lineNum);
+int firstFileRead(assemblerContext *ctx, macroExpander *expander);
 
 /* secondRead.c methods */
-int secondFileRead(int *memoryArr, lineInfo *linesArr, int lineNum, int IC, int DC);
-
-/* main.c methods */
-void printError(int lineNum, const char *format, ...);
+int secondFileRead(assemblerContext *ctx);
+
+/* assembler.c methods */
+void *arenaAlloc(memoryArena *arena, size_t size);
+char *arenaCopy(memoryArena *arena, const char *str, size_t length);
+char *arenaString(memoryArena *arena, const char *str);
+void arenaRelease(memoryArena *arena);
+void arenaFree(memoryArena *arena);
+void initContext(assemblerContext *ctx);
+void resetContext(assemblerContext *ctx);
+void freeContext(assemblerContext *ctx);
+int createOutputs(assemblerContext *ctx);
+int assemble(const char *buffer, size_t length, assemblerContext *ctx);
+bool reserveText(textBuffer *buf, size_t length);
+bool appendText(textBuffer *buf, const char *str, size_t length);
+bool appendFormat(textBuffer *buf, const char *format, ...);
+void printError(assemblerContext *ctx, int lineNum, const char *format, ...);
+void printWarning(assemblerContext *ctx, int lineNum, const char *format, ...);
+void appendJsonString(textBuffer *buf, const char *str, size_t length);
+double getTime();
+double getStatsTime(assemblerContext *ctx);
+int base32ToInt(const char *digits, size_t length);
+void appendBase32(textBuffer *buf, int num);
+void appendObjectText(textBuffer *buf, const int *memory, int IC, int DC);
+void appendSymbolLine(textBuffer *buf, const char *name, int address);
+
+/* objectFormat.c methods */
+bool textToBinaryObject(const textBuffer *object, const textBuffer *entries, const textBuffer *externs, textBuffer *out);
+const objectHeader *loadBinaryObject(const char *data, size_t length);
+bool binaryToTextObject(const objectHeader *header, textBuffer *object, textBuffer *entries, textBuffer *externs);
+
+/* files.c methods */
+FILE *openFile(char *name, char *ending, const char *mode);
+char *readFile(char *name, char *ending, size_t *length);
+const char *mapFile(char *name, char *ending, size_t *length, bool *isMapped);
+void releaseFile(const char *content, size_t length, bool isMapped);
+void readTextFile(char *name, char *ending, textBuffer *buf);
+const objectHeader *loadImage(char *fileName, bool binaryInput, textBuffer *object, textBuffer *externs, textBuffer *binary, const char **content, size_t *length, bool *isMapped, textBuffer *report);
+void writeFile(char *name, char *ending, textBuffer *buf, textBuffer *report);
+void writeOutput(assemblerContext *ctx, char *fileName, char *ending, textBuffer *content, textBuffer *report);
+int parseFile(assemblerContext *ctx, char *fileName, char *cacheDir, textBuffer *report);
+
+/* cache.c methods */
+bool openCache(char *cacheDir);
+void getCacheKey(const char *source, size_t length, char *key);
+bool loadFromCache(char *cacheDir, char *key, const char *source, size_t length, char *fileName, bool needBinary, textBuffer *messages);
+void storeInCache(char *cacheDir, char *key, const char *source, size_t length, char *fileName, assemblerContext *ctx);
+
+/* lsp.c methods */
+int runLanguageServer();
+
+/* server.c methods */
+int runAssemblerServer(char *socketPath, int numOfWorkers, char *cacheDir, bool writeExpandedSource, bool writeBinaryObject);
+
+/* simulator.c methods */
+void loadMachine(simMachine *machine, const objectHeader *header);
+void decodeInstruction(simMachine *machine, int address);
+void invalidateSlots(simMachine *machine);
+simResult runMachine(simMachine *machine, unsigned long maxSteps);
+int readInputNumber(sourceReader *input);
+const char *getSimResultText(simResult result);
+
+/* profile.c methods */
+void appendProfile(textBuffer *out, simMachine *machine, char *fileName, assemblerContext *ctx);
+
+/* jit.c methods */
+simJit *createJit();
+void freeJit(simJit *jit);
+void flushJit(simJit *jit);
+simResult runJit(simJit *jit, simMachine *machine, unsigned long maxSteps);
+
+/* lockstep.c methods */
+void loadLockstep(lockstepMachine *lockstep, const objectHeader *header, const sourceReader *inputs, int numOfLanes);
+void runLockstep(lockstepMachine *lockstep, unsigned long maxSteps);
+
+/* threadPool.c methods */
+int getNumOfCores();
+void runJobs(int numOfJobs, int numOfWorkers, jobFunc func, void *arg);
 
 
 #endif
\ No newline at end of file
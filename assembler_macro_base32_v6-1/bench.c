@@ -0,0 +1,637 @@
+/*
+The benchmark.
+Generates legal programs of a given size and mix of lines, assembles them with the assembler library,
+and times each phase: the macros expansion, the first read, the second read and the output files.
+A program must fit in the memory of the machine, so the lines are split into as many programs as needed.
+The results can be saved as a baseline, and compared with a saved baseline (the time per line of each phase).
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdlib.h>
+
+/* ======== Macros ======== */
+#define BENCH_MACROS			3 /* The number of macros each program defines */
+#define MAX_STATEMENT_WORDS		16 /* The most words one generated line (or macro call) can take */
+#define MAX_BENCH_STRING		10 /* The max length of a generated string */
+#define NUM_OF_PHASES			4
+
+/* ====== Externs ====== */
+/* Use the commands list from firstRead.c */
+extern const command g_cmdArr[];
+
+/* ======== Data Structures ======== */
+
+/* The options from the command line */
+typedef struct
+{
+	long numOfLines;			/* The number of source lines to generate (in all the programs) */
+	int labelPercent;			/* How many of the code and data lines have a label */
+	int macroPercent;			/* How many of the lines are macro calls */
+	int dataPercent;			/* How many of the lines are .data lines */
+	int stringPercent;			/* How many of the lines are .string lines */
+	int structPercent;			/* How many of the lines are .struct lines */
+	int numOfExterns;			/* The .extern lines of each program */
+	int numOfEntries;			/* The .entry lines of each program */
+	int repeats;				/* How many times the programs are assembled (the best time is taken) */
+	unsigned long seed;
+	char *writeDir;				/* Write the programs to this directory too (NULL if not) */
+	char *saveFile;				/* Save the results as a baseline (NULL if not) */
+	char *baselineFile;			/* Compare the results with a baseline (NULL if not) */
+	int threshold;				/* A phase that got slower by more percents is a regression */
+} benchOptions;
+
+/* The state of the programs generator */
+typedef struct
+{
+	benchOptions *options;
+	unsigned long random;		/* The state of the random numbers */
+	int numOfLabels;			/* The labels of the current program (L0, L1, ...) */
+	int *structLabels;			/* The ids of the .struct labels of the current program */
+	int numOfStructs;
+	int structCapacity;
+	int words;					/* The memory words of the current program */
+	long lines;					/* The lines of the current program */
+} benchGenerator;
+
+/* The time of each phase (in seconds) */
+typedef struct
+{
+	double phases[NUM_OF_PHASES];
+} benchTimes;
+
+const char *g_phaseNames[NUM_OF_PHASES] = { "macros", "firstRead", "secondRead", "outputs" };
+
+/* The words of the body of each macro the generator defines */
+const char *g_benchMacros[BENCH_MACROS] = { "inc r1\nmov r2, r3\n", "clr r4\nprn #5\n", "dec r5\ncmp r6, #1\nrst\n" };
+const int g_benchMacroWords[BENCH_MACROS] = { 4, 4, 6 };
+
+/* ====== Methods ====== */
+
+/* Returns a random number in [0, limit) (a 32 bits LCG, so the programs are the same on every machine). */
+int randomNum(benchGenerator *gen, int limit)
+{
+	gen->random = (gen->random * 1103515245u + 12345u) & 0xffffffffu;
+	return (int)((gen->random >> 16) % (unsigned long)limit);
+}
+
+/* Adds generated lines (a '\n' between them) to the program, and counts them. */
+void addBenchLine(benchGenerator *gen, textBuffer *buf, const char *line, int words)
+{
+	const char *pos;
+
+	appendText(buf, line, strlen(line));
+	appendText(buf, "\n", 1);
+	gen->words += words;
+	for (pos = line, gen->lines++; (pos = strchr(pos, '\n')) != NULL; pos++)
+	{
+		gen->lines++;
+	}
+}
+
+/* Returns the operand types (OP_TYPE_BIT flags) the current program can use. */
+int getAvailableTypes(benchGenerator *gen)
+{
+	int types = ALL_OP_TYPES;
+
+	/* A label operand needs a label (or an extern), and a struct operand needs a .struct label */
+	if (gen->numOfLabels + gen->options->numOfExterns == 0)
+	{
+		types &= ~OP_TYPE_BIT(LABEL);
+	}
+	if (gen->numOfStructs == 0)
+	{
+		types &= ~OP_TYPE_BIT(STRUCT);
+	}
+	return types;
+}
+
+/* Puts a random operand of a type from 'types' (OP_TYPE_BIT flags, at least one available) in 'operand'. */
+/* Returns its type. */
+opType generateOperand(benchGenerator *gen, int types, char *operand)
+{
+	int numOfExterns = gen->options->numOfExterns;
+	opType type;
+
+	types &= getAvailableTypes(gen);
+	do
+	{
+		type = (opType)randomNum(gen, REGISTER + 1);
+	} while (!(types & OP_TYPE_BIT(type)));
+
+	switch (type)
+	{
+	case NUMBER:
+		sprintf(operand, "#%d", randomNum(gen, 201) - 100);
+		break;
+	case LABEL:
+		if (numOfExterns && (gen->numOfLabels == 0 || randomNum(gen, 4) == 0))
+		{
+			sprintf(operand, "E%d", randomNum(gen, numOfExterns));
+		}
+		else
+		{
+			sprintf(operand, "L%d", randomNum(gen, gen->numOfLabels));
+		}
+		break;
+	case STRUCT:
+		sprintf(operand, "L%d.%d", gen->structLabels[randomNum(gen, gen->numOfStructs)], randomNum(gen, 2) + 1);
+		break;
+	default:
+		sprintf(operand, "r%d", randomNum(gen, MAX_REGISTER_DIGIT + 1));
+		break;
+	}
+
+	return type;
+}
+
+/* Puts a random command line in 'line'. Returns the number of its words. */
+int generateCommand(benchGenerator *gen, char *line)
+{
+	const command *cmd;
+	char src[MAX_LINE_LENGTH], dest[MAX_LINE_LENGTH];
+	opType srcType, destType;
+
+	/* Pick a command that has operands the program can use */
+	do
+	{
+		cmd = &g_cmdArr[randomNum(gen, 16)];
+	} while ((cmd->numOfParams > 0 && !(cmd->destTypes & getAvailableTypes(gen)))
+		|| (cmd->numOfParams > 1 && !(cmd->srcTypes & getAvailableTypes(gen))));
+
+	switch (cmd->numOfParams)
+	{
+	case 0:
+		strcat(line, cmd->name);
+		return 1;
+	case 1:
+		generateOperand(gen, cmd->destTypes, dest);
+		sprintf(line + strlen(line), "%s %s", cmd->name, dest);
+		return 2;
+	default:
+		srcType = generateOperand(gen, cmd->srcTypes, src);
+		destType = generateOperand(gen, cmd->destTypes, dest);
+		sprintf(line + strlen(line), "%s %s, %s", cmd->name, src, dest);
+
+		/* Two registers share one word */
+		return (srcType == REGISTER && destType == REGISTER) ? 2 : 3;
+	}
+}
+
+/* Puts a random string (in quotes) at the end of 'line'. Returns the number of its words. */
+int generateString(benchGenerator *gen, char *line)
+{
+	int length = randomNum(gen, MAX_BENCH_STRING) + 1, i;
+
+	line += strlen(line);
+	*line++ = '"';
+	for (i = 0; i < length; i++)
+	{
+		*line++ = (char)('a' + randomNum(gen, 26));
+	}
+	strcpy(line, "\"");
+	return length + 1;
+}
+
+/* Generates one legal program (that fits in the memory) to the end of buf, with 'maxLines' lines at most. */
+/* Returns FALSE if there isn't enough memory. */
+bool generateProgram(benchGenerator *gen, textBuffer *buf, long maxLines)
+{
+	benchOptions *options = gen->options;
+	char line[MAX_LINE_LENGTH * 2];
+	int i, kind, words, *newStructLabels;
+
+	gen->numOfLabels = 0;
+	gen->numOfStructs = 0;
+	gen->words = 0;
+	gen->lines = 0;
+
+	for (i = 0; i < options->numOfExterns; i++)
+	{
+		sprintf(line, ".extern E%d", i);
+		addBenchLine(gen, buf, line, 0);
+	}
+
+	/* The macros are defined once, and each call adds the words of its body */
+	for (i = 0; options->macroPercent && i < BENCH_MACROS; i++)
+	{
+		sprintf(line, "macro m%d\n%sendmacro", i, g_benchMacros[i]);
+		addBenchLine(gen, buf, line, 0);
+	}
+
+	while ((gen->lines == 0 || gen->lines + options->numOfEntries < maxLines) && gen->words + MAX_STATEMENT_WORDS <= MEMORY_SIZE - FIRST_ADDRESS)
+	{
+		kind = randomNum(gen, 100);
+		line[0] = '\0';
+
+		/* A macro call can't have a label */
+		if (kind < options->macroPercent)
+		{
+			i = randomNum(gen, BENCH_MACROS);
+			sprintf(line, "m%d", i);
+			addBenchLine(gen, buf, line, g_benchMacroWords[i]);
+			continue;
+		}
+		kind -= options->macroPercent;
+
+		if (kind >= options->dataPercent + options->stringPercent && kind < options->dataPercent + options->stringPercent + options->structPercent)
+		{
+			/* A struct is used by its label, so it always has one */
+			newStructLabels = (int *)reserveArray(gen->structLabels, &gen->structCapacity, gen->numOfStructs + 1, sizeof(int));
+			if (!newStructLabels)
+			{
+				return FALSE;
+			}
+			gen->structLabels = newStructLabels;
+			sprintf(line, "L%d: .struct %d, ", gen->numOfLabels, randomNum(gen, 1001) - 500);
+			words = 1 + generateString(gen, line);
+			gen->structLabels[gen->numOfStructs++] = gen->numOfLabels++;
+			addBenchLine(gen, buf, line, words);
+			continue;
+		}
+
+		if (randomNum(gen, 100) < options->labelPercent)
+		{
+			sprintf(line, "L%d: ", gen->numOfLabels++);
+		}
+
+		if (kind < options->dataPercent)
+		{
+			strcat(line, ".data ");
+			for (words = 0; words == 0 || (words < 5 && randomNum(gen, 2)); words++)
+			{
+				sprintf(line + strlen(line), words ? ", %d" : "%d", randomNum(gen, 1001) - 500);
+			}
+		}
+		else if (kind < options->dataPercent + options->stringPercent)
+		{
+			strcat(line, ".string ");
+			words = generateString(gen, line);
+		}
+		else
+		{
+			words = generateCommand(gen, line);
+		}
+		addBenchLine(gen, buf, line, words);
+	}
+
+	for (i = 0; i < options->numOfEntries && i < gen->numOfLabels; i++)
+	{
+		sprintf(line, ".entry L%d", i);
+		addBenchLine(gen, buf, line, 0);
+	}
+
+	return TRUE;
+}
+
+/* Generates the programs into 'sources', and puts the end of each program in *programEnds. */
+/* Returns the number of programs, or -1 if there isn't enough memory. */
+int generatePrograms(benchOptions *options, textBuffer *sources, size_t **programEnds, long *numOfLines)
+{
+	benchGenerator gen;
+	size_t *newProgramEnds;
+	int numOfPrograms = 0, capacity = 0;
+
+	memset(&gen, 0, sizeof(gen));
+	gen.options = options;
+	gen.random = options->seed;
+	*numOfLines = 0;
+
+	while (*numOfLines < options->numOfLines)
+	{
+		newProgramEnds = (size_t *)reserveArray(*programEnds, &capacity, numOfPrograms + 1, sizeof(size_t));
+		if (!newProgramEnds || !generateProgram(&gen, sources, options->numOfLines - *numOfLines))
+		{
+			free(gen.structLabels);
+			return -1;
+		}
+		*programEnds = newProgramEnds;
+		(*programEnds)[numOfPrograms++] = sources->length;
+		*numOfLines += gen.lines;
+	}
+
+	free(gen.structLabels);
+	return numOfPrograms;
+}
+
+/* Assembles a program, and adds the time of each phase to *times. Returns the number of errors. */
+/* The first read expands the macros while it reads, so the time of the expansion alone is taken from its time. */
+int benchProgram(assemblerContext *ctx, const char *source, size_t length, benchTimes *times)
+{
+	macroExpander expander;
+	size_t lineLength;
+	double start, expanded, firstRead, secondRead, outputs;
+	int numOfErrors;
+
+	resetContext(ctx);
+	initMacroExpander(&expander, source, length);
+	start = getTime();
+	while (nextExpandedLine(ctx, &expander, &lineLength) != NULL)
+	{
+		/* Only expand */
+	}
+	expanded = getTime();
+
+	resetContext(ctx);
+	initMacroExpander(&expander, source, length);
+	firstRead = getTime();
+	numOfErrors = firstFileRead(ctx, &expander);
+	secondRead = getTime();
+	numOfErrors += secondFileRead(ctx);
+	outputs = getTime();
+	if (numOfErrors == 0)
+	{
+		numOfErrors += createOutputs(ctx);
+	}
+
+	times->phases[0] += expanded - start;
+	times->phases[1] += (secondRead - firstRead) - (expanded - start);
+	times->phases[2] += outputs - secondRead;
+	times->phases[3] += getTime() - outputs;
+	return numOfErrors;
+}
+
+/* Reads a baseline file into *times and *numOfLines. Returns if it succeeded. */
+bool readBaseline(char *fileName, benchTimes *times, long *numOfLines)
+{
+	FILE *file = fopen(fileName, "r");
+	char name[MAX_LINE_LENGTH];
+	double value;
+	int i, found = 0;
+
+	if (!file)
+	{
+		return FALSE;
+	}
+
+	*numOfLines = 0;
+	while (fscanf(file, "%79s %lf", name, &value) == 2)
+	{
+		if (strcmp(name, "lines") == 0)
+		{
+			*numOfLines = (long)value;
+		}
+		for (i = 0; i < NUM_OF_PHASES; i++)
+		{
+			if (strcmp(name, g_phaseNames[i]) == 0)
+			{
+				times->phases[i] = value;
+				found++;
+			}
+		}
+	}
+
+	fclose(file);
+	return *numOfLines > 0 && found == NUM_OF_PHASES;
+}
+
+/* Saves the results as a baseline file ("name value" lines). Returns if it succeeded. */
+bool saveBaseline(char *fileName, benchTimes *times, long numOfLines)
+{
+	FILE *file = fopen(fileName, "w");
+	int i;
+
+	if (!file)
+	{
+		return FALSE;
+	}
+
+	fprintf(file, "lines %ld\n", numOfLines);
+	for (i = 0; i < NUM_OF_PHASES; i++)
+	{
+		fprintf(file, "%s %.9f\n", g_phaseNames[i], times->phases[i]);
+	}
+	return fclose(file) == 0;
+}
+
+/* Prints the results (and the change from the baseline, if there is one). */
+/* Returns the number of phases that got slower than the threshold. */
+int printResults(benchTimes *times, long numOfLines, benchTimes *baseline, long baselineLines, int threshold)
+{
+	double total = 0, baselineTotal = 0, perLine, baselinePerLine, change;
+	int i, regressions = 0;
+
+	printf("%-12s %12s %10s", "Phase", "Time (ms)", "ns/line");
+	printf(baseline ? " %12s %9s\n" : "\n", "Base ns/line", "Change");
+
+	for (i = 0; i <= NUM_OF_PHASES; i++)
+	{
+		/* The last row is the total */
+		if (i < NUM_OF_PHASES)
+		{
+			total += times->phases[i];
+			baselineTotal += baseline ? baseline->phases[i] : 0;
+		}
+		perLine = ((i < NUM_OF_PHASES) ? times->phases[i] : total) * 1e9 / numOfLines;
+		printf("%-12s %12.3f %10.1f", (i < NUM_OF_PHASES) ? g_phaseNames[i] : "total", perLine * numOfLines / 1e6, perLine);
+
+		if (baseline)
+		{
+			/* The time per line is compared, so a baseline of another size can be used too */
+			baselinePerLine = ((i < NUM_OF_PHASES) ? baseline->phases[i] : baselineTotal) * 1e9 / baselineLines;
+			change = baselinePerLine > 0 ? (perLine / baselinePerLine - 1) * 100 : 0;
+			printf(" %12.1f %+8.1f%%%s", baselinePerLine, change, change > threshold ? "  REGRESSION" : "");
+			regressions += (change > threshold);
+		}
+		printf("\n");
+	}
+
+	printf("[Info] %ld lines, %.0f lines/sec.\n", numOfLines, total > 0 ? numOfLines / total : 0);
+	return regressions;
+}
+
+/* Reads the number after the option in argv[*i] into *value. Returns if it's a legal number (not negative). */
+bool readNumberOption(int argc, char *argv[], int *i, long *value)
+{
+	char *endOfNum;
+
+	if (*i + 1 >= argc)
+	{
+		printf("[Info] \"%s\" must be followed by a number.\n", argv[*i]);
+		return FALSE;
+	}
+
+	*value = strtol(argv[++*i], &endOfNum, 10);
+	if (*argv[*i] == '\0' || *endOfNum != '\0' || *value < 0)
+	{
+		printf("[Info] \"%s\" must be followed by a number.\n", argv[*i - 1]);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Reads the options in argv into *options. Returns if they are legal. */
+bool readBenchOptions(int argc, char *argv[], benchOptions *options)
+{
+	const char *numberNames[] = { "--lines", "--labels", "--macros", "--data", "--strings", "--structs", "--externs", "--entries", "--repeats", "--seed", "--threshold", NULL };
+	long values[11];
+	int i, j;
+
+	/* The defaults */
+	values[0] = 100000;
+	values[1] = 30;
+	values[2] = 10;
+	values[3] = 15;
+	values[4] = 5;
+	values[5] = 5;
+	values[6] = 4;
+	values[7] = 4;
+	values[8] = 5;
+	values[9] = 1;
+	values[10] = 10;
+	options->writeDir = NULL;
+	options->saveFile = NULL;
+	options->baselineFile = NULL;
+
+	for (i = 1; i < argc; i++)
+	{
+		for (j = 0; numberNames[j] && strcmp(argv[i], numberNames[j]) != 0; j++)
+		{
+			/* Find the option */
+		}
+
+		if (numberNames[j])
+		{
+			if (!readNumberOption(argc, argv, &i, &values[j]))
+			{
+				return FALSE;
+			}
+		}
+		else if ((strcmp(argv[i], "--write") == 0 || strcmp(argv[i], "--save") == 0 || strcmp(argv[i], "--baseline") == 0) && i + 1 < argc)
+		{
+			*(strcmp(argv[i], "--write") == 0 ? &options->writeDir : strcmp(argv[i], "--save") == 0 ? &options->saveFile : &options->baselineFile) = argv[i + 1];
+			i++;
+		}
+		else
+		{
+			printf("[Info] Unknown option \"%s\".\n", argv[i]);
+			return FALSE;
+		}
+	}
+
+	options->numOfLines = values[0];
+	options->labelPercent = (int)values[1];
+	options->macroPercent = (int)values[2];
+	options->dataPercent = (int)values[3];
+	options->stringPercent = (int)values[4];
+	options->structPercent = (int)values[5];
+	options->numOfExterns = (int)values[6];
+	options->numOfEntries = (int)values[7];
+	options->repeats = values[8] ? (int)values[8] : 1;
+	options->seed = (unsigned long)values[9];
+	options->threshold = (int)values[10];
+
+	if (options->numOfLines == 0 || options->labelPercent > 100
+		|| options->macroPercent + options->dataPercent + options->stringPercent + options->structPercent > 100)
+	{
+		printf("[Info] The lines must be more than 0, and the percents of the lines can't be more than 100.\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Writes each program to writeDir/benchN.as. */
+void writePrograms(char *writeDir, textBuffer *sources, size_t *programEnds, int numOfPrograms)
+{
+	textBuffer program, report = { 0 };
+	char *name = (char *)malloc(strlen(writeDir) + 32);
+	int i;
+
+	for (i = 0; name && i < numOfPrograms; i++)
+	{
+		program.data = sources->data + (i ? programEnds[i - 1] : 0);
+		program.length = programEnds[i] - (i ? programEnds[i - 1] : 0);
+		sprintf(name, "%s/bench%d", writeDir, i);
+		writeFile(name, ".as", &program, &report);
+	}
+
+	if (report.length)
+	{
+		fwrite(report.data, 1, report.length, stdout);
+	}
+	free(report.data);
+	free(name);
+}
+
+/* Main method. Generates the programs, assembles them 'repeats' times, and prints the best time of each phase. */
+/* Options: "--lines N", "--labels PCT", "--macros PCT", "--data PCT", "--strings PCT", "--structs PCT", */
+/* "--externs N" and "--entries N" (for each program), "--repeats N", "--seed N", "--write DIR" (write the programs), */
+/* "--save FILE" (save a baseline), "--baseline FILE" and "--threshold PCT" (compare with a baseline). */
+int main(int argc, char *argv[])
+{
+	benchOptions options;
+	benchTimes best, times, baseline;
+	assemblerContext ctx;
+	textBuffer sources = { 0 };
+	size_t *programEnds = NULL;
+	long numOfLines, baselineLines = 0;
+	int numOfPrograms, repeat, i, numOfErrors = 0, regressions;
+
+	if (!readBenchOptions(argc, argv, &options))
+	{
+		return 1;
+	}
+	if (options.baselineFile && !readBaseline(options.baselineFile, &baseline, &baselineLines))
+	{
+		printf("[Info] Can't read the baseline file \"%s\".\n", options.baselineFile);
+		return 1;
+	}
+
+	numOfPrograms = generatePrograms(&options, &sources, &programEnds, &numOfLines);
+	if (numOfPrograms == -1)
+	{
+		printf("[Error] Not enough memory - malloc falied.\n");
+		return 1;
+	}
+	printf("[Info] Generated %d programs, %ld lines, %lu bytes.\n", numOfPrograms, numOfLines, (unsigned long)sources.length);
+	if (options.writeDir)
+	{
+		writePrograms(options.writeDir, &sources, programEnds, numOfPrograms);
+	}
+
+	/* Take the best time of each phase */
+	initContext(&ctx);
+	for (repeat = 0; repeat < options.repeats; repeat++)
+	{
+		memset(&times, 0, sizeof(times));
+		for (i = 0; i < numOfPrograms; i++)
+		{
+			numOfErrors += benchProgram(&ctx, sources.data + (i ? programEnds[i - 1] : 0), programEnds[i] - (i ? programEnds[i - 1] : 0), &times);
+			if (numOfErrors)
+			{
+				printf("[Error] The generated program %d isn't legal:\n", i);
+				fwrite(ctx.messages.data, 1, ctx.messages.length, stdout);
+				break;
+			}
+		}
+		for (i = 0; i < NUM_OF_PHASES; i++)
+		{
+			best.phases[i] = (repeat == 0 || times.phases[i] < best.phases[i]) ? times.phases[i] : best.phases[i];
+		}
+		if (numOfErrors)
+		{
+			break;
+		}
+	}
+	freeContext(&ctx);
+	free(sources.data);
+	free(programEnds);
+	if (numOfErrors)
+	{
+		return 1;
+	}
+
+	regressions = printResults(&best, numOfLines, options.baselineFile ? &baseline : NULL, baselineLines, options.threshold);
+	if (options.saveFile && !saveBaseline(options.saveFile, &best, numOfLines))
+	{
+		printf("[Info] Can't write the baseline file \"%s\".\n", options.saveFile);
+		return 1;
+	}
+	if (regressions)
+	{
+		printf("[Info] %d phase%s got slower than the baseline by more than %d%%.\n", regressions, regressions > 1 ? "s" : "", options.threshold);
+		return 1;
+	}
+	return 0;
+}
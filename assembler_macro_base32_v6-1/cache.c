@@ -0,0 +1,281 @@
+/*
+The outputs cache.
+The output files of a source without errors are kept in a cache directory, named by a hash of the source.
+Each entry keeps a copy of its source too, and a hit is used only if the copy is the same as the new source
+(so two sources with the same hash never share outputs). The warnings of the source are kept with the entry,
+so a hit reports them like an assembling would.
+When the same source is assembled again, its output files are hard linked (or copied) from the cache,
+and the assembling is skipped.
+*/
+
+#define _POSIX_C_SOURCE 200112L /* For link, mkdir and getpid */
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/* ====== Methods ====== */
+
+/* Creates the cache directory if it doesn't exist. Returns if the directory can be used. */
+bool openCache(char *cacheDir)
+{
+	struct stat dirStat;
+
+	if (mkdir(cacheDir, 0777) != 0 && errno != EEXIST)
+	{
+		return FALSE;
+	}
+
+	return stat(cacheDir, &dirStat) == 0 && S_ISDIR(dirStat.st_mode);
+}
+
+/* Puts the cache key of a source (of 'length' chars) in 'key' (CACHE_KEY_LENGTH chars at most). */
+/* The key is made of two different 32 bits hashes of the source (FNV-1a and djb2) and the length of the source. */
+/* The macros are expanded from the source alone, so the source decides the outputs. */
+void getCacheKey(const char *source, size_t length, char *key)
+{
+	const char *version = CACHE_VERSION;
+	unsigned int fnvHash = 2166136261u, djbHash = 5381;
+	size_t i;
+
+	/* The version makes the keys change when the outputs format changes */
+	for (; *version; version++)
+	{
+		fnvHash = (fnvHash ^ (unsigned char)*version) * 16777619u;
+		djbHash = (djbHash * 33) ^ (unsigned char)*version;
+	}
+
+	for (i = 0; i < length; i++)
+	{
+		fnvHash = (fnvHash ^ (unsigned char)source[i]) * 16777619u;
+		djbHash = (djbHash * 33) ^ (unsigned char)source[i];
+	}
+
+	sprintf(key, "%08x%08x-%lx", fnvHash & 0xffffffffu, djbHash & 0xffffffffu, (unsigned long)length);
+}
+
+/* Returns a malloc string of the path of a cache entry ("cacheDir/key"), or NULL if there isn't enough memory. */
+char *getCachePath(char *cacheDir, char *key)
+{
+	char *path = (char *)malloc(strlen(cacheDir) + strlen(key) + 2);
+
+	if (path)
+	{
+		sprintf(path, "%s/%s", cacheDir, key);
+	}
+	return path;
+}
+
+/* Returns if the file with a given name and ending exists. */
+bool isFileExists(char *name, char *ending)
+{
+	char *fileName = (char *)malloc(strlen(name) + strlen(ending) + 1);
+	struct stat fileStat;
+	bool exists = FALSE;
+
+	if (fileName)
+	{
+		sprintf(fileName, "%s%s", name, ending);
+		exists = (stat(fileName, &fileStat) == 0);
+		free(fileName);
+	}
+	return exists;
+}
+
+/* Hard links the file 'from' + ending to 'to' + toEnding (replacing it). */
+/* If it can't be linked (another file system), the file is copied. Returns if it succeeded. */
+bool linkFile(char *from, char *to, char *ending, char *toEnding)
+{
+	char *fromName = (char *)malloc(strlen(from) + strlen(ending) + 1);
+	char *toName = (char *)malloc(strlen(to) + strlen(toEnding) + 1);
+	const char *content;
+	textBuffer copy = { 0 }, report = { 0 };
+	size_t length;
+	bool isMapped, succeeded = FALSE;
+
+	if (fromName && toName)
+	{
+		sprintf(fromName, "%s%s", from, ending);
+		sprintf(toName, "%s%s", to, toEnding);
+		unlink(toName);
+		succeeded = (link(fromName, toName) == 0);
+	}
+
+	if (fromName && toName && !succeeded)
+	{
+		content = mapFile(from, ending, &length, &isMapped);
+		if (content)
+		{
+			copy.data = (char *)content;
+			copy.length = length;
+			writeFile(to, toEnding, &copy, &report);
+			succeeded = (report.length == 0);
+			releaseFile(content, length, isMapped);
+			free(report.data);
+		}
+	}
+
+	free(fromName);
+	free(toName);
+	return succeeded;
+}
+
+/* Returns if the source copy of the cache entry 'path' is the same as the source (of 'length' chars). */
+bool isCachedSource(char *path, const char *source, size_t length)
+{
+	const char *cached;
+	size_t cachedLength;
+	bool isMapped, isSame;
+
+	cached = mapFile(path, ".as", &cachedLength, &isMapped);
+	if (!cached)
+	{
+		return FALSE;
+	}
+
+	isSame = (cachedLength == length && memcmp(cached, source, length) == 0);
+	releaseFile(cached, cachedLength, isMapped);
+	return isSame;
+}
+
+/* Links the cached output files of the key to the output files of fileName, and puts the cached warnings in 'messages'. */
+/* Returns FALSE if the key isn't in the cache with the same source (or the binary object is needed and it isn't cached). */
+bool loadFromCache(char *cacheDir, char *key, const char *source, size_t length, char *fileName, bool needBinary, textBuffer *messages)
+{
+	char *path = getCachePath(cacheDir, key);
+	bool found;
+
+	/* The .ob file is cached last, so if it exists the other files of the entry are complete */
+	found = path && isFileExists(path, ".ob") && isFileExists(path, ".msg") && (!needBinary || isFileExists(path, ".obj"))
+		&& isCachedSource(path, source, length);
+	if (found)
+	{
+		found = linkFile(path, fileName, ".ob", ".ob")
+			&& (!isFileExists(path, ".ext") || linkFile(path, fileName, ".ext", ".ext"))
+			&& (!isFileExists(path, ".ent") || linkFile(path, fileName, ".ent", ".ent"))
+			&& (!needBinary || linkFile(path, fileName, ".obj", ".obj"));
+	}
+
+	if (found)
+	{
+		readTextFile(path, ".msg", messages);
+	}
+
+	free(path);
+	return found;
+}
+
+/* Adds an output file of fileName to the cache entry 'path' (through a temporary name, so readers never see a partial file). */
+/* Returns if it succeeded. */
+bool storeFile(char *fileName, char *path, char *ending, char *tempEnding)
+{
+	char *tempName = (char *)malloc(strlen(path) + strlen(tempEnding) + 1);
+	char *cacheName = (char *)malloc(strlen(path) + strlen(ending) + 1);
+	bool succeeded = FALSE;
+
+	if (tempName && cacheName && linkFile(fileName, path, ending, tempEnding))
+	{
+		sprintf(tempName, "%s%s", path, tempEnding);
+		sprintf(cacheName, "%s%s", path, ending);
+		succeeded = (rename(tempName, cacheName) == 0);
+		if (!succeeded)
+		{
+			unlink(tempName);
+		}
+	}
+
+	free(tempName);
+	free(cacheName);
+	return succeeded;
+}
+
+/* Adds a text (of 'length' chars) to the cache entry 'path' as the file with the ending (through a temporary name). */
+/* Returns if it succeeded. */
+bool storeText(char *path, char *ending, char *tempEnding, const char *text, size_t length)
+{
+	char *tempName = (char *)malloc(strlen(path) + strlen(tempEnding) + 1);
+	char *cacheName = (char *)malloc(strlen(path) + strlen(ending) + 1);
+	textBuffer content = { 0 }, report = { 0 };
+	bool succeeded = FALSE;
+
+	if (tempName && cacheName)
+	{
+		sprintf(tempName, "%s%s", path, tempEnding);
+		sprintf(cacheName, "%s%s", path, ending);
+		content.data = (char *)text;
+		content.length = length;
+		writeFile(path, tempEnding, &content, &report);
+		succeeded = (report.length == 0 && rename(tempName, cacheName) == 0);
+		if (!succeeded)
+		{
+			unlink(tempName);
+		}
+		free(report.data);
+	}
+
+	free(tempName);
+	free(cacheName);
+	return succeeded;
+}
+
+/* Removes the files of a partial cache entry 'path' (unless another writer has completed the entry meanwhile). */
+void removeCacheEntry(char *path)
+{
+	char *endings[] = { ".as", ".msg", ".ext", ".ent", ".obj" };
+	char *cacheName = (char *)malloc(strlen(path) + 5);
+	int i;
+
+	if (cacheName && !isFileExists(path, ".ob"))
+	{
+		for (i = 0; i < (int)(sizeof(endings) / sizeof(endings[0])); i++)
+		{
+			sprintf(cacheName, "%s%s", path, endings[i]);
+			unlink(cacheName);
+		}
+	}
+
+	free(cacheName);
+}
+
+/* Adds the source (of 'length' chars) and the output files of fileName (assembled without errors by ctx) to the cache under the key. */
+void storeInCache(char *cacheDir, char *key, const char *source, size_t length, char *fileName, assemblerContext *ctx)
+{
+	char *path = getCachePath(cacheDir, key);
+	char tempEnding[64];
+	bool stored;
+
+	if (!path)
+	{
+		return;
+	}
+
+	/* The temporary name is unique for each process and context */
+	sprintf(tempEnding, ".tmp%ld-%lx", (long)getpid(), (unsigned long)ctx);
+
+	/* The .ob file is stored last - it marks the entry as complete, so it's stored only if all the other files were */
+	/* The source is copied (not linked), so editing the source file later can't change the cached copy */
+	stored = storeText(path, ".as", tempEnding, source, length)
+		&& storeText(path, ".msg", tempEnding, ctx->messages.data, ctx->messages.length);
+	if (stored && ctx->externOut.length)
+	{
+		stored = storeFile(fileName, path, ".ext", tempEnding);
+	}
+	if (stored && ctx->entriesOut.length)
+	{
+		stored = storeFile(fileName, path, ".ent", tempEnding);
+	}
+	if (stored && ctx->createBinaryObject)
+	{
+		stored = storeFile(fileName, path, ".obj", tempEnding);
+	}
+	if (!stored || !storeFile(fileName, path, ".ob", tempEnding))
+	{
+		removeCacheEntry(path);
+	}
+
+	free(path);
+}
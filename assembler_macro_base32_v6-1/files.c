@@ -0,0 +1,327 @@
+/*
+Reading and writing files.
+The sources are mapped into memory (so the lines are read straight from the mapping),
+and each output file is written with a single write.
+parseFile runs the whole pipeline of a source file, from its .as file to its output files (for the assembler
+and for the assembler server).
+*/
+
+#define _POSIX_C_SOURCE 200112L /* For mmap, fileno and write */
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* ====== Methods ====== */
+
+/* Creates a file (for writing) from a given name and ending, and returns a pointer to it. */
+FILE *openFile(char *name, char *ending, const char *mode)
+{
+	FILE *file;
+	char *mallocStr = (char *)malloc(strlen(name) + strlen(ending) + 1), *fileName = mallocStr;
+	sprintf(fileName, "%s%s", name, ending);
+
+	file = fopen(fileName, mode);
+	free(mallocStr);
+
+	return file;
+}
+
+/* Reads the whole file with a given name and ending into a malloc block, and puts its length in *length. */
+/* Returns NULL if the file can't be read. */
+char *readFile(char *name, char *ending, size_t *length)
+{
+	FILE *file = openFile(name, ending, "rb");
+	char *content = NULL, *newContent;
+	size_t capacity = 0, bytesRead;
+
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	*length = 0;
+	do
+	{
+		/* Grow the block geometrically until the whole file fits */
+		if (*length == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 4096;
+			newContent = (char *)realloc(content, capacity);
+			if (!newContent)
+			{
+				free(content);
+				fclose(file);
+				return NULL;
+			}
+			content = newContent;
+		}
+
+		bytesRead = fread(content + *length, 1, capacity - *length, file);
+		*length += bytesRead;
+	} while (bytesRead > 0);
+
+	fclose(file);
+	return content;
+}
+
+/* Maps the whole file with a given name and ending into memory, and puts its length in *length. */
+/* Files that can't be mapped (empty files, pipes) are read into a malloc block instead, and *isMapped is FALSE. */
+/* Returns NULL if the file can't be read. Release the content with releaseFile. */
+const char *mapFile(char *name, char *ending, size_t *length, bool *isMapped)
+{
+	FILE *file = openFile(name, ending, "rb");
+	struct stat fileStat;
+	void *content;
+
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	*isMapped = FALSE;
+	if (fstat(fileno(file), &fileStat) == 0 && S_ISREG(fileStat.st_mode) && fileStat.st_size > 0)
+	{
+		/* The mapping stays valid after the file is closed */
+		content = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+		if (content != MAP_FAILED)
+		{
+			fclose(file);
+			*length = (size_t)fileStat.st_size;
+			*isMapped = TRUE;
+			return (const char *)content;
+		}
+	}
+
+	fclose(file);
+	return readFile(name, ending, length);
+}
+
+/* Releases the content of a file from mapFile. */
+void releaseFile(const char *content, size_t length, bool isMapped)
+{
+	if (isMapped)
+	{
+		munmap((void *)content, length);
+	}
+	else
+	{
+		free((void *)content);
+	}
+}
+
+/* Reads the content of a text object file into buf (an empty content if the file doesn't exist). */
+void readTextFile(char *name, char *ending, textBuffer *buf)
+{
+	const char *content;
+	size_t length;
+	bool isMapped;
+
+	buf->length = 0;
+	content = mapFile(name, ending, &length, &isMapped);
+	if (content)
+	{
+		appendText(buf, content, length);
+		releaseFile(content, length, isMapped);
+	}
+}
+
+/* Loads the memory image of a file name to run it: its .obj file (mapped), or its .ob and .ext files converted into a binary object in 'binary'. */
+/* Returns the header of the image, or NULL if it can't be run (the reason is added to the report). */
+const objectHeader *loadImage(char *fileName, bool binaryInput, textBuffer *object, textBuffer *externs, textBuffer *binary, const char **content, size_t *length, bool *isMapped, textBuffer *report)
+{
+	textBuffer empty = { 0 };
+	const objectHeader *header;
+
+	*content = NULL;
+	if (binaryInput)
+	{
+		*content = mapFile(fileName, ".obj", length, isMapped);
+		if (!*content)
+		{
+			appendFormat(report, "[Info] Can't open the file \"%s.obj\".\n", fileName);
+			return NULL;
+		}
+		header = loadBinaryObject(*content, *length);
+	}
+	else
+	{
+		readTextFile(fileName, ".ob", object);
+		if (object->length == 0)
+		{
+			appendFormat(report, "[Info] Can't open the file \"%s.ob\".\n", fileName);
+			return NULL;
+		}
+		readTextFile(fileName, ".ext", externs);
+		header = textToBinaryObject(object, &empty, externs, binary) ? loadBinaryObject(binary->data, binary->length) : NULL;
+	}
+
+	if (!header)
+	{
+		appendFormat(report, "[Error] The image of \"%s\" isn't legal.\n", fileName);
+	}
+	else if (header->numOfExterns)
+	{
+		appendFormat(report, "[Error] \"%s\" uses extern labels - link it first.\n", fileName);
+		header = NULL;
+	}
+	return header;
+}
+
+/* Writes the text in buf to a file with a given name and ending (with a single write for the whole text). */
+void writeFile(char *name, char *ending, textBuffer *buf, textBuffer *report)
+{
+	char *fileName = (char *)malloc(strlen(name) + strlen(ending) + 1);
+	size_t written = 0;
+	ssize_t result;
+	int fd = -1;
+
+	if (fileName)
+	{
+		sprintf(fileName, "%s%s", name, ending);
+
+		/* A new file replaces the old one, so a hard link to the old file (from the cache) isn't changed */
+		unlink(fileName);
+		fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		free(fileName);
+	}
+	if (fd == -1)
+	{
+		appendFormat(report, "[Info] Can't create the file \"%s%s\".\n", name, ending);
+		return;
+	}
+
+	/* The whole text is written at once, the loop only continues a partial write */
+	while (written < buf->length)
+	{
+		result = write(fd, buf->data + written, buf->length - written);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (result <= 0)
+		{
+			appendFormat(report, "[Info] Can't write the file \"%s%s\".\n", name, ending);
+			break;
+		}
+		written += (size_t)result;
+	}
+	close(fd);
+}
+
+/* Writes an output file of the source, and adds its size to the stats of the context (if there are stats). */
+void writeOutput(assemblerContext *ctx, char *fileName, char *ending, textBuffer *content, textBuffer *report)
+{
+	writeFile(fileName, ending, content, report);
+	if (ctx->stats)
+	{
+		ctx->stats->bytesWritten += content->length;
+	}
+}
+
+/* Parsing a file, and creating the output files. */
+/* All the [Info] and [Error] lines of the file are added to 'report', so they can be printed as one block. */
+/* If cacheDir isn't NULL, the outputs are taken from the cache when the same source was assembled before. */
+/* Returns the number of errors (-1 if the file can't be opened). */
+int parseFile(assemblerContext *ctx, char *fileName, char *cacheDir, textBuffer *report)
+{
+	const char *source;
+	char cacheKey[CACHE_KEY_LENGTH + 1];
+	size_t length;
+	bool isMapped;
+	int numOfErrors;
+	double start;
+
+	/* Map the file (the lines are read straight from the mapping) */
+	source = mapFile(fileName, ".as", &length, &isMapped);
+	if (source == NULL)
+	{
+		appendFormat(report, "[Info] Can't open the file \"%s.as\".\n", fileName);
+		return -1;
+	}
+	appendFormat(report, "[Info] Successfully opened the file \"%s.as\".\n", fileName);
+	if (ctx->stats)
+	{
+		ctx->stats->files++;
+		ctx->stats->bytesRead += length;
+	}
+
+	/* Take the outputs from the cache (the .am file isn't cached, so it's always assembled with --am) */
+	if (cacheDir && !ctx->keepExpandedSource)
+	{
+		start = getStatsTime(ctx);
+		getCacheKey(source, length, cacheKey);
+		if (loadFromCache(cacheDir, cacheKey, source, length, fileName, ctx->createBinaryObject, &ctx->messages))
+		{
+			/* Replay the warnings of the cached assembling, so the report doesn't depend on the cache */
+			appendText(report, ctx->messages.data, ctx->messages.length);
+			if (ctx->stats)
+			{
+				ctx->stats->cachedFiles++;
+				ctx->stats->outputTime += getTime() - start;
+			}
+			appendFormat(report, "[Info] Created output files for the file \"%s.as\" (from the cache).\n", fileName);
+			releaseFile(source, length, isMapped);
+			return 0;
+		}
+	}
+
+	/* Assemble the source */
+	numOfErrors = assemble(source, length, ctx);
+	appendText(report, ctx->messages.data, ctx->messages.length);
+
+	/* The writes of the files are a part of the outputs time */
+	start = getStatsTime(ctx);
+
+	/* Create the source after the macros expansion (only if it was kept) */
+	if (ctx->keepExpandedSource)
+	{
+		writeOutput(ctx, fileName, ".am", &ctx->expandedSource, report);
+	}
+
+	/* Create Output Files */
+	if (numOfErrors == 0)
+	{
+		/* Create all the output files (the .ext and .ent files only if they aren't empty) */
+		writeOutput(ctx, fileName, ".ob", &ctx->objectOut, report);
+		if (ctx->externOut.length)
+		{
+			writeOutput(ctx, fileName, ".ext", &ctx->externOut, report);
+		}
+		if (ctx->entriesOut.length)
+		{
+			writeOutput(ctx, fileName, ".ent", &ctx->entriesOut, report);
+		}
+		if (ctx->createBinaryObject)
+		{
+			writeOutput(ctx, fileName, ".obj", &ctx->binaryOut, report);
+		}
+		if (cacheDir && !ctx->keepExpandedSource)
+		{
+			storeInCache(cacheDir, cacheKey, source, length, fileName, ctx);
+		}
+		appendFormat(report, "[Info] Created output files for the file \"%s.as\".\n", fileName);
+	}
+	else
+	{
+		/* print the number of errors. */
+		appendFormat(report, "[Info] A total of %d error%s found throughout \"%s.as\".\n", numOfErrors, (numOfErrors > 1) ? "s were" : " was", fileName);
+	}
+
+	if (ctx->stats)
+	{
+		ctx->stats->outputTime += getTime() - start;
+	}
+
+	/* Release the lines and the parser temporaries of the file at once */
+	resetContext(ctx);
+	releaseFile(source, length, isMapped);
+	return numOfErrors;
+}
@@ -10,11 +10,11 @@ It saves the data from an assembly file in data structures, and finds the errors
 #include <stdlib.h>
 
 /* ====== Directives List ====== */
-void parseDataDirc(lineInfo *line, int *IC, int *DC);
-void parseStringDirc(lineInfo *line, int *IC, int *DC);
-void parseStructDirc(lineInfo *line, int *IC, int *DC);
-void parseExternDirc(lineInfo *line);
-void parseEntryDirc(lineInfo *line);
+void parseDataDirc(assemblerContext *ctx, lineInfo *line);
+void parseStringDirc(assemblerContext *ctx, lineInfo *line);
+void parseStructDirc(assemblerContext *ctx, lineInfo *line);
+void parseExternDirc(assemblerContext *ctx, lineInfo *line);
+void parseEntryDirc(assemblerContext *ctx, lineInfo *line);
 
 const directive g_dircArr[] = 
 {	/* Name | Parseing Function */
@@ -26,42 +26,47 @@ const directive g_dircArr[] =
 	{ NULL } /* represent the end of the array */
 };	
 
+/* Maps DIRC_HASH of a directive name to its ID in g_dircArr (-1 is an empty slot) */
+const signed char g_dircHash[DIRC_HASH_SIZE] = { 4, -1, 2, -1, 1, 0, -1, 3 };
+
 /* ====== Commands List ====== */
 const command g_cmdArr[] =	
-{	/* Name | Opcode | NumOfParams */
-	{ "mov", 0, 2 } , 
-	{ "cmp", 1, 2 } ,
-	{ "add", 2, 2 } ,
-	{ "sub", 3, 2 } ,
-	{ "not", 4, 1 } ,
-	{ "clr", 5, 1 } ,
-	{ "lea", 6, 2 } ,
-	{ "inc", 7, 1 } ,
-	{ "dec", 8, 1 } ,
-	{ "jmp", 9, 1 } ,
-	{ "bne", 10, 1 } ,
-	{ "get", 11, 1 } ,
-	{ "prn", 12, 1 } ,
-	{ "jsr", 13, 1 } ,
-	{ "rst", 14, 0 } ,
-	{ "hlt", 15, 0 } ,
+{	/* Name | Opcode | NumOfParams | Source Types | Destination Types */
+	{ "mov", 0, 2, ALL_OP_TYPES, WRITABLE_OP_TYPES } , 
+	{ "cmp", 1, 2, ALL_OP_TYPES, ALL_OP_TYPES } ,
+	{ "add", 2, 2, ALL_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "sub", 3, 2, ALL_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "not", 4, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "clr", 5, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "lea", 6, 2, ADDRESS_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "inc", 7, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "dec", 8, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "jmp", 9, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "bne", 10, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "get", 11, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "prn", 12, 1, NO_OP_TYPES, ALL_OP_TYPES } ,
+	{ "jsr", 13, 1, NO_OP_TYPES, WRITABLE_OP_TYPES } ,
+	{ "rst", 14, 0, NO_OP_TYPES, NO_OP_TYPES } ,
+	{ "hlt", 15, 0, NO_OP_TYPES, NO_OP_TYPES } ,
 	{ NULL } /* represent the end of the array */
 }; 
 
-/* ====== Externs ====== */
-extern labelInfo g_labelArr[MAX_LABELS_NUM];
-extern int g_labelNum;
-lineInfo *g_entryLines[MAX_LABELS_NUM];
-extern int g_entryLabelsNum;
-extern int g_dataArr[MAX_DATA_NUM];
+/* Maps CMD_HASH of a command name to its ID in g_cmdArr (-1 is an empty slot) */
+const signed char g_cmdHash[CMD_HASH_SIZE] = 
+{
+	-1, 0, 4, -1, 13, 1, 7, 3, -1, -1, -1, 5, -1, -1, -1, -1,
+	-1, 6, -1, 10, -1, 11, 12, 2, -1, -1, 9, 8, 15, -1, 14, -1
+};
 
 /* ====== Methods ====== */
 
 /* Adds the label to the labelArr and increases labelNum. Returns a pointer to the label in the array. */
-labelInfo *addLabelToArr(labelInfo label, lineInfo *line)
+labelInfo *addLabelToArr(assemblerContext *ctx, labelInfo label, lineInfo *line)
 {
+	labelInfo *newLabelArr;
+
 	/* Check if label is legal */
-	if (!isLegalLabel(line->lineStr, line->lineNum, TRUE))
+	if (!isLegalLabel(ctx, line->lineStr, line->lineNum, TRUE))
 	{
 		/* Illegal label name */
 		line->isError = TRUE;
@@ -69,9 +74,9 @@ labelInfo *addLabelToArr(labelInfo label, lineInfo *line)
 	}
 
 	/* Check if label is legal */
-	if (isExistingLabel(line->lineStr))
+	if (isExistingLabel(ctx, line->lineStr))
 	{
-		printError(line->lineNum, "Label already exists.");
+		printError(ctx, line->lineNum, "Label already exists.");
 		line->isError = TRUE;
 		return NULL;
 	}
@@ -79,41 +84,47 @@ labelInfo *addLabelToArr(labelInfo label, lineInfo *line)
 	/* Add the name to the label */
 	strcpy(label.name, line->lineStr);
 
-	/* Add the label to g_labelArr and to the lineInfo */
-	if (g_labelNum < MAX_LABELS_NUM)
+	/* Add the label to ctx->labelArr and to the hash index */
+	newLabelArr = (labelInfo *)reserveArray(ctx->labelArr, &ctx->labelCapacity, ctx->labelNum + 1, sizeof(labelInfo));
+	if (newLabelArr)
 	{
-		g_labelArr[g_labelNum] = label;
-		return &g_labelArr[g_labelNum++];
+		ctx->labelArr = newLabelArr;
+		ctx->labelArr[ctx->labelNum] = label;
+		if (addLabelToIndex(ctx, ctx->labelNum))
+		{
+			return &ctx->labelArr[ctx->labelNum++];
+		}
 	}
 
-	/* Too many labels */
-	printError(line->lineNum, "Too many labels - max is %d.", MAX_LABELS_NUM, TRUE);
+	/* Not enough memory */
+	printError(ctx, line->lineNum, "Not enough memory - malloc falied.");
 	line->isError = TRUE;
 	return NULL;
 }
 
-/* Adds the number to the g_dataArr and increases DC. Returns if it succeeded. */
-bool addNumberToData(int num, int *IC, int *DC, int lineNum)
+/* Adds the number to the ctx->dataArr and increases DC. Returns if it succeeded. */
+bool addNumberToData(assemblerContext *ctx, int num, int lineNum)
 {
-	/* Check if there is enough space in g_dataArr for the data */
-	if (*DC + *IC < MAX_DATA_NUM)
-	{
-		g_dataArr[(*DC)++] = num;
-	}
-	else
+	/* Make sure there is enough space in ctx->dataArr for the data */
+	int *newDataArr = (int *)reserveArray(ctx->dataArr, &ctx->dataCapacity, ctx->DC + 1, sizeof(int));
+
+	if (!newDataArr)
 	{
+		printError(ctx, lineNum, "Not enough memory - malloc falied.");
 		return FALSE;
 	}
 
+	ctx->dataArr = newDataArr;
+	ctx->dataArr[ctx->DC++] = num;
 	return TRUE;
 }
 
-/* Adds the str to the g_dataArr and increases DC. Returns if it succeeded. */
-bool addStringToData(char *str, int *IC, int *DC, int lineNum)
+/* Adds the str to the ctx->dataArr and increases DC. Returns if it succeeded. */
+bool addStringToData(assemblerContext *ctx, char *str, int lineNum)
 {
 	do
 	{
-		if (!addNumberToData((int)*str, IC, DC, lineNum))
+		if (!addNumberToData(ctx, (int)*str, lineNum))
 		{
 			return FALSE;
 		}
@@ -124,70 +135,73 @@ bool addStringToData(char *str, int *IC, int *DC, int lineNum)
 
 /* Finds the label in line->lineStr and add it to the label list. */
 /* Returns a pointer to the next char after the label, or NULL is there isn't a legal label. */
-char *findLabel(lineInfo *line, int IC)
+char *findLabel(assemblerContext *ctx, lineInfo *line, int IC)
 {
-	char *labelEnd = strchr(line->lineStr, ':');
+	char *labelEnd = findChars(&ctx->scan, line->lineStr, CHAR_COLON);
 	labelInfo label = { 0 };
 	label.address = FIRST_ADDRESS + IC;
 
 	/* Find the label (or return NULL if there isn't) */
-	if (!labelEnd)
+	if (*labelEnd != ':')
 	{
 		return NULL;
 	}
-	*labelEnd = '\0';
+	setLineChar(&ctx->scan, labelEnd, '\0');
 
 	/* Check if the ':' came after the first word */
-	if (!isOneWord(line->lineStr))
+	if (!isOneWord(&ctx->scan, line->lineStr))
 	{
-		*labelEnd = ':'; /* Fix the change in line->lineStr */
+		setLineChar(&ctx->scan, labelEnd, ':'); /* Fix the change in line->lineStr */
 		return NULL;
 	}
 
 	/* Check of the label is legal and add it to the labelList */
-	line->label = addLabelToArr(label, line);
+	if (addLabelToArr(ctx, label, line))
+	{
+		line->labelId = ctx->labelNum - 1;
+	}
 
 	return labelEnd + 1; /* +1 to make it point at the next char after the \0 */
 }
 
-/* Omits the last label in labelArr by updating g_labelNum. */
+/* Omits the last label in labelArr by updating ctx->labelNum. */
 /* Used to remove the label from a entry/extern line. */
-void removeLastLabel(int lineNum)
+void removeLastLabel(assemblerContext *ctx, int lineNum)
 {
-	g_labelNum--;
-	printf("[Warning] At line %d: The assembler ignored the label before the directive.\n", lineNum);
+	removeLabelFromIndex(ctx, --ctx->labelNum);
+	printWarning(ctx, lineNum, "The assembler ignored the label before the directive.");
 }
 
 /* Parses a .struct directive. */
-void parseStructDirc(lineInfo *line, int *IC, int *DC)
+void parseStructDirc(assemblerContext *ctx, lineInfo *line)
 {
 	char *operandTok = line->lineStr, *endOfOp = line->lineStr;
 	int operandValue;
 	bool foundComma;
 
 	/* Make the label a data label (is there is one) */
-	if (line->label)
+	if (line->labelId != -1)
 	{
-		line->label->isData = TRUE;
-		line->label->address = FIRST_ADDRESS + *DC;
+		ctx->labelArr[line->labelId].isData = TRUE;
+		ctx->labelArr[line->labelId].address = FIRST_ADDRESS + ctx->DC;
 	}
 
 	/* Check if there are params */
-	if (isWhiteSpaces(line->lineStr))
+	if (isWhiteSpaces(&ctx->scan, line->lineStr))
 	{
 		/* No parameters */
-		printError(line->lineNum, "No parameter.");
+		printError(ctx, line->lineNum, "No parameter.");
 		line->isError = TRUE;
 		return;
 	}
 
-	/* Find all the params and add them to g_dataArr */
-		operandTok = getFirstOperand(line->lineStr, &endOfOp, &foundComma);
+	/* Find all the params and add them to ctx->dataArr */
+		operandTok = getFirstOperand(&ctx->scan, line->lineStr, &endOfOp, &foundComma);
 
-		/* Add the param to g_dataArr */
-		if (isLegalNum(operandTok, MEMORY_WORD_LENGTH, line->lineNum, &operandValue))
+		/* Add the param to ctx->dataArr */
+		if (isLegalNum(ctx, operandTok, MEMORY_WORD_LENGTH, line->lineNum, &operandValue))
 		{
-			if (!addNumberToData(operandValue, IC, DC, line->lineNum))
+			if (!addNumberToData(ctx, operandValue, line->lineNum))
 			{
 				/* Not enough memory */
 				line->isError = TRUE;
@@ -205,11 +219,11 @@ void parseStructDirc(lineInfo *line, int *IC, int *DC)
 		line->lineStr = endOfOp;
 	
 	
-	trimStr(&line->lineStr);
+	trimStr(&ctx->scan, &line->lineStr);
 
-	if (isLegalStringParam(&line->lineStr, line->lineNum))
+	if (isLegalStringParam(ctx, &line->lineStr, line->lineNum))
 	{
-		if (!addStringToData(line->lineStr, IC, DC, line->lineNum))
+		if (!addStringToData(ctx, line->lineStr, line->lineNum))
 		{
 			/* Not enough memory */
 			line->isError = TRUE;
@@ -227,42 +241,42 @@ void parseStructDirc(lineInfo *line, int *IC, int *DC)
 }
 
 /* Parses a .data directive. */
-void parseDataDirc(lineInfo *line, int *IC, int *DC)
+void parseDataDirc(assemblerContext *ctx, lineInfo *line)
 {
 	char *operandTok = line->lineStr, *endOfOp = line->lineStr;
 	int operandValue;
 	bool foundComma;
 
 	/* Make the label a data label (is there is one) */
-	if (line->label)
+	if (line->labelId != -1)
 	{
-		line->label->isData = TRUE;
-		line->label->address = FIRST_ADDRESS + *DC;
+		ctx->labelArr[line->labelId].isData = TRUE;
+		ctx->labelArr[line->labelId].address = FIRST_ADDRESS + ctx->DC;
 	}
 
 	/* Check if there are params */
-	if (isWhiteSpaces(line->lineStr))
+	if (isWhiteSpaces(&ctx->scan, line->lineStr))
 	{
 		/* No parameters */
-		printError(line->lineNum, "No parameter.");
+		printError(ctx, line->lineNum, "No parameter.");
 		line->isError = TRUE;
 		return;
 	}
 
-	/* Find all the params and add them to g_dataArr */
+	/* Find all the params and add them to ctx->dataArr */
 	FOREVER
 	{
 		/* Get next param or break if there isn't */
-		if (isWhiteSpaces(line->lineStr))
+		if (isWhiteSpaces(&ctx->scan, line->lineStr))
 		{
 			break;
 		}
-		operandTok = getFirstOperand(line->lineStr, &endOfOp, &foundComma);
+		operandTok = getFirstOperand(&ctx->scan, line->lineStr, &endOfOp, &foundComma);
 
-		/* Add the param to g_dataArr */
-		if (isLegalNum(operandTok, MEMORY_WORD_LENGTH, line->lineNum, &operandValue))
+		/* Add the param to ctx->dataArr */
+		if (isLegalNum(ctx, operandTok, MEMORY_WORD_LENGTH, line->lineNum, &operandValue))
 		{
-			if (!addNumberToData(operandValue, IC, DC, line->lineNum))
+			if (!addNumberToData(ctx, operandValue, line->lineNum))
 			{
 				/* Not enough memory */
 				line->isError = TRUE;
@@ -283,27 +297,27 @@ void parseDataDirc(lineInfo *line, int *IC, int *DC)
 	if (foundComma)
 	{
 		/* Comma after the last param */
-		printError(line->lineNum, "Do not write a comma after the last parameter.");
+		printError(ctx, line->lineNum, "Do not write a comma after the last parameter.");
 		line->isError = TRUE;
 		return;
 	}
 }
 
 /* Parses a .string directive. */
-void parseStringDirc(lineInfo *line, int *IC, int *DC)
+void parseStringDirc(assemblerContext *ctx, lineInfo *line)
 {
 	/* Make the label a data label (is there is one) */
-	if (line->label)
+	if (line->labelId != -1)
 	{
-		line->label->isData = TRUE;
-		line->label->address = FIRST_ADDRESS + *DC;
+		ctx->labelArr[line->labelId].isData = TRUE;
+		ctx->labelArr[line->labelId].address = FIRST_ADDRESS + ctx->DC;
 	}
 
-	trimStr(&line->lineStr);
+	trimStr(&ctx->scan, &line->lineStr);
 
-	if (isLegalStringParam(&line->lineStr, line->lineNum))
+	if (isLegalStringParam(ctx, &line->lineStr, line->lineNum))
 	{
-		if (!addStringToData(line->lineStr, IC, DC, line->lineNum))
+		if (!addStringToData(ctx, line->lineStr, line->lineNum))
 		{
 			/* Not enough memory */
 			line->isError = TRUE;
@@ -319,18 +333,18 @@ void parseStringDirc(lineInfo *line, int *IC, int *DC)
 }
 
 /* Parses a .extern directive. */
-void parseExternDirc(lineInfo *line)
+void parseExternDirc(assemblerContext *ctx, lineInfo *line)
 {
 	labelInfo label = { 0 }, *labelPointer;
 
 	/* If there is a label in the line, remove the it from labelArr */
-	if (line->label)
+	if (line->labelId != -1)
 	{
-		removeLastLabel(line->lineNum);
+		removeLastLabel(ctx, line->lineNum);
 	}
 
-	trimStr(&line->lineStr);
-	labelPointer = addLabelToArr(label, line);
+	trimStr(&ctx->scan, &line->lineStr);
+	labelPointer = addLabelToArr(ctx, label, line);
 
 	/* Make the label an extern label */
 	if (!line->isError)
@@ -341,67 +355,91 @@ void parseExternDirc(lineInfo *line)
 }
 
 /* Parses a .entry directive. */
-void parseEntryDirc(lineInfo *line)
+void parseEntryDirc(assemblerContext *ctx, lineInfo *line)
 {
+	int *newEntryLines;
+
 	/* If there is a label in the line, remove the it from labelArr */
-	if (line->label)
+	if (line->labelId != -1)
 	{
-		removeLastLabel(line->lineNum);
+		removeLastLabel(ctx, line->lineNum);
 	}
 
 	/* Add the label to the entry labels list */
-	trimStr(&line->lineStr);
+	trimStr(&ctx->scan, &line->lineStr);
 
-	if (isLegalLabel(line->lineStr, line->lineNum, TRUE))
+	if (isLegalLabel(ctx, line->lineStr, line->lineNum, TRUE))
 	{
-		if (isExistingEntryLabel(line->lineStr))
+		if (isExistingEntryLabel(ctx, line->lineStr))
 		{
-			printError(line->lineNum, "Label already defined as an entry label.");
+			printError(ctx, line->lineNum, "Label already defined as an entry label.");
 			line->isError = TRUE;
 		}
-		else if (g_entryLabelsNum < MAX_LABELS_NUM)
+		else
 		{
-			g_entryLines[g_entryLabelsNum++] = line;
+			/* Add the id of the line in ctx->linesArr */
+			newEntryLines = (int *)reserveArray(ctx->entryLines, &ctx->entryCapacity, ctx->entryLabelsNum + 1, sizeof(int));
+			if (newEntryLines)
+			{
+				ctx->entryLines = newEntryLines;
+				ctx->entryLines[ctx->entryLabelsNum] = line - ctx->linesArr;
+			}
+
+			if (!newEntryLines || !addEntryToIndex(ctx, ctx->entryLabelsNum))
+			{
+				printError(ctx, line->lineNum, "Not enough memory - malloc falied.");
+				line->isError = TRUE;
+				return;
+			}
+			ctx->entryLabelsNum++;
 		}
 	}
 }
 
 /* Parses the directive and in a directive line. */
-void parseDirective(lineInfo *line, int *IC, int *DC)
+void parseDirective(assemblerContext *ctx, lineInfo *line)
 {
-	int i = 0;
-	while (g_dircArr[i].name)
+	int dircId = getDircId(line->commandStr);
+
+	if (dircId != -1)
 	{
-		if (!strcmp(line->commandStr, g_dircArr[i].name))
-		{
-			/* Call the parse function for this type of directive */
-			g_dircArr[i].parseFunc(line, IC, DC);
-			return;
-		}
-		i++;
+		/* Call the parse function for this type of directive */
+		g_dircArr[dircId].parseFunc(ctx, line);
+		return;
 	}
 	
 	/* line->commandStr isn't a real directive */
-	printError(line->lineNum, "No such directive as \"%s\".", line->commandStr);
+	printError(ctx, line->lineNum, "No such directive as \"%s\".", line->commandStr);
 	line->isError = TRUE;
 }
 
+/* Returns the name of an operand type, for the error messages. */
+const char *getOpTypeName(opType type)
+{
+	switch (type)
+	{
+	case NUMBER:	return "number";
+	case LABEL:		return "label";
+	case STRUCT:	return "struct";
+	case REGISTER:	return "register";
+	default:		return "invalid operand";
+	}
+}
 
 /* Returns if the operands' types are legal (depending on the command). */
-bool areLegalOpTypes(const command *cmd, operandInfo op1, operandInfo op2, int lineNum)
+bool areLegalOpTypes(assemblerContext *ctx, const command *cmd, operandInfo op1, operandInfo op2, int lineNum)
 {
 	/* --- Check First Operand --- */
-	/* "lea" command (opcode is 6) can only get a label or struct as the 1st op */
-	if (cmd->opcode == 6 && op1.type != LABEL && op1.type != STRUCT)
+	if (op1.type != INVALID && !(cmd->srcTypes & OP_TYPE_BIT(op1.type)))
 	{
-		printError(lineNum, "Source operand for \"%s\" command must be a label or struct.", cmd->name);
+		printError(ctx, lineNum, "Source operand for \"%s\" command can't be a %s.", cmd->name, getOpTypeName(op1.type));
 		return FALSE;
 	}
 
-	/* 2nd operand can be a number only if the command is "prn" (opcode is 12) or the command in "cmp" (op code 1)*/
-	if (op2.type == NUMBER && cmd->opcode != 1 && cmd->opcode != 12)
+	/* --- Check Second Operand --- */
+	if (op2.type != INVALID && !(cmd->destTypes & OP_TYPE_BIT(op2.type)))
 	{
-		printError(lineNum, "Destination operand for \"%s\" command can't be a number.", cmd->name);
+		printError(ctx, lineNum, "Destination operand for \"%s\" command can't be a %s.", cmd->name, getOpTypeName(op2.type));
 		return FALSE;
 	}
 
@@ -409,13 +447,13 @@ bool areLegalOpTypes(const command *cmd, operandInfo op1, operandInfo op2, int l
 }
 
 /* Updates the type and value of operand. */
-void parseOpInfo(operandInfo *operand, int lineNum)
+void parseOpInfo(assemblerContext *ctx, operandInfo *operand, int lineNum)
 {
 	int value = 0;
 
-	if (isWhiteSpaces(operand->str))
+	if (isWhiteSpaces(&ctx->scan, operand->str))
 	{
-		printError(lineNum, "Empty parameter.");
+		printError(ctx, lineNum, "Empty parameter.");
 		operand->type = INVALID;
 		return;
 	}
@@ -423,42 +461,43 @@ void parseOpInfo(operandInfo *operand, int lineNum)
 
 
 	/* Check if the type is NUMBER */
-	if (*operand->str == '#')
+	if (isCharClass(&ctx->scan, operand->str, CHAR_HASH))
 	{
 		operand->str++; /* Remove the '#' */
+		operand->length--;
 
 		/* Check if the number is legal */
-		if (isspace(*operand->str)) 
+		if (isCharClass(&ctx->scan, operand->str, CHAR_SPACE))
 		{
-			printError(lineNum, "There is a white space afetr the '#'.");
+			printError(ctx, lineNum, "There is a white space afetr the '#'.");
 			operand->type = INVALID;
 		}
 		else
 		{
-			operand->type = isLegalNum(operand->str, MEMORY_WORD_LENGTH - 2, lineNum, &value) ? NUMBER : INVALID;
+			operand->type = isLegalNum(ctx, operand->str, MEMORY_WORD_LENGTH - 2, lineNum, &value) ? NUMBER : INVALID;
 		}
 	}
 	/* Check if the type is REGISTER */
-	else if (isRegister(operand->str, &value))
+	else if (isRegister(operand->str, operand->length, &value))
 	{
 		operand->type = REGISTER;
 	}
 	
 	/* Check if the type is STRUCT */
-	else if (isStruct(operand->str, lineNum, FALSE))
+	else if (parseStructOperand(ctx, operand, lineNum))
 	{
 		operand->type = STRUCT;
 	}
 	
 	/* Check if the type is LABEL */
-	else if (isLegalLabel(operand->str, lineNum, FALSE))
+	else if (isLegalLabelView(ctx, operand->str, operand->length, lineNum, FALSE))
 	{
 		operand->type = LABEL;
 	}
 	/* The type is INVALID */
 	else
 	{
-		printError(lineNum, "\"%s\" is an invalid parameter.", operand->str);
+		printError(ctx, lineNum, "\"%s\" is an invalid parameter.", operand->str);
 		operand->type = INVALID;
 		value = -1;
 	}
@@ -467,7 +506,7 @@ void parseOpInfo(operandInfo *operand, int lineNum)
 }
 
 /* Parses the operands in a command line. */
-void parseCmdOperands(lineInfo *line, int *IC, int *DC)
+void parseCmdOperands(assemblerContext *ctx, lineInfo *line)
 {
 	char *startOfNextPart = line->lineStr;
 	bool foundComma = FALSE;
@@ -483,20 +522,11 @@ void parseCmdOperands(lineInfo *line, int *IC, int *DC)
 		/* If both of the operands are registers, they will only take 1 memory word (instead of 2) */
 		if (!(line->op1.type == REGISTER && line->op2.type == REGISTER))
 		{
-			/* Check if there is enough memory */
-			if (*IC + *DC < MAX_DATA_NUM)
-			{
-				++*IC; /* Count the last command word or operand. */
-			}
-			else
-			{
-				line->isError = TRUE;
-				return;
-			}
+			++ctx->IC; /* Count the last command word or operand. */
 		}
 
 		/* Check if there are still more operands to read */
-		if (isWhiteSpaces(line->lineStr) || numOfOpsFound > 2)
+		if (isWhiteSpaces(&ctx->scan, line->lineStr) || numOfOpsFound > 2)
 		{
 			/* If there are more than 2 operands it's already illegal */
 			break;
@@ -511,8 +541,9 @@ void parseCmdOperands(lineInfo *line, int *IC, int *DC)
 		}
 
 		/* Parse the opernad*/
-		line->op2.str = getFirstOperand(line->lineStr, &startOfNextPart, &foundComma);
-		parseOpInfo(&line->op2, line->lineNum);
+		line->op2.str = getFirstOperand(&ctx->scan, line->lineStr, &startOfNextPart, &foundComma);
+		line->op2.length = findChars(&ctx->scan, line->op2.str, CHAR_END) - line->op2.str;
+		parseOpInfo(ctx, &line->op2, line->lineNum);
 
 		if (line->op2.type == INVALID)
 		{
@@ -530,11 +561,11 @@ void parseCmdOperands(lineInfo *line, int *IC, int *DC)
 		/* There are more/less operands than needed */
 		if (numOfOpsFound <  line->cmd->numOfParams)
 		{
-			printError(line->lineNum, "Not enough operands.", line->commandStr);
+			printError(ctx, line->lineNum, "Not enough operands.", line->commandStr);
 		}
 		else
 		{
-			printError(line->lineNum, "Too many operands.", line->commandStr);
+			printError(ctx, line->lineNum, "Too many operands.", line->commandStr);
 		}
 
 		line->isError = TRUE;
@@ -544,12 +575,12 @@ void parseCmdOperands(lineInfo *line, int *IC, int *DC)
 	/* Check if there is a comma after the last param */
 	if (foundComma)
 	{
-		printError(line->lineNum, "Don't write a comma after the last parameter.");
+		printError(ctx, line->lineNum, "Don't write a comma after the last parameter.");
 		line->isError = TRUE;
 		return;
 	}
 	/* Check if the operands' types are legal */
-	if (!areLegalOpTypes(line->cmd, line->op1, line->op2, line->lineNum))
+	if (!areLegalOpTypes(ctx, line->cmd, line->op1, line->op2, line->lineNum))
 	{
 		line->isError = TRUE;
 		return;
@@ -557,9 +588,9 @@ void parseCmdOperands(lineInfo *line, int *IC, int *DC)
 }
 
 /* Parses the command in a command line. */
-void parseCommand(lineInfo *line, int *IC, int *DC)
+void parseCommand(assemblerContext *ctx, lineInfo *line)
 {
-	int cmdId = getCmdId(line->commandStr);
+	int cmdId = getCmdId(line->commandStr, strlen(line->commandStr));
 
 	if (cmdId == -1)
 	{
@@ -567,61 +598,55 @@ void parseCommand(lineInfo *line, int *IC, int *DC)
 		if (*line->commandStr == '\0')
 		{
 			/* The command is empty, but the line isn't empty so it's only a label. */
-			printError(line->lineNum, "Can't write a label to an empty line.", line->commandStr);
+			printError(ctx, line->lineNum, "Can't write a label to an empty line.", line->commandStr);
 		}
 		else
 		{
 			/* Illegal command. */
-			printError(line->lineNum, "No such command as \"%s\".", line->commandStr);
+			printError(ctx, line->lineNum, "No such command as \"%s\".", line->commandStr);
 		}
 		line->isError = TRUE;
 		return;
 	}
 
 	line->cmd = &g_cmdArr[cmdId];
-	parseCmdOperands(line, IC, DC);
+	parseCmdOperands(ctx, line);
 }
 
-/* Returns the same string in a different part of the memory by using malloc. */
-char *allocString(const char *str) 
+/* Parses a line of 'length' chars, and print errors. */
+/* The line is copied once into the arena (with SCAN_PADDING '\0' chars after it), because the parser writes into the text. */
+void parseLine(assemblerContext *ctx, lineInfo *line, const char *lineStr, size_t length, int lineNum)
 {
-	char *newString = (char *)malloc(strlen(str) + 1);
-	if (newString) 
-	{
-		strcpy(newString, str); 
-	}
-
-	return newString;
-}
-
-/* Parses a line, and print errors. */
-void parseLine(lineInfo *line, char *lineStr, int lineNum, int *IC, int *DC)
-{
-	char *startOfNextPart = lineStr;
+	char *startOfNextPart;
 
 	line->lineNum = lineNum;
-	line->address = FIRST_ADDRESS + *IC;
-	line->originalString = allocString(lineStr);
+	line->address = FIRST_ADDRESS + ctx->IC;
+	line->originalString = (char *)arenaAlloc(&ctx->arena, length + SCAN_PADDING);
 	line->lineStr = line->originalString;
 	line->isError = FALSE;
-	line->label = NULL;
+	line->labelId = -1;
 	line->commandStr = NULL;
 	line->cmd = NULL;
 
 	if (!line->originalString)
 	{
-		printf("[Error] Not enough memory - malloc falied.");
+		appendFormat(&ctx->messages, "[Error] Not enough memory - malloc falied.");
 		return;
 	}
 
+	/* Classify the chars of the line once, the tokenizer finds the tokens from the masks */
+	memcpy(line->originalString, lineStr, length);
+	memset(line->originalString + length, '\0', SCAN_PADDING);
+	scanLine(&ctx->scan, line->originalString, length);
+
 	/* Check if the line is a comment */
-	if (isCommentOrEmpty(line))
+	if (isCommentOrEmpty(ctx, line))
 	{	
 		return;
 	}
 
 	/* Find label and add it to the label list */
-	startOfNextPart = findLabel(line, *IC);
+	startOfNextPart = findLabel(ctx, line, ctx->IC);
 	if (line->isError)
 	{
 		return;
@@ -633,17 +658,17 @@ void parseLine(lineInfo *line, char *lineStr, int lineNum, int *IC, int *DC)
 	}
 
 	/* Find the command token */
-	line->commandStr = getFirstTok(line->lineStr, &startOfNextPart);
+	line->commandStr = getFirstTok(&ctx->scan, line->lineStr, &startOfNextPart);
 	line->lineStr = startOfNextPart;
 	/* Parse the command / directive */
 	if (isDirective(line->commandStr))
 	{
 		line->commandStr++; /* Remove the '.' from the command */
-		parseDirective(line, IC, DC);
+		parseDirective(ctx, line);
 	}
 	else
 	{
-		parseCommand(line, IC, DC);
+		parseCommand(ctx, line);
 	}
 
 	if (line->isError)
@@ -652,87 +677,88 @@ void parseLine(lineInfo *line, char *lineStr, int lineNum, int *IC, int *DC)
 	}
 }
 
-/* Puts a line from 'file' in 'buf'. Returns if the line is shorter than maxLength. */
-bool readLine(FILE *file, char *buf, size_t maxLength)
+/* Returns the next line in the reader (without the '\n'), and puts its length in *length. */
+/* Returns NULL at the end of the source. */
+const char *nextLine(sourceReader *reader, size_t *length)
 {
-	char *endOfLine;
+	const char *line = reader->pos, *endOfLine;
 
-	if (!fgets(buf, maxLength, file))
+	if (reader->pos >= reader->end)
 	{
-		return FALSE;
+		return NULL;
 	}
 
-	/* Check if the line os too long (no '\n' was present). */
-	endOfLine = strchr(buf, '\n');
+	/* Find the end of the line and skip the '\n' */
+	endOfLine = memchr(line, '\n', reader->end - line);
 	if (endOfLine)
 	{
-		*endOfLine = '\0';
+		reader->pos = endOfLine + 1;
 	}
 	else
 	{
-		char c;
-		bool ret = (feof(file)) ? TRUE : FALSE; /* Return FALSE, unless it's the end of the file */
-
-		/* Keep reading chars until you reach the end of the line ('\n') or EOF */
-		do
-		{
-			c = fgetc(file);
-		} while (c != '\n' && c != EOF);
-
-		return ret;
+		endOfLine = reader->end;
+		reader->pos = reader->end;
 	}
 
-	return TRUE;
+	*length = endOfLine - line;
+	return line;
 }
 
-/* Reading the file for the first time, line by line, and parsing it. */
+/* Reading the source for the first time, line by line (as the macros are expanded), and parsing it. */
 /* Returns how many errors were found. */
-int firstFileRead(FILE *file, lineInfo *linesArr, int *linesFound, int *IC, int *DC)
+int firstFileRead(assemblerContext *ctx, macroExpander *expander)
 {
-	char lineStr[MAX_LINE_LENGTH + 2]; /* +2 for the \n and \0 at the end */
+	const char *lineStr;
+	size_t length;
 	int errorsFound = 0;
+	lineInfo *newLinesArr;
 
-	*linesFound = 0;
+	ctx->linesFound = 0;
 
 	/* Read lines and parse them */
-	while (!feof(file))
+	while ((lineStr = nextExpandedLine(ctx, expander, &length)) != NULL)
 	{
-		if (readLine(file, lineStr, MAX_LINE_LENGTH + 2)) 
+		/* Make sure there is enough space in ctx->linesArr for the line */
+		newLinesArr = (lineInfo *)reserveArray(ctx->linesArr, &ctx->linesCapacity, ctx->linesFound + 1, sizeof(lineInfo));
+		if (!newLinesArr)
 		{
-			/* Check if the file is too lone */
-			if (*linesFound >= MAX_LINES_NUM)
-			{
-				printf("[Error] File is too long. Max lines number in file is %d.\n", MAX_LINES_NUM);
-				return ++errorsFound;
-			}
+			appendFormat(&ctx->messages, "[Error] Not enough memory - malloc falied. Stoping to read the file.\n");
+			return ++errorsFound;
+		}
+		ctx->linesArr = newLinesArr;
 
-			/* Parse a line */
-			parseLine(&linesArr[*linesFound], lineStr, *linesFound + 1, IC, DC);
+		if (length <= MAX_LINE_LENGTH)
+		{
+			/* Parse a line (straight from the source, it's copied only once) */
+			parseLine(ctx, &ctx->linesArr[ctx->linesFound], lineStr, length, ctx->linesFound + 1);
 
 			/* Update errorsFound */
-			if (linesArr[*linesFound].isError)
+			if (ctx->linesArr[ctx->linesFound].isError)
 			{
 				errorsFound++;
 			}
 
-			/* Check if the number of memory words needed is small enough */
-			if (*IC + *DC >= MAX_DATA_NUM)
+			/* Check if the code and data still fit in the memory of the machine */
+			if (FIRST_ADDRESS + ctx->IC + ctx->DC > MEMORY_SIZE)
 			{
-				/* dataArr is full. Stop reading the file. */
-				printError(*linesFound + 1, "Too much data and code. Max memory words is %d.", MAX_DATA_NUM);
-				printf("[Info] Memory is full. Stoping to read the file.\n");
+				/* The memory is full. Stop reading the file. */
+				printError(ctx, ctx->linesFound + 1, "Too much data and code. Max memory words is %d.", MEMORY_SIZE - FIRST_ADDRESS);
+				appendFormat(&ctx->messages, "[Info] Memory is full. Stoping to read the file.\n");
+				++ctx->linesFound;
 				return ++errorsFound;
 			}
-			++*linesFound;
+			++ctx->linesFound;
 		}
-		else if (!feof(file))
+		else
 		{
-			/* Line is too long */
-			printError(*linesFound + 1, "Line is too long. Max line length is %d.", MAX_LINE_LENGTH);
+			/* Line is too long - keep an empty line with an error in its place */
+			printError(ctx, ctx->linesFound + 1, "Line is too long. Max line length is %d.", MAX_LINE_LENGTH);
+			parseLine(ctx, &ctx->linesArr[ctx->linesFound], "", 0, ctx->linesFound + 1);
+			ctx->linesArr[ctx->linesFound].isError = TRUE;
 			errorsFound++;
-			++*linesFound;
+			++ctx->linesFound;
 		}
 	}
 
 	return errorsFound;
-}
\ No newline at end of file
+}
@@ -0,0 +1,698 @@
+/*
+The JIT of the simulator.
+Compiles the blocks of a memory image (the instructions from an address up to a jump) into x86-64 code in an
+executable memory, and runs them instead of the interpreter. The machine is the same as in simulator.c.
+The registers r0-r7 are kept in host registers while the compiled code runs. get, prn and hlt, the illegal
+instructions, and the instructions that can't run now (a full or empty jsr stack, a write to a compiled word,
+fewer steps left than the block has) exit the compiled code and run on the interpreter.
+A write to a compiled word throws all the compiled code away, so the code is compiled again as it's changed.
+On other hosts createJit returns NULL and runJit runs the interpreter.
+
+The host registers of the compiled code:
+- rdi: the machine, rsi: the steps left, r9: the JIT (the blocks and isCode), r8d: the zero flag (0 if it's set).
+- ebx, ebp, r12d, r13d, r14d, r15d, r10d, r11d: the registers r0-r7.
+- eax, ecx, edx: scratch. An exit or a jump to the dispatch gets the address in eax.
+*/
+
+#define _DEFAULT_SOURCE /* For MAP_ANONYMOUS */
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+	#define JIT_SUPPORTED
+	#include <sys/mman.h>
+#endif
+
+#ifdef JIT_SUPPORTED
+
+/* ======== Macros ======== */
+#define JIT_CODE_SIZE				(256 * 1024) /* The size of the executable memory */
+#define JIT_MAX_BLOCK_LENGTH		64 /* The max instructions of a block */
+#define JIT_MAX_INSTRUCTION_CODE	96 /* The max bytes of the code of an instruction (with its stub) */
+#define JIT_MAX_BLOCK_CODE			64 /* The max bytes of the code of a block besides its instructions */
+#define JIT_EXIT_LOOKUP				0 /* The compiled code got to an address without a block */
+#define JIT_EXIT_INTERPRET			1 /* The instruction at the pc has to run on the interpreter */
+
+/* The x86-64 opcodes (a 0x0F prefix is written as 0x0Fxx) */
+#define X86_JMP						0xE9
+#define X86_JE						0x0F84
+#define X86_JNE						0x0F85
+#define X86_JB						0x0F82
+#define X86_JAE						0x0F83
+
+/* ======== Data Structures ======== */
+
+/* The host registers, by their number in the encoding */
+typedef enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 } hostRegister;
+
+/* Where the value of an operand is */
+typedef enum { JIT_REGISTER, JIT_MEMORY, JIT_IMMEDIATE } operandKind;
+
+/* An operand of an instruction: a host register, a memory address, or an immediate value */
+typedef struct
+{
+	operandKind kind;
+	int value;
+} jitOperand;
+
+/* The arithmetic instructions that take an operand */
+typedef enum { ALU_MOV, ALU_ADD, ALU_SUB, ALU_AND, ALU_CMP } aluOp;
+
+/* The opcodes of an arithmetic instruction */
+typedef struct
+{
+	int rmReg;					/* op r/m32, r32 */
+	int regRm;					/* op r32, r/m32 */
+	int imm;					/* op r/m32, imm32 */
+	int immDigit;				/* The reg field of the imm32 form */
+} aluEncoding;
+
+/* An exit of a block to the interpreter, written after the code of the block */
+typedef struct
+{
+	size_t patch;				/* The offset of the jump to the exit */
+	int address;				/* The address of the instruction that runs on the interpreter */
+	int stepsBack;				/* The steps of the block that weren't run */
+} jitStub;
+
+/* The block being compiled */
+typedef struct
+{
+	jitStub stubs[JIT_MAX_BLOCK_LENGTH + 1];	/* An instruction has up to one stub, and the block has one */
+	int numOfStubs;
+} jitBlock;
+
+/* ====== Externs ====== */
+/* Use the commands list from firstRead.c */
+extern const command g_cmdArr[];
+
+/* ====== Globals ====== */
+
+/* The host registers of r0-r7 */
+const hostRegister g_jitRegisters[NUM_OF_REGISTERS] = { RBX, RBP, R12, R13, R14, R15, R10, R11 };
+
+/* The opcodes of each aluOp */
+const aluEncoding g_aluArr[] =
+{	/* r/m, r | r, r/m | imm | imm digit */
+	{ 0x89, 0x8B, 0xC7, 0 },	/* mov */
+	{ 0x01, 0x03, 0x81, 0 },	/* add */
+	{ 0x29, 0x2B, 0x81, 5 },	/* sub */
+	{ 0x21, 0x23, 0x81, 4 },	/* and */
+	{ 0x39, 0x3B, 0x81, 7 }		/* cmp */
+};
+
+/* ====== Methods ====== */
+
+/* === Code === */
+
+/* Writes a byte of code. */
+void emitByte(simJit *jit, int value)
+{
+	jit->code[jit->codeUsed++] = (unsigned char)value;
+}
+
+/* Writes a 32 bits value of code. */
+void emitInt(simJit *jit, int value)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		emitByte(jit, (int)(((unsigned int)value >> (8 * i)) & 0xFF));
+	}
+}
+
+/* Writes the REX prefix of the registers of an instruction (if it needs one). */
+void emitRex(simJit *jit, bool wide, int reg, int index, int base)
+{
+	int rex = 0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+
+	if (rex != 0x40)
+	{
+		emitByte(jit, rex);
+	}
+}
+
+/* Writes an opcode (with its 0x0F prefix). */
+void emitOpcode(simJit *jit, int opcode)
+{
+	if (opcode > 0xFF)
+	{
+		emitByte(jit, opcode >> 8);
+	}
+	emitByte(jit, opcode & 0xFF);
+}
+
+/* Writes an instruction with a register operand 'rm' (reg is a register or an opcode digit). */
+void emitRegOp(simJit *jit, int opcode, bool wide, int reg, int rm)
+{
+	emitRex(jit, wide, reg, 0, rm);
+	emitOpcode(jit, opcode);
+	emitByte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* Writes an instruction with a memory operand [base + index * (1 << scale) + disp] (no index if it's negative). */
+void emitMemOp(simJit *jit, int opcode, bool wide, int reg, int base, int index, int scale, int disp)
+{
+	emitRex(jit, wide, reg, index < 0 ? 0 : index, base);
+	emitOpcode(jit, opcode);
+	if (index < 0)
+	{
+		emitByte(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+	}
+	else
+	{
+		emitByte(jit, 0x84 | ((reg & 7) << 3));
+		emitByte(jit, (scale << 6) | ((index & 7) << 3) | (base & 7));
+	}
+	emitInt(jit, disp);
+}
+
+/* Writes an arithmetic instruction on a host register and an operand. */
+void emitAlu(simJit *jit, aluOp op, int reg, jitOperand *operand)
+{
+	switch (operand->kind)
+	{
+	case JIT_REGISTER:
+		emitRegOp(jit, g_aluArr[op].rmReg, FALSE, operand->value, reg);
+		break;
+
+	case JIT_MEMORY:
+		emitMemOp(jit, g_aluArr[op].regRm, FALSE, reg, RDI, -1, 0, (int)offsetof(simMachine, memory) + operand->value * (int)sizeof(int));
+		break;
+
+	default:
+		emitRegOp(jit, g_aluArr[op].imm, FALSE, g_aluArr[op].immDigit, reg);
+		emitInt(jit, operand->value);
+	}
+}
+
+/* Writes an arithmetic instruction on a host register and an immediate value. */
+void emitAluImm(simJit *jit, aluOp op, int reg, int value)
+{
+	jitOperand operand;
+
+	operand.kind = JIT_IMMEDIATE;
+	operand.value = value;
+	emitAlu(jit, op, reg, &operand);
+}
+
+/* Writes a jump (or a conditional jump) to 'target' (or to 0 if it's NULL). Returns the offset to patch it later. */
+size_t emitJump(simJit *jit, int opcode, const unsigned char *target)
+{
+	size_t patch;
+
+	emitOpcode(jit, opcode);
+	patch = jit->codeUsed;
+	emitInt(jit, target ? (int)(target - (jit->code + patch + 4)) : 0);
+	return patch;
+}
+
+/* Makes the jump at the offset 'patch' jump to the current end of the code. */
+void patchJump(simJit *jit, size_t patch)
+{
+	int rel = (int)(jit->codeUsed - (patch + 4));
+
+	memcpy(jit->code + patch, &rel, sizeof(rel));
+}
+
+/* Writes a jump to the block at 'address': directly if it's compiled, and through the dispatch otherwise. */
+void emitGoto(simJit *jit, int address)
+{
+	if (address < MEMORY_SIZE && jit->blocks[address])
+	{
+		emitJump(jit, X86_JMP, (unsigned char *)jit->blocks[address]);
+		return;
+	}
+	emitByte(jit, 0xB8 + RAX); /* mov eax, address */
+	emitInt(jit, address);
+	emitJump(jit, X86_JMP, jit->code + (address < MEMORY_SIZE ? jit->dispatch : jit->exitLookup));
+}
+
+/* Writes a conditional jump to a new stub of the block, that runs the instruction at 'address' on the interpreter. */
+void addStub(simJit *jit, jitBlock *block, int opcode, int address, int stepsBack)
+{
+	jitStub *stub = &block->stubs[block->numOfStubs++];
+
+	stub->patch = emitJump(jit, opcode, NULL);
+	stub->address = address;
+	stub->stepsBack = stepsBack;
+}
+
+/* Writes the code shared by the blocks: the entry, the dispatch and the exits. */
+/* The entry is called as int entry(simMachine *machine, simJit *jit, void *block), and returns the JIT_EXIT. */
+void emitSharedCode(simJit *jit)
+{
+	const int saved[] = { RBX, RBP, R12, R13, R14, R15 }; /* The callee saved registers */
+	size_t toLookup, toLookupNull, toExit;
+	int i;
+
+	/* The entry */
+	for (i = 0; i < 6; i++)
+	{
+		emitRex(jit, FALSE, 0, 0, saved[i]);
+		emitByte(jit, 0x50 + (saved[i] & 7)); /* push */
+	}
+	emitRegOp(jit, 0x8B, TRUE, R9, RSI);
+	emitMemOp(jit, 0x8B, TRUE, RSI, R9, -1, 0, (int)offsetof(simJit, stepsLeft));
+	emitMemOp(jit, 0x8B, FALSE, R8, R9, -1, 0, (int)offsetof(simJit, notZero));
+	for (i = 0; i < NUM_OF_REGISTERS; i++)
+	{
+		emitMemOp(jit, 0x8B, FALSE, g_jitRegisters[i], RDI, -1, 0, (int)offsetof(simMachine, registers) + i * (int)sizeof(int));
+	}
+	emitRegOp(jit, 0xFF, FALSE, 4, RDX); /* jmp rdx */
+
+	/* The dispatch: jumps to the block of the address in eax, or exits if it isn't compiled */
+	jit->dispatch = jit->codeUsed;
+	emitAluImm(jit, ALU_CMP, RAX, MEMORY_SIZE);
+	toLookup = emitJump(jit, X86_JAE, NULL);
+	emitMemOp(jit, 0x8B, TRUE, RCX, R9, RAX, 3, (int)offsetof(simJit, blocks));
+	emitRegOp(jit, 0x85, TRUE, RCX, RCX); /* test rcx, rcx */
+	toLookupNull = emitJump(jit, X86_JE, NULL);
+	emitRegOp(jit, 0xFF, FALSE, 4, RCX); /* jmp rcx */
+
+	/* The exits: keep the state of the machine and return */
+	jit->exitInterpret = jit->codeUsed;
+	emitByte(jit, 0xB8 + RDX); /* mov edx, JIT_EXIT_INTERPRET */
+	emitInt(jit, JIT_EXIT_INTERPRET);
+	toExit = emitJump(jit, X86_JMP, NULL);
+
+	jit->exitLookup = jit->codeUsed;
+	patchJump(jit, toLookup);
+	patchJump(jit, toLookupNull);
+	emitByte(jit, 0xB8 + RDX); /* mov edx, JIT_EXIT_LOOKUP */
+	emitInt(jit, JIT_EXIT_LOOKUP);
+
+	patchJump(jit, toExit);
+	emitMemOp(jit, 0x89, FALSE, RAX, RDI, -1, 0, (int)offsetof(simMachine, pc));
+	emitMemOp(jit, 0x89, TRUE, RSI, R9, -1, 0, (int)offsetof(simJit, stepsLeft));
+	emitMemOp(jit, 0x89, FALSE, R8, R9, -1, 0, (int)offsetof(simJit, notZero));
+	for (i = 0; i < NUM_OF_REGISTERS; i++)
+	{
+		emitMemOp(jit, 0x89, FALSE, g_jitRegisters[i], RDI, -1, 0, (int)offsetof(simMachine, registers) + i * (int)sizeof(int));
+	}
+	emitRegOp(jit, 0x8B, FALSE, RAX, RDX);
+	for (i = 5; i >= 0; i--)
+	{
+		emitRex(jit, FALSE, 0, 0, saved[i]);
+		emitByte(jit, 0x58 + (saved[i] & 7)); /* pop */
+	}
+	emitByte(jit, 0xC3); /* ret */
+
+	jit->sharedSize = jit->codeUsed;
+}
+
+/* === Blocks === */
+
+/* Returns where the value pointed by an operand of a decoded instruction is. */
+jitOperand getJitOperand(simMachine *machine, int *value)
+{
+	jitOperand operand;
+
+	if (value >= machine->registers && value < machine->registers + NUM_OF_REGISTERS)
+	{
+		operand.kind = JIT_REGISTER;
+		operand.value = g_jitRegisters[value - machine->registers];
+	}
+	else if (value >= machine->memory && value < machine->memory + MEMORY_SIZE)
+	{
+		operand.kind = JIT_MEMORY;
+		operand.value = (int)(value - machine->memory);
+	}
+	else
+	{
+		operand.kind = JIT_IMMEDIATE;
+		operand.value = *value;
+	}
+	return operand;
+}
+
+/* Returns if an operation is compiled (the others run on the interpreter). */
+bool isCompiledOp(int op)
+{
+	return op <= SIM_RST && op != SIM_GET && op != SIM_PRN;
+}
+
+/* Returns if an operation ends a block. */
+bool isJumpOp(int op)
+{
+	return op == SIM_JMP || op == SIM_BNE || op == SIM_JSR || op == SIM_RST;
+}
+
+/* Writes a jump to the target of a jump instruction: a compiled address, or the address in a register. */
+void emitJumpTarget(simJit *jit, jitOperand *target)
+{
+	if (target->kind == JIT_REGISTER)
+	{
+		emitRegOp(jit, 0x8B, FALSE, RAX, target->value);
+		emitJump(jit, X86_JMP, jit->code + jit->dispatch);
+	}
+	else
+	{
+		emitGoto(jit, target->value);
+	}
+}
+
+/* Writes the code of a write instruction (mov, add, sub, not, clr, lea, inc, dec). */
+void emitWriteInstruction(simJit *jit, jitBlock *block, simInstruction *ins, jitOperand *src, jitOperand *dst, int address, int stepsBack)
+{
+	int work = dst->kind == JIT_REGISTER ? dst->value : RAX;
+
+	if (dst->kind == JIT_MEMORY && ins->op != SIM_MOV && ins->op != SIM_LEA && ins->op != SIM_CLR)
+	{
+		emitAlu(jit, ALU_MOV, RAX, dst);
+	}
+
+	switch (ins->op)
+	{
+	case SIM_MOV:
+	case SIM_LEA:
+		emitAlu(jit, ALU_MOV, work, src);
+		break;
+
+	case SIM_ADD:
+		emitAlu(jit, ALU_ADD, work, src);
+		break;
+
+	case SIM_SUB:
+		emitAlu(jit, ALU_SUB, work, src);
+		break;
+
+	case SIM_NOT:
+		emitRegOp(jit, 0xF7, FALSE, 2, work);
+		break;
+
+	case SIM_CLR:
+		emitAluImm(jit, ALU_MOV, work, 0);
+		break;
+
+	case SIM_INC:
+		emitAluImm(jit, ALU_ADD, work, 1);
+		break;
+
+	default:
+		emitAluImm(jit, ALU_SUB, work, 1);
+	}
+
+	/* The sources are words already */
+	if (ins->op != SIM_MOV && ins->op != SIM_LEA && ins->op != SIM_CLR)
+	{
+		emitAluImm(jit, ALU_AND, work, WORD_MASK);
+	}
+
+	if (dst->kind == JIT_MEMORY)
+	{
+		/* A write to a compiled word runs on the interpreter (and throws the code away) */
+		emitMemOp(jit, 0x80, FALSE, 7, R9, -1, 0, (int)offsetof(simJit, isCode) + dst->value); /* cmp byte */
+		emitByte(jit, 0);
+		addStub(jit, block, X86_JNE, address, stepsBack);
+		emitMemOp(jit, 0x89, FALSE, RAX, RDI, -1, 0, (int)offsetof(simMachine, memory) + dst->value * (int)sizeof(int));
+	}
+}
+
+/* Writes the code of the instruction at 'address' in a block, that has 'stepsBack' instructions from it to the end of the block. */
+void emitInstruction(simJit *jit, simMachine *machine, jitBlock *block, int address, int stepsBack)
+{
+	simInstruction *ins = &machine->slots[SIM_SLOT(address)];
+	jitOperand src, dst;
+	size_t toNext;
+
+	if (g_cmdArr[ins->op].numOfParams == 2)
+	{
+		src = getJitOperand(machine, ins->src);
+	}
+	if (g_cmdArr[ins->op].numOfParams >= 1)
+	{
+		dst = getJitOperand(machine, ins->dst);
+	}
+
+	switch (ins->op)
+	{
+	case SIM_CMP:
+		emitAlu(jit, ALU_MOV, RAX, &src);
+		emitAlu(jit, ALU_SUB, RAX, &dst);
+		emitAluImm(jit, ALU_AND, RAX, WORD_MASK);
+		emitRegOp(jit, 0x8B, FALSE, R8, RAX);
+		break;
+
+	case SIM_JMP:
+		emitJumpTarget(jit, &dst);
+		break;
+
+	case SIM_BNE:
+		emitRegOp(jit, 0x85, FALSE, R8, R8); /* test r8d, r8d */
+		toNext = emitJump(jit, X86_JE, NULL);
+		emitJumpTarget(jit, &dst);
+		patchJump(jit, toNext);
+		emitGoto(jit, ins->next);
+		break;
+
+	case SIM_JSR:
+		emitMemOp(jit, 0x8B, FALSE, RAX, RDI, -1, 0, (int)offsetof(simMachine, stackSize));
+		emitAluImm(jit, ALU_CMP, RAX, SIM_STACK_SIZE);
+		addStub(jit, block, X86_JAE, address, stepsBack);
+		emitMemOp(jit, 0xC7, FALSE, 0, RDI, RAX, 2, (int)offsetof(simMachine, stack)); /* mov dword [stack + rax * 4] */
+		emitInt(jit, ins->next);
+		emitAluImm(jit, ALU_ADD, RAX, 1);
+		emitMemOp(jit, 0x89, FALSE, RAX, RDI, -1, 0, (int)offsetof(simMachine, stackSize));
+		emitJumpTarget(jit, &dst);
+		break;
+
+	case SIM_RST:
+		emitMemOp(jit, 0x8B, FALSE, RAX, RDI, -1, 0, (int)offsetof(simMachine, stackSize));
+		emitRegOp(jit, 0x85, FALSE, RAX, RAX); /* test eax, eax */
+		addStub(jit, block, X86_JE, address, stepsBack);
+		emitAluImm(jit, ALU_SUB, RAX, 1);
+		emitMemOp(jit, 0x89, FALSE, RAX, RDI, -1, 0, (int)offsetof(simMachine, stackSize));
+		emitMemOp(jit, 0x8B, FALSE, RAX, RDI, RAX, 2, (int)offsetof(simMachine, stack));
+		emitJump(jit, X86_JMP, jit->code + jit->dispatch);
+		break;
+
+	default:
+		emitWriteInstruction(jit, block, ins, &src, &dst, address, stepsBack);
+	}
+}
+
+/* Throws away all the compiled code. */
+void clearJitCode(simJit *jit)
+{
+	memset(jit->blocks, 0, sizeof(jit->blocks));
+	memset(jit->isCode, 0, sizeof(jit->isCode));
+	jit->codeUsed = jit->sharedSize;
+}
+
+/* Compiles the block that starts at 'address'. Returns its code, or NULL if its first instruction runs on the interpreter. */
+void *compileBlock(simJit *jit, simMachine *machine, int address)
+{
+	int addresses[JIT_MAX_BLOCK_LENGTH];
+	int length = 0, next = address, i, j;
+	simInstruction *ins;
+	jitBlock block;
+	void *start;
+
+	/* The instructions are decoded again, since the compiled code doesn't decode the words it writes */
+	while (length < JIT_MAX_BLOCK_LENGTH && next < MEMORY_SIZE)
+	{
+		decodeInstruction(machine, next);
+		ins = &machine->slots[SIM_SLOT(next)];
+		if (!isCompiledOp(ins->op))
+		{
+			break;
+		}
+		addresses[length++] = next;
+		next = ins->next;
+		if (isJumpOp(ins->op))
+		{
+			break;
+		}
+	}
+	if (length == 0)
+	{
+		return NULL;
+	}
+
+	if (jit->codeUsed + length * JIT_MAX_INSTRUCTION_CODE + JIT_MAX_BLOCK_CODE > jit->codeSize)
+	{
+		clearJitCode(jit);
+		jit->numOfFlushes++;
+	}
+	start = jit->code + jit->codeUsed;
+	jit->blocks[address] = start; /* So a loop to its start jumps directly */
+	jit->numOfBlocks++;
+	block.numOfStubs = 0;
+
+	/* Take the steps of the whole block, or run its first instruction on the interpreter */
+	emitRegOp(jit, 0x81, TRUE, 7, RSI); /* cmp rsi, length */
+	emitInt(jit, length);
+	addStub(jit, &block, X86_JB, address, 0);
+	emitRegOp(jit, 0x81, TRUE, 5, RSI); /* sub rsi, length */
+	emitInt(jit, length);
+
+	for (i = 0; i < length; i++)
+	{
+		for (j = addresses[i]; j < machine->slots[SIM_SLOT(addresses[i])].next; j++)
+		{
+			jit->isCode[j] = TRUE;
+		}
+		emitInstruction(jit, machine, &block, addresses[i], length - i);
+	}
+	if (!isJumpOp(machine->slots[SIM_SLOT(addresses[length - 1])].op))
+	{
+		emitGoto(jit, next);
+	}
+
+	for (i = 0; i < block.numOfStubs; i++)
+	{
+		patchJump(jit, block.stubs[i].patch);
+		if (block.stubs[i].stepsBack)
+		{
+			emitRegOp(jit, 0x81, TRUE, 0, RSI); /* add rsi, stepsBack */
+			emitInt(jit, block.stubs[i].stepsBack);
+		}
+		emitByte(jit, 0xB8 + RAX); /* mov eax, address */
+		emitInt(jit, block.stubs[i].address);
+		emitJump(jit, X86_JMP, jit->code + jit->exitInterpret);
+	}
+	return start;
+}
+
+/* Runs the instruction at machine->pc on the interpreter. Throws the compiled code away if it wrote a compiled word. */
+simResult interpretInstruction(simJit *jit, simMachine *machine, unsigned long *stepsLeft)
+{
+	unsigned long steps = machine->steps;
+	simInstruction *ins;
+	int op, *dst;
+	simResult result;
+
+	if (machine->pc < MEMORY_SIZE)
+	{
+		decodeInstruction(machine, machine->pc);
+	}
+	ins = &machine->slots[SIM_SLOT(machine->pc)];
+	op = ins->op;
+	dst = ins->dst;
+
+	result = runMachine(machine, 1);
+	*stepsLeft -= machine->steps - steps;
+
+	if (op < SIM_DECODE && op != SIM_CMP && op != SIM_PRN && dst >= machine->memory && dst < machine->memory + MEMORY_SIZE
+		&& jit->isCode[dst - machine->memory])
+	{
+		clearJitCode(jit);
+		jit->numOfFlushes++;
+	}
+	return result;
+}
+
+/* Creates a JIT with an empty executable memory. Returns NULL if the host isn't supported, or if it failed. */
+simJit *createJit()
+{
+	simJit *jit = (simJit *)calloc(1, sizeof(simJit));
+	void *code;
+
+	if (!jit)
+	{
+		return NULL;
+	}
+	code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+	{
+		free(jit);
+		return NULL;
+	}
+	jit->code = (unsigned char *)code;
+	jit->codeSize = JIT_CODE_SIZE;
+	emitSharedCode(jit);
+	return jit;
+}
+
+/* Frees a JIT and its executable memory. */
+void freeJit(simJit *jit)
+{
+	if (jit)
+	{
+		munmap(jit->code, jit->codeSize);
+		free(jit);
+	}
+}
+
+/* Throws away the compiled code and the counters (before a new image is run). */
+void flushJit(simJit *jit)
+{
+	clearJitCode(jit);
+	jit->numOfBlocks = 0;
+	jit->numOfFlushes = 0;
+}
+
+/* Runs the machine from machine->pc until it stops, or until it runs maxSteps instructions (like runMachine). */
+/* The blocks are compiled when they are first run, and the instructions that can't be compiled run on the interpreter. */
+simResult runJit(simJit *jit, simMachine *machine, unsigned long maxSteps)
+{
+	int (*entry)(simMachine *, simJit *, void *);
+	unsigned long stepsLeft = maxSteps, startSteps = machine->steps;
+	simResult result = SIM_STEP_LIMIT;
+	void *block;
+
+	/* ISO C has no cast from a data pointer to a function pointer */
+	memcpy(&entry, &jit->code, sizeof(entry));
+
+	while (result == SIM_STEP_LIMIT && stepsLeft > 0)
+	{
+		block = NULL;
+		if (machine->pc < MEMORY_SIZE)
+		{
+			block = jit->blocks[machine->pc] ? jit->blocks[machine->pc] : compileBlock(jit, machine, machine->pc);
+		}
+		if (block)
+		{
+			jit->stepsLeft = stepsLeft;
+			jit->notZero = !machine->zeroFlag;
+			if (entry(machine, jit, block) == JIT_EXIT_LOOKUP)
+			{
+				stepsLeft = jit->stepsLeft;
+				machine->zeroFlag = jit->notZero == 0;
+				continue;
+			}
+			stepsLeft = jit->stepsLeft;
+			machine->zeroFlag = jit->notZero == 0;
+		}
+		if (stepsLeft > 0)
+		{
+			result = interpretInstruction(jit, machine, &stepsLeft);
+		}
+	}
+
+	machine->steps = startSteps + (maxSteps - stepsLeft);
+	return result;
+}
+
+#else
+
+/* The JIT isn't supported on this host. */
+simJit *createJit()
+{
+	return NULL;
+}
+
+/* Frees a JIT (there are none on this host). */
+void freeJit(simJit *jit)
+{
+	free(jit);
+}
+
+/* Throws away the compiled code (there is none on this host). */
+void flushJit(simJit *jit)
+{
+}
+
+/* Runs the machine on the interpreter. */
+simResult runJit(simJit *jit, simMachine *machine, unsigned long maxSteps)
+{
+	return runMachine(machine, maxSteps);
+}
+
+#endif
@@ -0,0 +1,353 @@
+/*
+The line scanner.
+Each line is classified once, before it's parsed: a bitmask for each class of chars (white spaces, '\0', ':', ',', '"', ';' and '#')
+holds a bit for each position in the line. The tokenizer helpers (at the end of this file) find the next or the last char
+of a class from the masks, instead of walking the chars again and again.
+The classification is done 32 chars at a time with AVX2, or 16 chars at a time with SSE2, and one char at a time otherwise.
+This file is built with optimizations (see the makefile) - the SIMD intrinsics are very slow without them.
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define SCAN_BLOCK_SIZE	32 /* The chars classified at once */
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+	#define SCAN_BLOCK_SIZE	16
+#endif
+
+/* The bit of a position in its word of a mask */
+#define SCAN_BIT(pos)		(1UL << ((pos) % SCAN_WORD_BITS))
+/* The bits of a word of a mask from a position on */
+#define SCAN_BITS_FROM(pos)	(~(SCAN_BIT(pos) - 1) & SCAN_WORD_MASK)
+#define SCAN_WORD_MASK		(SCAN_BIT(SCAN_WORD_BITS - 1) * 2 - 1)
+
+/* ====== Methods ====== */
+
+/* Returns the class of the char c, or NUM_OF_CHAR_CLASSES if it isn't in any class. */
+charClass getCharClass(char c)
+{
+	switch (c)
+	{
+		/* The white spaces of isspace (in the "C" locale) */
+		case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+			return CHAR_SPACE;
+		case '\0':
+			return CHAR_END;
+		case ':':
+			return CHAR_COLON;
+		case ',':
+			return CHAR_COMMA;
+		case '"':
+			return CHAR_QUOTE;
+		case ';':
+			return CHAR_SEMICOLON;
+		case '#':
+			return CHAR_HASH;
+	}
+	return NUM_OF_CHAR_CLASSES;
+}
+
+/* Puts the class of the char c (at 'pos' in the line) in the masks (or clears it from them). */
+void setCharClass(lineScan *scan, size_t pos, char c, bool isSet)
+{
+	charClass type = getCharClass(c);
+
+	if (type == NUM_OF_CHAR_CLASSES)
+	{
+		return;
+	}
+	if (isSet)
+	{
+		scan->masks[type][pos / SCAN_WORD_BITS] |= SCAN_BIT(pos);
+	}
+	else
+	{
+		scan->masks[type][pos / SCAN_WORD_BITS] &= ~SCAN_BIT(pos);
+	}
+}
+
+#ifdef SCAN_BLOCK_SIZE
+/* Puts the classes of the SCAN_BLOCK_SIZE chars at 'pos' in the line in the masks (pos is a multiple of SCAN_BLOCK_SIZE). */
+void classifyBlock(lineScan *scan, size_t pos)
+{
+	size_t word = pos / SCAN_WORD_BITS;
+	int shift = pos % SCAN_WORD_BITS, i;
+
+#if defined(__AVX2__)
+	__m256i chars = _mm256_loadu_si256((const __m256i *)(scan->text + pos));
+	__m256i isControl = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), chars));
+
+	#define CLASS_BITS(isClass)		((unsigned long)(unsigned int)_mm256_movemask_epi8(isClass) << shift)
+	#define EQUAL_BITS(c)			CLASS_BITS(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(c)))
+	unsigned long spaceBits = CLASS_BITS(_mm256_or_si256(isControl, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' '))));
+#else
+	__m128i chars = _mm_loadu_si128((const __m128i *)(scan->text + pos));
+	__m128i isControl = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('\r' + 1)));
+
+	#define CLASS_BITS(isClass)		((unsigned long)(unsigned int)_mm_movemask_epi8(isClass) << shift)
+	#define EQUAL_BITS(c)			CLASS_BITS(_mm_cmpeq_epi8(chars, _mm_set1_epi8(c)))
+	unsigned long spaceBits = CLASS_BITS(_mm_or_si128(isControl, _mm_cmpeq_epi8(chars, _mm_set1_epi8(' '))));
+#endif
+
+	/* The first block of a word replaces the bits of the last line */
+	if (shift == 0)
+	{
+		for (i = 0; i < NUM_OF_CHAR_CLASSES; i++)
+		{
+			scan->masks[i][word] = 0;
+		}
+	}
+
+	scan->masks[CHAR_SPACE][word] |= spaceBits;
+	scan->masks[CHAR_END][word] |= EQUAL_BITS('\0');
+	scan->masks[CHAR_COLON][word] |= EQUAL_BITS(':');
+	scan->masks[CHAR_COMMA][word] |= EQUAL_BITS(',');
+	scan->masks[CHAR_QUOTE][word] |= EQUAL_BITS('"');
+	scan->masks[CHAR_SEMICOLON][word] |= EQUAL_BITS(';');
+	scan->masks[CHAR_HASH][word] |= EQUAL_BITS('#');
+	#undef CLASS_BITS
+	#undef EQUAL_BITS
+}
+#endif
+
+/* Classifies the chars of a line of 'length' chars (MAX_LINE_LENGTH at most) and its '\0'. */
+/* The text must have SCAN_PADDING '\0' chars after the line, the last block may read some of them. */
+/* Only the words of the masks up to the '\0' are set, the searches never pass it. */
+void scanLine(lineScan *scan, char *text, size_t length)
+{
+	size_t pos;
+
+	scan->text = text;
+
+#ifdef SCAN_BLOCK_SIZE
+	for (pos = 0; pos <= length; pos += SCAN_BLOCK_SIZE)
+	{
+		classifyBlock(scan, pos);
+	}
+#else
+	memset(scan->masks, 0, sizeof(scan->masks));
+	for (pos = 0; pos <= length; pos++)
+	{
+		setCharClass(scan, pos, text[pos], TRUE);
+	}
+#endif
+}
+
+/* Changes a char of the scanned line (the parser puts '\0' at the end of each token), and its class. */
+void setLineChar(lineScan *scan, char *pos, char c)
+{
+	setCharClass(scan, pos - scan->text, *pos, FALSE);
+	setCharClass(scan, pos - scan->text, c, TRUE);
+	*pos = c;
+}
+
+/* Returns the position of the lowest set bit of a word (that isn't 0). */
+int getLowestBit(unsigned long bits)
+{
+#ifdef __GNUC__
+	return __builtin_ctzl(bits);
+#else
+	int bit = 0;
+
+	while (!(bits & 1))
+	{
+		bits >>= 1;
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+/* Returns the position of the highest set bit of a word (that isn't 0). */
+int getHighestBit(unsigned long bits)
+{
+#ifdef __GNUC__
+	return sizeof(unsigned long) * BYTE_SIZE - 1 - __builtin_clzl(bits);
+#else
+	int bit = 0;
+
+	while (bits >>= 1)
+	{
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+/* Returns the first char from 'from' (in the scanned line) of the class, or the '\0' that ends the string if it comes first. */
+char *findChars(lineScan *scan, char *from, charClass type)
+{
+	size_t pos = from - scan->text, word = pos / SCAN_WORD_BITS;
+	unsigned long bits = (scan->masks[type][word] | scan->masks[CHAR_END][word]) & SCAN_BITS_FROM(pos);
+
+	/* There is always a '\0' at the end of the line */
+	while (!bits)
+	{
+		word++;
+		bits = scan->masks[type][word] | scan->masks[CHAR_END][word];
+	}
+
+	return scan->text + word * SCAN_WORD_BITS + getLowestBit(bits);
+}
+
+/* Returns the first char from 'from' (in the scanned line) that isn't of the class (CHAR_END isn't allowed). */
+char *skipChars(lineScan *scan, char *from, charClass type)
+{
+	size_t pos = from - scan->text, word = pos / SCAN_WORD_BITS;
+	unsigned long bits = ~scan->masks[type][word] & SCAN_BITS_FROM(pos);
+
+	/* The '\0' at the end of the line isn't of the class */
+	while (!bits)
+	{
+		word++;
+		bits = ~scan->masks[type][word] & SCAN_WORD_MASK;
+	}
+
+	return scan->text + word * SCAN_WORD_BITS + getLowestBit(bits);
+}
+
+/* Returns the last char in [from, to) of the scanned line that isn't of the class, or NULL if there isn't. */
+char *findLastOtherChar(lineScan *scan, char *from, char *to, charClass type)
+{
+	size_t start = from - scan->text, end = to - scan->text, word;
+	unsigned long bits;
+
+	while (end > start)
+	{
+		/* The bits of [start, end) in the word of end - 1 */
+		word = (end - 1) / SCAN_WORD_BITS;
+		bits = ~scan->masks[type][word] & (SCAN_BIT(end - 1) * 2 - 1);
+		if (word == start / SCAN_WORD_BITS)
+		{
+			bits &= SCAN_BITS_FROM(start);
+		}
+		if (bits)
+		{
+			return scan->text + word * SCAN_WORD_BITS + getHighestBit(bits);
+		}
+		end = word * SCAN_WORD_BITS;
+	}
+
+	return NULL;
+}
+
+/* Returns if the char at pos (in the scanned line) is of the class. */
+bool isCharClass(lineScan *scan, const char *pos, charClass type)
+{
+	size_t index = pos - scan->text;
+
+	return (scan->masks[type][index / SCAN_WORD_BITS] & SCAN_BIT(index)) != 0;
+}
+
+/* ====== Tokenizer ====== */
+
+/* Removes spaces from start (the string is in the scanned line) */
+void trimLeftStr(lineScan *scan, char **ptStr)
+{
+	/* Return if it's NULL */
+	if (!ptStr)
+	{
+		return;
+	}
+
+	/* Get ptStr to the start of the actual text */
+	*ptStr = skipChars(scan, *ptStr, CHAR_SPACE);
+}
+
+/* Removes all the spaces from the edges of the string ptStr is pointing to. */
+void trimStr(lineScan *scan, char **ptStr)
+{
+	char *eos, *lastChar;
+
+	/* Return if it's NULL or empty string */
+	if (!ptStr || **ptStr == '\0')
+	{
+		return;
+	}
+
+	trimLeftStr(scan, ptStr);
+
+	/* eos is pointing to the '\0' at the end of str, and lastChar to the last char that isn't a space */
+	eos = findChars(scan, *ptStr, CHAR_END);
+	lastChar = findLastOtherChar(scan, *ptStr, eos, CHAR_SPACE);
+
+	/* Remove spaces from the end */
+	if (lastChar && lastChar + 1 != eos)
+	{
+		setLineChar(scan, lastChar + 1, '\0');
+	}
+}
+
+/* Returns a pointer to the start of first token. */
+/* Also makes *endOfTok (if it's not NULL) to point at the last char after the token. */
+char *getFirstTok(lineScan *scan, char *str, char **endOfTok)
+{
+	char *tokStart = str;
+	char *tokEnd = NULL;
+
+	/* Trim the start */
+	trimLeftStr(scan, &tokStart);
+
+	/* Find the end of the first word */
+	tokEnd = findChars(scan, tokStart, CHAR_SPACE);
+
+	/* Add \0 at the end if needed */
+	if (*tokEnd != '\0')
+	{
+		setLineChar(scan, tokEnd, '\0');
+		tokEnd++;
+	}
+
+	/* Make *endOfTok (if it's not NULL) to point at the last char after the token */
+	if (endOfTok)
+	{
+		*endOfTok = tokEnd;
+	}
+	return tokStart;
+}
+
+/* Returns if str contains only one word. */
+bool isOneWord(lineScan *scan, char *str)
+{
+	trimLeftStr(scan, &str);							/* Skip the spaces at the start */
+	str = findChars(scan, str, CHAR_SPACE);	/* Skip the text at the middle */
+
+	/* Return if it's the end of the text or not. */
+	return isWhiteSpaces(scan, str);
+}
+
+/* Returns if str contains only white spaces. */
+bool isWhiteSpaces(lineScan *scan, char *str)
+{
+	return *skipChars(scan, str, CHAR_SPACE) == '\0';
+}
+
+/* Returns a pointer to the start of the first operand in 'line' and change the end of it to '\0'. */
+/* Also makes *endOfOp (if it's not NULL) point at the next char after the operand. */
+char *getFirstOperand(lineScan *scan, char *line, char **endOfOp, bool *foundComma)
+{
+	if (!isWhiteSpaces(scan, line))
+	{
+		/* Find the first comma (or the end of the line) */
+		char *end = findChars(scan, line, CHAR_COMMA);
+		*foundComma = (*end == ',');
+		if (*foundComma)
+		{
+			setLineChar(scan, end, '\0');
+			end++;
+		}
+
+		/* Set endOfOp (if it's not NULL) to point at the next char after the operand
+		(Or at the end of it if it's the end of the line) */
+		if (endOfOp)
+		{
+			*endOfOp = end;
+		}
+	}
+
+	trimStr(scan, &line);
+	return line;
+}
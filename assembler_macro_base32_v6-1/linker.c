@@ -0,0 +1,496 @@
+/*
+The linker.
+Links the objects of the file names in argv (their .ob, .ent and .ext files, or their .obj files with -b)
+into one memory image, which is written as an .ob file (and as an .obj file too with -b).
+The code words of all the modules are placed first (in the order of argv), and the data words after them,
+so each module gets a code base and a data base in the image.
+The .entry labels of all the modules are kept in one hash index, each EXTERNAL word listed in a .ext file
+is patched with the address of its entry label, and each RELOCATABLE word is moved by the base of its module.
+The code of each module is decoded to find its operand words, so only the words of direct (label) operands are
+moved (the words of struct operands hold no address). An address that doesn't fit in the operand bits of a word
+is a link error.
+Every module, word and symbol is handled once, so linking takes a time linear in the size of the objects.
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/* ======== Macros ======== */
+#define MAX_OPERAND_ADDRESS	((1 << (MEMORY_WORD_LENGTH - ERA_BITS)) - 1) /* The last address that fits in an operand word */
+
+/* ====== Externs ====== */
+/* Use the commands list from firstRead.c */
+extern const command g_cmdArr[];
+
+/* ======== Data Structures ======== */
+
+/* An object to link */
+typedef struct
+{
+	char *fileName;
+	const objectHeader *header;		/* The binary object (NULL if it wasn't loaded) */
+	const char *content;			/* The mapped .obj file (with -b) */
+	size_t length;
+	bool isMapped;
+	textBuffer binary;				/* The binary object made from the text object files (without -b) */
+	int codeBase;					/* The address of the first code word of the module in the image */
+	int dataBase;					/* The address of the first data word of the module in the image */
+} linkModule;
+
+/* The state of linking the modules */
+typedef struct
+{
+	linkModule *modules;
+	int numOfModules;
+	assemblerContext globals;		/* The entry labels of all the modules (with their addresses in the image) */
+	int *entryModules;				/* The module that defined each label of globals */
+	int entryModulesCapacity;
+	signed char *wordModes;			/* The operand mode of each code word of the module being linked (INVALID if it isn't an operand) */
+	int wordModesCapacity;
+	int *memory;					/* The image */
+	int IC;
+	int DC;
+	textBuffer report;
+} linker;
+
+/* ====== Methods ====== */
+
+/* Loads the object of a module: its .obj file (mapped), or its text object files converted into a binary object. */
+/* The temporary buffers are used for the text files. Returns if it succeeded. */
+bool loadModule(linkModule *module, bool binaryInput, textBuffer *object, textBuffer *entries, textBuffer *externs, textBuffer *report)
+{
+	if (binaryInput)
+	{
+		module->content = mapFile(module->fileName, ".obj", &module->length, &module->isMapped);
+		if (!module->content)
+		{
+			appendFormat(report, "[Info] Can't open the file \"%s.obj\".\n", module->fileName);
+			return FALSE;
+		}
+		module->header = loadBinaryObject(module->content, module->length);
+		if (!module->header)
+		{
+			appendFormat(report, "[Error] \"%s.obj\" isn't a legal binary object.\n", module->fileName);
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	readTextFile(module->fileName, ".ob", object);
+	if (object->length == 0)
+	{
+		appendFormat(report, "[Info] Can't open the file \"%s.ob\".\n", module->fileName);
+		return FALSE;
+	}
+	readTextFile(module->fileName, ".ent", entries);
+	readTextFile(module->fileName, ".ext", externs);
+
+	/* The binary object is in a malloc block, which is aligned like loadBinaryObject needs */
+	if (!textToBinaryObject(object, entries, externs, &module->binary)
+		|| !(module->header = loadBinaryObject(module->binary.data, module->binary.length)))
+	{
+		appendFormat(report, "[Error] The object files of \"%s\" aren't legal.\n", module->fileName);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Releases the object of a module. */
+void releaseModule(linkModule *module)
+{
+	if (module->content)
+	{
+		releaseFile(module->content, module->length, module->isMapped);
+	}
+	free(module->binary.data);
+}
+
+/* Returns the name of a symbol of a module's object. */
+const char *getSymbolName(const linkModule *module, const objectSymbol *symbol)
+{
+	return (const char *)module->header + module->header->namesOffset + symbol->nameOffset;
+}
+
+/* Returns the address in the image of an address in a module (the code and the data of the module have their own bases). */
+int getImageAddress(const linkModule *module, int address)
+{
+	int codeEnd = FIRST_ADDRESS + module->header->IC;
+
+	return (address < codeEnd) ? module->codeBase + (address - FIRST_ADDRESS) : module->dataBase + (address - codeEnd);
+}
+
+/* Places the code and the data of each module in the image. Returns FALSE if the image doesn't fit in the memory. */
+bool placeModules(linker *lnk)
+{
+	int i, codeBase = FIRST_ADDRESS, dataBase;
+	long numOfWords = 0;
+
+	for (i = 0; i < lnk->numOfModules; i++)
+	{
+		numOfWords += lnk->modules[i].header->IC + lnk->modules[i].header->DC;
+		lnk->IC += lnk->modules[i].header->IC;
+	}
+	if (FIRST_ADDRESS + numOfWords > MEMORY_SIZE)
+	{
+		appendFormat(&lnk->report, "[Error] The image is %ld words, but only %d words fit in the memory.\n", numOfWords, MEMORY_SIZE - FIRST_ADDRESS);
+		return FALSE;
+	}
+	lnk->DC = (int)numOfWords - lnk->IC;
+
+	dataBase = FIRST_ADDRESS + lnk->IC;
+	for (i = 0; i < lnk->numOfModules; i++)
+	{
+		lnk->modules[i].codeBase = codeBase;
+		lnk->modules[i].dataBase = dataBase;
+		codeBase += lnk->modules[i].header->IC;
+		dataBase += lnk->modules[i].header->DC;
+	}
+
+	lnk->memory = (int *)malloc((numOfWords ? numOfWords : 1) * sizeof(int));
+	if (!lnk->memory)
+	{
+		appendFormat(&lnk->report, "[Error] Not enough memory - malloc falied.\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Adds a label to the global labels. Returns FALSE if there isn't enough memory. */
+bool addGlobalLabel(linker *lnk, const char *name, int address, int moduleId)
+{
+	assemblerContext *globals = &lnk->globals;
+	labelInfo *newLabelArr;
+	int *newModules;
+
+	newLabelArr = (labelInfo *)reserveArray(globals->labelArr, &globals->labelCapacity, globals->labelNum + 1, sizeof(labelInfo));
+	if (newLabelArr)
+	{
+		globals->labelArr = newLabelArr;
+	}
+	newModules = (int *)reserveArray(lnk->entryModules, &lnk->entryModulesCapacity, globals->labelNum + 1, sizeof(int));
+	if (newModules)
+	{
+		lnk->entryModules = newModules;
+	}
+	if (!newLabelArr || !newModules)
+	{
+		return FALSE;
+	}
+
+	memset(&globals->labelArr[globals->labelNum], 0, sizeof(labelInfo));
+	strcpy(globals->labelArr[globals->labelNum].name, name);
+	globals->labelArr[globals->labelNum].address = address;
+	lnk->entryModules[globals->labelNum] = moduleId;
+	if (!addLabelToIndex(globals, globals->labelNum))
+	{
+		return FALSE;
+	}
+	globals->labelNum++;
+	return TRUE;
+}
+
+/* Adds the entry labels of a module to the global labels. Returns FALSE if a label is defined twice or there isn't enough memory. */
+bool addModuleEntries(linker *lnk, int moduleId)
+{
+	const linkModule *module = &lnk->modules[moduleId];
+	const objectSymbol *symbols = (const objectSymbol *)((const char *)module->header + module->header->entriesOffset);
+	labelInfo *label;
+	const char *name;
+	unsigned int i;
+	bool succeeded = TRUE;
+
+	for (i = 0; i < module->header->numOfEntries; i++)
+	{
+		name = getSymbolName(module, &symbols[i]);
+		if (strlen(name) > MAX_LABEL_LENGTH)
+		{
+			appendFormat(&lnk->report, "[Error] \"%s\": The entry label \"%s\" is too long.\n", module->fileName, name);
+			succeeded = FALSE;
+		}
+		else if ((label = getLabel(&lnk->globals, (char *)name)) != NULL)
+		{
+			appendFormat(&lnk->report, "[Error] \"%s\": The entry label \"%s\" is already defined in \"%s\".\n",
+				module->fileName, name, lnk->modules[lnk->entryModules[label - lnk->globals.labelArr]].fileName);
+			succeeded = FALSE;
+		}
+		else if (!addGlobalLabel(lnk, name, getImageAddress(module, symbols[i].address), moduleId))
+		{
+			appendFormat(&lnk->report, "[Error] Not enough memory - malloc falied.\n");
+			return FALSE;
+		}
+	}
+
+	return succeeded;
+}
+
+/* Puts in lnk->wordModes the operand mode of each code word of a module, by decoding its instructions. */
+/* Returns FALSE if the code isn't a sequence of legal instructions (or there isn't enough memory). */
+bool getWordModes(linker *lnk, const linkModule *module, const unsigned short *words)
+{
+	signed char *newWordModes;
+	int address, word, opcode, numOfWords;
+
+	newWordModes = (signed char *)reserveArray(lnk->wordModes, &lnk->wordModesCapacity, module->header->IC + 1, sizeof(signed char));
+	if (!newWordModes)
+	{
+		appendFormat(&lnk->report, "[Error] Not enough memory - malloc falied.\n");
+		return FALSE;
+	}
+	lnk->wordModes = newWordModes;
+
+	for (address = 0; address < module->header->IC; address += numOfWords)
+	{
+		word = words[address];
+		opcode = (word >> (ERA_BITS + 4)) & 0xF;
+		lnk->wordModes[address] = INVALID;
+
+		/* Two register operands share one word */
+		numOfWords = 1 + g_cmdArr[opcode].numOfParams;
+		if (g_cmdArr[opcode].numOfParams == 2 && ((word >> ERA_BITS) & 0xF) == ((REGISTER << 2) | REGISTER))
+		{
+			numOfWords = 2;
+		}
+		if ((word & ((1 << ERA_BITS) - 1)) != ABSOLUTE || address + numOfWords > module->header->IC)
+		{
+			appendFormat(&lnk->report, "[Error] \"%s\": The code word at %d isn't a legal instruction.\n", module->fileName, FIRST_ADDRESS + address);
+			return FALSE;
+		}
+
+		if (numOfWords == 2 && g_cmdArr[opcode].numOfParams == 2)
+		{
+			lnk->wordModes[address + 1] = REGISTER;
+		}
+		else if (numOfWords == 3)
+		{
+			lnk->wordModes[address + 1] = (signed char)((word >> (ERA_BITS + 2)) & 3);
+			lnk->wordModes[address + 2] = (signed char)((word >> ERA_BITS) & 3);
+		}
+		else if (numOfWords == 2)
+		{
+			lnk->wordModes[address + 1] = (signed char)((word >> ERA_BITS) & 3);
+		}
+	}
+
+	return TRUE;
+}
+
+/* Puts a relocatable word that holds an address of the image in the code word at 'index' of the module. */
+/* Returns FALSE (and reports it) if the address doesn't fit in the operand bits of the word. */
+bool setAddressWord(linker *lnk, const linkModule *module, int index, int address)
+{
+	if (address > MAX_OPERAND_ADDRESS)
+	{
+		appendFormat(&lnk->report, "[Error] \"%s\": The word at %d needs the address %d, but only addresses up to %d fit in an operand.\n",
+			module->fileName, FIRST_ADDRESS + index, address, MAX_OPERAND_ADDRESS);
+		return FALSE;
+	}
+
+	lnk->memory[module->codeBase - FIRST_ADDRESS + index] = ((address << ERA_BITS) | RELOCATABLE) & WORD_MASK;
+	return TRUE;
+}
+
+/* Copies the words of a module into the image, moves its relocatable words, and patches its extern words. */
+/* Returns FALSE if an extern label isn't an entry label of any module, or an address doesn't fit in its word. */
+bool linkModuleWords(linker *lnk, int moduleId)
+{
+	const linkModule *module = &lnk->modules[moduleId];
+	const objectHeader *header = module->header;
+	const unsigned short *words = (const unsigned short *)((const char *)header + header->wordsOffset);
+	const unsigned short *relocations = (const unsigned short *)((const char *)header + header->relocationsOffset);
+	const objectSymbol *externs = (const objectSymbol *)((const char *)header + header->externsOffset);
+	int *code = lnk->memory + (module->codeBase - FIRST_ADDRESS);
+	int *data = lnk->memory + (module->dataBase - FIRST_ADDRESS);
+	int index;
+	labelInfo *label;
+	const char *name;
+	unsigned int i;
+	bool succeeded = TRUE;
+
+	for (i = 0; i < header->IC; i++)
+	{
+		code[i] = words[i];
+	}
+	for (i = 0; i < header->DC; i++)
+	{
+		data[i] = words[header->IC + i];
+	}
+
+	if (!getWordModes(lnk, module, words))
+	{
+		return FALSE;
+	}
+
+	/* Each relocatable word of a direct operand holds an address in the module */
+	/* (the assembler leaves the words of the struct operands at 0, so they aren't moved) */
+	for (i = 0; i < header->numOfRelocations; i++)
+	{
+		index = relocations[i];
+		if (lnk->wordModes[index] == LABEL)
+		{
+			succeeded = setAddressWord(lnk, module, index, getImageAddress(module, code[index] >> ERA_BITS)) && succeeded;
+		}
+		else if (lnk->wordModes[index] != STRUCT)
+		{
+			appendFormat(&lnk->report, "[Error] \"%s\": The relocatable word at %d isn't an address operand.\n", module->fileName, FIRST_ADDRESS + index);
+			succeeded = FALSE;
+		}
+	}
+
+	/* Each extern word gets the address of the entry label with the same name */
+	for (i = 0; i < header->numOfExterns; i++)
+	{
+		name = getSymbolName(module, &externs[i]);
+		index = externs[i].address - FIRST_ADDRESS;
+		if (index < 0 || index >= header->IC || (code[index] & ((1 << ERA_BITS) - 1)) != EXTENAL
+			|| (lnk->wordModes[index] != LABEL && lnk->wordModes[index] != STRUCT))
+		{
+			appendFormat(&lnk->report, "[Error] \"%s\": The extern label \"%s\" isn't used by a legal word.\n", module->fileName, name);
+			succeeded = FALSE;
+			continue;
+		}
+
+		label = getLabel(&lnk->globals, (char *)name);
+		if (!label)
+		{
+			appendFormat(&lnk->report, "[Error] \"%s\": The extern label \"%s\" isn't an entry label of any module.\n", module->fileName, name);
+			succeeded = FALSE;
+			continue;
+		}
+
+		succeeded = setAddressWord(lnk, module, index, label->address) && succeeded;
+	}
+
+	return succeeded;
+}
+
+/* Links the loaded modules into lnk->memory. Returns if it succeeded. */
+bool linkModules(linker *lnk)
+{
+	bool succeeded = TRUE;
+	int i;
+
+	if (!placeModules(lnk))
+	{
+		return FALSE;
+	}
+
+	/* All the entry labels are known before the extern words are patched */
+	for (i = 0; i < lnk->numOfModules; i++)
+	{
+		succeeded = addModuleEntries(lnk, i) && succeeded;
+	}
+	if (!succeeded)
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < lnk->numOfModules; i++)
+	{
+		succeeded = linkModuleWords(lnk, i) && succeeded;
+	}
+	return succeeded;
+}
+
+/* Writes the image to the .ob file of outName (and to its .obj file too if needed). Returns if it succeeded. */
+bool writeImage(linker *lnk, char *outName, bool binaryOutput)
+{
+	textBuffer object = { 0 }, empty = { 0 }, binary = { 0 };
+	bool succeeded = TRUE;
+
+	appendObjectText(&object, lnk->memory, lnk->IC, lnk->DC);
+	writeFile(outName, ".ob", &object, &lnk->report);
+	if (binaryOutput)
+	{
+		succeeded = textToBinaryObject(&object, &empty, &empty, &binary);
+		if (succeeded)
+		{
+			writeFile(outName, ".obj", &binary, &lnk->report);
+		}
+	}
+
+	free(object.data);
+	free(binary.data);
+	return succeeded;
+}
+
+/* Main method. Links the objects of the file names in argv into one image. */
+int main(int argc, char *argv[])
+{
+	textBuffer object = { 0 }, entries = { 0 }, externs = { 0 };
+	linker lnk;
+	char *outName = NULL;
+	bool binaryInput = FALSE, succeeded = TRUE;
+	int i, firstFile;
+
+	/* Read the options */
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (strcmp(argv[i], "-b") == 0)
+		{
+			binaryInput = TRUE;
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			outName = argv[++i];
+		}
+		else
+		{
+			break;
+		}
+	}
+	firstFile = i;
+
+	if (!outName || firstFile >= argc || argv[firstFile][0] == '-')
+	{
+		printf("[Info] Usage: %s [-b] -o output file...\n", argv[0]);
+		printf("[Info] Links file.ob, file.ent and file.ext of each file into output.ob (-b links file.obj files, and writes output.obj too).\n");
+		return 1;
+	}
+
+	memset(&lnk, 0, sizeof(lnk));
+	initContext(&lnk.globals);
+	lnk.numOfModules = argc - firstFile;
+	lnk.modules = (linkModule *)calloc(lnk.numOfModules, sizeof(linkModule));
+	if (!lnk.modules)
+	{
+		printf("[Error] Not enough memory - malloc falied.\n");
+		return 1;
+	}
+
+	/* Load all the modules (so all the errors of the files are reported) */
+	for (i = 0; i < lnk.numOfModules; i++)
+	{
+		lnk.modules[i].fileName = argv[firstFile + i];
+		succeeded = loadModule(&lnk.modules[i], binaryInput, &object, &entries, &externs, &lnk.report) && succeeded;
+	}
+
+	if (succeeded && linkModules(&lnk) && writeImage(&lnk, outName, binaryInput))
+	{
+		appendFormat(&lnk.report, "[Info] Linked %d file%s into \"%s.ob\" (%d code words and %d data words).\n",
+			lnk.numOfModules, (lnk.numOfModules == 1) ? "" : "s", outName, lnk.IC, lnk.DC);
+	}
+	else
+	{
+		appendFormat(&lnk.report, "[Info] The files weren't linked.\n");
+		succeeded = FALSE;
+	}
+	fwrite(lnk.report.data, 1, lnk.report.length, stdout);
+
+	for (i = 0; i < lnk.numOfModules; i++)
+	{
+		releaseModule(&lnk.modules[i]);
+	}
+	free(lnk.modules);
+	free(lnk.entryModules);
+	free(lnk.wordModes);
+	free(lnk.memory);
+	freeContext(&lnk.globals);
+	free(lnk.report.data);
+	free(object.data);
+	free(entries.data);
+	free(externs.data);
+	return succeeded ? 0 : 1;
+}
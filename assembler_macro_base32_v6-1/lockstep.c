@@ -0,0 +1,519 @@
+/*
+The lockstep simulator.
+Runs one image with many inputs at once: up to SIM_LANES machines (the lanes) run the same instructions
+together. Each word, register and flag is a row of 16 bits lanes, so an instruction is a loop over its rows that
+the compiler vectorizes (this file is compiled with -O3), and it runs in all the lanes at once.
+The instructions are decoded by the simulator (see decodeInstruction) from the image, and shared by the lanes.
+The lanes run together while they are at the same address. When a jump sends them to different addresses,
+the lanes at the lowest address run and the others wait (masked out), until they get to the same address
+again - so the lanes that run a loop more times are waited for at its exit.
+A lane that writes to its code runs on its own from there (on the interpreter), since its instructions aren't
+the shared ones anymore. Each lane stops the way the simulator would stop with its input, after the same steps.
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <string.h>
+
+/* ======== Macros ======== */
+#define LANE_BIT(lane)			(1UL << (lane))
+#define NO_ADDRESS				(MEMORY_SIZE + 3) /* Above the pc of any lane */
+
+/* Writes the value of each lane l to the row of dst, in the lanes of the mask */
+#define LANE_WRITE(dst, value)	for (l = 0; l < SIM_LANES; l++) \
+	{ \
+		(dst)[l] = (unsigned short)((((value) & WORD_MASK) & mask[l]) | ((dst)[l] & ~mask[l])); \
+	}
+
+/* ====== Externs ====== */
+/* Use the commands list from firstRead.c */
+extern const command g_cmdArr[];
+
+/* ====== Methods ====== */
+
+/* Returns the row of an operand of the image: a register, a memory word (and its address in *address), */
+/* or 'imm' with the immediate value in all the lanes. */
+unsigned short *getLaneOperand(lockstepMachine *lockstep, int *value, unsigned short *imm, int *address)
+{
+	int l;
+
+	if (value >= lockstep->image.registers && value < lockstep->image.registers + NUM_OF_REGISTERS)
+	{
+		return lockstep->registers[value - lockstep->image.registers];
+	}
+	if (value >= lockstep->image.memory && value < lockstep->image.memory + MEMORY_SIZE)
+	{
+		*address = (int)(value - lockstep->image.memory);
+		return lockstep->memory[*address];
+	}
+	for (l = 0; l < SIM_LANES; l++)
+	{
+		imm[l] = (unsigned short)*value;
+	}
+	return imm;
+}
+
+/* Returns the shared instruction at an address, decoded from the image the first time it runs. */
+lockstepInstruction *getLockstepInstruction(lockstepMachine *lockstep, int pc)
+{
+	lockstepInstruction *ins;
+	simInstruction *decoded;
+	int address, end, srcAddress;
+
+	if (pc >= MEMORY_SIZE)
+	{
+		return &lockstep->badAddress;
+	}
+	ins = &lockstep->code[pc];
+	if (ins->op != SIM_DECODE)
+	{
+		return ins;
+	}
+
+	decodeInstruction(&lockstep->image, pc);
+	decoded = &lockstep->image.slots[SIM_SLOT(pc)];
+	ins->op = decoded->op;
+	ins->dstAddress = -1;
+	ins->target = -1;
+	ins->writtenLanes = 0;
+	if (ins->op == SIM_BAD_INSTRUCTION)
+	{
+		/* The words of an instruction are up to 3 words */
+		end = pc + 3;
+	}
+	else
+	{
+		if (g_cmdArr[ins->op].numOfParams == 2)
+		{
+			ins->src = getLaneOperand(lockstep, decoded->src, ins->imm[0], &srcAddress);
+		}
+		if (g_cmdArr[ins->op].numOfParams >= 1)
+		{
+			ins->dst = getLaneOperand(lockstep, decoded->dst, ins->imm[1], &ins->dstAddress);
+		}
+		if ((ins->op == SIM_JMP || ins->op == SIM_BNE || ins->op == SIM_JSR) && decoded->dst == &decoded->imm[1])
+		{
+			ins->target = decoded->imm[1];
+		}
+		ins->next = decoded->next;
+		end = ins->next;
+	}
+
+	/* The lanes that wrote to its words don't have this instruction */
+	for (address = pc; address < end && address < MEMORY_SIZE; address++)
+	{
+		lockstep->isCode[address] = TRUE;
+		ins->writtenLanes |= lockstep->writtenLanes[address];
+	}
+	return ins;
+}
+
+/* Stops a lane, with why it stopped, its pc, and the instructions it ran. */
+void stopLane(lockstepMachine *lockstep, int lane, simResult result, int pc, unsigned long steps)
+{
+	lockstep->result[lane] = result;
+	lockstep->pc[lane] = pc;
+	lockstep->steps[lane] = steps;
+	lockstep->running &= ~LANE_BIT(lane);
+	lockstep->active[lane] = 0;
+	lockstep->at[lane] = NO_ADDRESS;
+}
+
+/* Runs a lane on its own on the interpreter from pc (after it ran 'steps' instructions) until it stops. */
+void runLaneAlone(lockstepMachine *lockstep, int lane, int pc, unsigned long steps, unsigned long maxSteps)
+{
+	simMachine *machine = &lockstep->lane;
+	textBuffer none = { 0 };
+	simResult result;
+	int i;
+
+	for (i = 0; i < MEMORY_SIZE; i++)
+	{
+		machine->memory[i] = lockstep->memory[i][lane];
+	}
+	for (i = 0; i < NUM_OF_REGISTERS; i++)
+	{
+		machine->registers[i] = lockstep->registers[i][lane];
+	}
+	machine->zeroFlag = lockstep->notZero[lane] == 0;
+	machine->pc = pc;
+	memcpy(machine->stack, lockstep->stack[lane], sizeof(machine->stack));
+	machine->stackSize = lockstep->stackSize[lane];
+	machine->steps = steps;
+	machine->input = lockstep->input[lane];
+	machine->output = lockstep->output[lane];
+	machine->profile = NULL;
+	invalidateSlots(machine);
+
+	result = runMachine(machine, maxSteps - steps);
+
+	/* The registers and the output are the lane's results */
+	for (i = 0; i < NUM_OF_REGISTERS; i++)
+	{
+		lockstep->registers[i][lane] = (unsigned short)machine->registers[i];
+	}
+	lockstep->notZero[lane] = (unsigned short)!machine->zeroFlag;
+	lockstep->output[lane] = machine->output;
+	machine->output = none;
+	stopLane(lockstep, lane, result, machine->pc, machine->steps);
+}
+
+/* Returns the bits of the lanes in a mask. */
+unsigned long getLaneBits(const unsigned short *mask)
+{
+	unsigned long bits = 0;
+	int l;
+
+	for (l = 0; l < SIM_LANES; l++)
+	{
+		bits |= mask[l] ? LANE_BIT(l) : 0;
+	}
+	return bits;
+}
+
+/* Returns if the running lanes are at the same address, and puts the lowest address of a running lane in *pc. */
+bool gatherLanes(lockstepMachine *lockstep, int *pc)
+{
+	unsigned short low = NO_ADDRESS, high = 0, address;
+	int l;
+
+	for (l = 0; l < SIM_LANES; l++)
+	{
+		low = lockstep->at[l] < low ? lockstep->at[l] : low;
+	}
+	for (l = 0; l < SIM_LANES; l++)
+	{
+		address = lockstep->at[l] & lockstep->active[l];
+		high = address > high ? address : high;
+	}
+	*pc = low;
+	return low == high;
+}
+
+/* Loads an image into the first numOfLanes lanes (up to SIM_LANES), with the input of each lane. */
+/* The output of each lane is cleared (its buffer is kept). */
+void loadLockstep(lockstepMachine *lockstep, const objectHeader *header, const sourceReader *inputs, int numOfLanes)
+{
+	int address, l;
+
+	lockstep->image.profile = NULL;
+	loadMachine(&lockstep->image, header);
+	memset(lockstep->memory, 0, sizeof(lockstep->memory));
+	for (address = FIRST_ADDRESS; address < FIRST_ADDRESS + header->IC + header->DC; address++)
+	{
+		for (l = 0; l < SIM_LANES; l++)
+		{
+			lockstep->memory[address][l] = (unsigned short)lockstep->image.memory[address];
+		}
+	}
+	for (address = 0; address < MEMORY_SIZE; address++)
+	{
+		lockstep->code[address].op = SIM_DECODE;
+	}
+	lockstep->badAddress.op = SIM_BAD_ADDRESS;
+	lockstep->badAddress.writtenLanes = 0;
+	memset(lockstep->registers, 0, sizeof(lockstep->registers));
+	memset(lockstep->writtenLanes, 0, sizeof(lockstep->writtenLanes));
+	memset(lockstep->isCode, 0, sizeof(lockstep->isCode));
+
+	lockstep->running = 0;
+	for (l = 0; l < SIM_LANES; l++)
+	{
+		lockstep->notZero[l] = 1;
+		lockstep->active[l] = l < numOfLanes ? 0xFFFF : 0;
+		lockstep->running |= l < numOfLanes ? LANE_BIT(l) : 0;
+		lockstep->at[l] = l < numOfLanes ? FIRST_ADDRESS : NO_ADDRESS;
+		lockstep->pc[l] = FIRST_ADDRESS;
+		lockstep->stackSize[l] = 0;
+		lockstep->idle[l] = 0;
+		lockstep->waited[l] = 0;
+		lockstep->steps[l] = 0;
+		lockstep->result[l] = SIM_HALTED;
+		lockstep->output[l].length = 0;
+		if (l < numOfLanes)
+		{
+			lockstep->input[l] = inputs[l];
+		}
+	}
+}
+
+/* Runs the lanes from FIRST_ADDRESS until they all stop, each one after up to maxSteps instructions. */
+/* Each lane gets its result, its pc (of the instruction that stopped it) and its steps. */
+void runLockstep(lockstepMachine *lockstep, unsigned long maxSteps)
+{
+	unsigned short stepMask[SIM_LANES], *mask, *notZero = lockstep->notZero, *src, *dst;
+	unsigned short taken, notTaken, here, next;
+	unsigned long maskBits, lanes, stepsDone = 0;
+	lockstepInstruction *ins;
+	bool isTogether = TRUE;
+	unsigned short *at = lockstep->at, *waited = lockstep->waited;
+	int pc = FIRST_ADDRESS, target, l;
+
+	/* The instructions lane l ran */
+	#define LANE_STEPS(l)	(stepsDone - lockstep->idle[l] - waited[l])
+	/* The bits of the lanes of the step are found when they are needed */
+	#define MASK_BITS()	(maskBits ? maskBits : (maskBits = getLaneBits(mask)))
+	/* The lanes that were together at pc go on from their own addresses */
+	#define SPLIT_LANES()	do { if (isTogether) { for (l = 0; l < SIM_LANES; l++) { at[l] = at[l] < NO_ADDRESS ? here : at[l]; } isTogether = FALSE; } } while (0)
+
+	while (lockstep->running)
+	{
+		/* The lanes at the lowest address run, and the others wait */
+		if (!isTogether)
+		{
+			isTogether = gatherLanes(lockstep, &pc);
+		}
+		here = (unsigned short)pc;
+		if (isTogether)
+		{
+			mask = lockstep->active;
+			maskBits = lockstep->running;
+		}
+		else
+		{
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				stepMask[l] = at[l] == here ? 0xFFFF : 0;
+			}
+			mask = stepMask;
+			maskBits = 0;
+		}
+
+		/* A lane that ran maxSteps instructions stops before the next one (none can before maxSteps steps) */
+		lanes = 0;
+		if (stepsDone >= maxSteps)
+		{
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if ((MASK_BITS() & LANE_BIT(l)) && LANE_STEPS(l) >= maxSteps)
+				{
+					stopLane(lockstep, l, SIM_STEP_LIMIT, pc, LANE_STEPS(l));
+					lanes |= LANE_BIT(l);
+				}
+			}
+		}
+		ins = getLockstepInstruction(lockstep, pc);
+		if (!lanes && ins->writtenLanes && (ins->writtenLanes & MASK_BITS()))
+		{
+			lanes = ins->writtenLanes & MASK_BITS();
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if (lanes & LANE_BIT(l))
+				{
+					runLaneAlone(lockstep, l, pc, LANE_STEPS(l), maxSteps);
+				}
+			}
+		}
+		if (!lanes && (ins->op == SIM_BAD_INSTRUCTION || ins->op == SIM_BAD_ADDRESS))
+		{
+			lanes = MASK_BITS();
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if (lanes & LANE_BIT(l))
+				{
+					stopLane(lockstep, l, ins->op == SIM_BAD_ADDRESS ? SIM_ILLEGAL_ADDRESS : SIM_ILLEGAL_INSTRUCTION,
+						pc, LANE_STEPS(l));
+				}
+			}
+		}
+		if (lanes)
+		{
+			/* The lanes that are left choose the step again */
+			continue;
+		}
+
+		/* The step runs in the lanes of the mask */
+		stepsDone++;
+		if (!isTogether)
+		{
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				waited[l] += lockstep->active[l] & ~stepMask[l] & 1;
+			}
+		}
+		if ((stepsDone & 0x7FFF) == 0)
+		{
+			/* The 16 bits counters are added before they can overflow */
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				lockstep->idle[l] += waited[l];
+				waited[l] = 0;
+			}
+		}
+		src = ins->src;
+		dst = ins->dst;
+		target = ins->target;
+		next = (unsigned short)ins->next;
+		switch (ins->op)
+		{
+		case SIM_MOV:
+		case SIM_LEA:
+			LANE_WRITE(dst, src[l]);
+			break;
+
+		case SIM_CMP:
+			LANE_WRITE(notZero, src[l] - dst[l]);
+			break;
+
+		case SIM_ADD:
+			LANE_WRITE(dst, dst[l] + src[l]);
+			break;
+
+		case SIM_SUB:
+			LANE_WRITE(dst, dst[l] - src[l]);
+			break;
+
+		case SIM_NOT:
+			LANE_WRITE(dst, ~dst[l]);
+			break;
+
+		case SIM_CLR:
+			LANE_WRITE(dst, 0);
+			break;
+
+		case SIM_INC:
+			LANE_WRITE(dst, dst[l] + 1);
+			break;
+
+		case SIM_DEC:
+			LANE_WRITE(dst, dst[l] - 1);
+			break;
+
+		case SIM_GET:
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if (mask[l])
+				{
+					dst[l] = (unsigned short)readInputNumber(&lockstep->input[l]);
+				}
+			}
+			break;
+
+		case SIM_PRN:
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if (mask[l])
+				{
+					appendFormat(&lockstep->output[l], "%d\n", SIGN_EXTEND(dst[l], MEMORY_WORD_LENGTH));
+				}
+			}
+			break;
+
+		case SIM_JMP:
+			if (isTogether && target >= 0)
+			{
+				pc = target;
+				continue;
+			}
+			SPLIT_LANES();
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				at[l] = at[l] == here ? (target >= 0 ? (unsigned short)target : dst[l]) : at[l];
+			}
+			continue;
+
+		case SIM_BNE:
+			if (isTogether && target >= 0)
+			{
+				/* The lanes stay together when they all jump or all don't */
+				taken = 0;
+				notTaken = 0;
+				for (l = 0; l < SIM_LANES; l++)
+				{
+					taken |= mask[l] & (notZero[l] ? 0xFFFF : 0);
+					notTaken |= mask[l] & (notZero[l] ? 0 : 0xFFFF);
+				}
+				if (!taken || !notTaken)
+				{
+					pc = taken ? target : ins->next;
+					continue;
+				}
+			}
+			SPLIT_LANES();
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				at[l] = at[l] == here ? (notZero[l] ? (target >= 0 ? (unsigned short)target : dst[l]) : next) : at[l];
+			}
+			continue;
+
+		case SIM_JSR:
+			SPLIT_LANES();
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if (at[l] != here)
+				{
+					continue;
+				}
+				if (lockstep->stackSize[l] == SIM_STACK_SIZE)
+				{
+					/* The jsr isn't a step */
+					stopLane(lockstep, l, SIM_STACK_OVERFLOW, pc, LANE_STEPS(l) - 1);
+					continue;
+				}
+				lockstep->stack[l][lockstep->stackSize[l]++] = ins->next;
+				at[l] = (unsigned short)(target >= 0 ? target : dst[l]);
+			}
+			continue;
+
+		case SIM_RST:
+			SPLIT_LANES();
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if (at[l] != here)
+				{
+					continue;
+				}
+				if (lockstep->stackSize[l] == 0)
+				{
+					stopLane(lockstep, l, SIM_STACK_UNDERFLOW, pc, LANE_STEPS(l) - 1);
+					continue;
+				}
+				at[l] = (unsigned short)lockstep->stack[l][--lockstep->stackSize[l]];
+			}
+			continue;
+
+		default: /* SIM_HLT */
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				if (mask[l])
+				{
+					stopLane(lockstep, l, SIM_HALTED, pc, LANE_STEPS(l));
+				}
+			}
+			continue;
+		}
+
+		if (isTogether)
+		{
+			pc = ins->next;
+		}
+		else
+		{
+			for (l = 0; l < SIM_LANES; l++)
+			{
+				at[l] = at[l] == here ? next : at[l];
+			}
+		}
+
+		/* A lane that wrote to its code runs on its own from the next instruction */
+		if (ins->dstAddress >= 0 && ins->op != SIM_CMP && ins->op != SIM_PRN)
+		{
+			lockstep->writtenLanes[ins->dstAddress] |= MASK_BITS();
+			if (lockstep->isCode[ins->dstAddress])
+			{
+				for (l = 0; l < SIM_LANES; l++)
+				{
+					if (maskBits & LANE_BIT(l))
+					{
+						runLaneAlone(lockstep, l, ins->next, LANE_STEPS(l), maxSteps);
+					}
+				}
+			}
+		}
+	}
+
+	#undef LANE_STEPS
+	#undef MASK_BITS
+	#undef SPLIT_LANES
+}
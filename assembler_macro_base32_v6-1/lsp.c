@@ -0,0 +1,1400 @@
+/*
+The language server.
+Runs the assembler as a language server (the Language Server Protocol - JSON-RPC messages with a Content-Length
+header) on stdin and stdout, so an editor can show the errors and warnings while the source is typed.
+Each line keeps the results of parsing it alone. After an edit only the changed lines are parsed again,
+the labels and the addresses are linked again from the first changed line, and only the lines that
+use a changed label are resolved again.
+The positions in the document are counted in bytes (the sources are ASCII).
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdlib.h>
+#include <ctype.h>
+
+/* ======== Macros ======== */
+#define MAX_JSON_DEPTH		64 /* The max nesting of arrays and objects in a message */
+#define MAX_HEADER_LENGTH	256 /* The max length of a header line of a message */
+#define LSP_ERROR			'1' /* The severity of an error diagnostic */
+#define LSP_WARNING			'2' /* The severity of a warning diagnostic */
+
+/* ======== Data Structures ======== */
+
+/* === JSON === */
+
+typedef enum { JSON_NULL, JSON_FALSE, JSON_TRUE, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT } jsonType;
+
+/* A value of a parsed JSON message, allocated in the arena of the server */
+typedef struct jsonValue
+{
+	jsonType type;
+	const char *str;			/* The decoded string, or the text of a number ('\0' terminated) */
+	size_t length;				/* The length of str */
+	const char *raw;			/* The JSON text of the value (not '\0' terminated) */
+	size_t rawLength;
+	const char *key;			/* The name of the member (in an object) */
+	struct jsonValue *child;	/* The first element or member (in an array or an object) */
+	struct jsonValue *next;		/* The next element or member */
+} jsonValue;
+
+/* === Documents === */
+
+/* How a line was linked with the lines before it */
+typedef enum { LINK_OK, LINK_DUPLICATE_LABEL, LINK_DUPLICATE_EXTERN, LINK_DUPLICATE_ENTRY, LINK_MEMORY_FULL, LINK_SKIPPED } linkResult;
+
+/* How the labels a line uses were resolved */
+typedef enum { RESOLVE_OK, RESOLVE_NO_ENTRY_LABEL, RESOLVE_EXTERN_ENTRY, RESOLVE_NO_LABEL } resolveResult;
+
+/* The label a line defines */
+typedef enum { SYMBOL_NONE, SYMBOL_CODE, SYMBOL_DATA, SYMBOL_EXTERN } symbolKind;
+
+/* A line after the macros expansion, with the results of parsing it alone */
+typedef struct
+{
+	size_t textStart;				/* The offset of the text in doc->expanded */
+	size_t textLength;
+	int sourceLine;					/* The line in the document (the line of the call for a macro body line) */
+
+	/* Parsing (kept until the text of the line changes) */
+	textBuffer diagnostics;			/* The severity, the message and a '\0' of each diagnostic */
+	bool isError;
+	int codeWords;					/* How much the line adds to IC */
+	int dataWords;					/* How much the line adds to DC */
+	char lineLabel[MAX_LABEL_LENGTH + 1];	/* The label before the ':' ("" if there isn't) */
+	symbolKind kind;
+	char symbol[MAX_LABEL_LENGTH + 1];		/* The label of the line, or the name of an extern label */
+	char entry[MAX_LABEL_LENGTH + 1];		/* The name of a .entry label ("" if there isn't) */
+	char refs[2][MAX_LABEL_LENGTH + 1];		/* The label operands */
+	int numOfRefs;
+
+	/* Linking (done again from the first changed line) */
+	linkResult link;
+	int codeEnd;					/* IC after the line */
+	int dataEnd;					/* DC after the line */
+
+	/* Resolving (done again when the line or a label it uses changed) */
+	resolveResult resolve;
+	int failedRef;					/* The operand that isn't a label (for RESOLVE_NO_LABEL) */
+} lspLine;
+
+/* The names in the labels of a context, with the line that defined each name */
+typedef struct
+{
+	assemblerContext names;
+	int *lines;
+	int linesCapacity;
+} lspSymbolTable;
+
+/* An open document */
+typedef struct
+{
+	char *uri;
+	long version;
+	textBuffer text;
+	size_t *lineStarts;				/* The offset of each line in text */
+	int numOfSourceLines;
+	int lineStartsCapacity;
+
+	assemblerContext expansion;		/* Expands the macros (the lines are kept in its expandedSource) */
+	textBuffer expanded;			/* The expanded source of the lines */
+	lspLine *lines;
+	int numOfLines;
+	int linesCapacity;
+
+	lspSymbolTable labels;			/* The labels of the linked lines */
+	lspSymbolTable entries;			/* The .entry names of the linked lines */
+	int fullLine;					/* The line where the memory got full (-1 if it didn't) */
+} lspDocument;
+
+/* A line of the document after the macros expansion (before it's compared with the old lines) */
+typedef struct
+{
+	size_t start;
+	size_t length;
+	int sourceLine;
+} lineSlice;
+
+/* The state of the server */
+typedef struct
+{
+	lspDocument **docs;
+	int numOfDocs;
+	int docsCapacity;
+
+	assemblerContext scratch;		/* Parses one line at a time */
+	assemblerContext changed;		/* The names of the labels that were linked again */
+	lineSlice *slices;
+	int slicesCapacity;
+
+	memoryArena jsonArena;			/* The values of the current message */
+	textBuffer body;				/* The current message */
+	textBuffer out;					/* The message being sent */
+	bool isShutdown;
+} lspServer;
+
+/* ====== JSON ====== */
+
+/* Skips the white spaces in the JSON text. */
+void skipJsonSpaces(sourceReader *reader)
+{
+	while (reader->pos < reader->end && isspace((unsigned char)*reader->pos))
+	{
+		reader->pos++;
+	}
+}
+
+/* Reads 4 hex digits into *value. Returns if they are legal. */
+bool parseHex4(const char *digits, const char *end, unsigned long *value)
+{
+	int i;
+
+	if (end - digits < 4)
+	{
+		return FALSE;
+	}
+
+	*value = 0;
+	for (i = 0; i < 4; i++)
+	{
+		if (!isxdigit((unsigned char)digits[i]))
+		{
+			return FALSE;
+		}
+		*value = *value * 16 + (isdigit((unsigned char)digits[i]) ? digits[i] - '0' : tolower((unsigned char)digits[i]) - 'a' + 10);
+	}
+	return TRUE;
+}
+
+/* Adds the UTF-8 bytes of a code point at 'out'. Returns the next char after them. */
+char *putUtf8(char *out, unsigned long code)
+{
+	if (code < 0x80)
+	{
+		*out++ = (char)code;
+	}
+	else if (code < 0x800)
+	{
+		*out++ = (char)(0xc0 | (code >> 6));
+		*out++ = (char)(0x80 | (code & 0x3f));
+	}
+	else if (code < 0x10000)
+	{
+		*out++ = (char)(0xe0 | (code >> 12));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3f));
+		*out++ = (char)(0x80 | (code & 0x3f));
+	}
+	else
+	{
+		*out++ = (char)(0xf0 | (code >> 18));
+		*out++ = (char)(0x80 | ((code >> 12) & 0x3f));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3f));
+		*out++ = (char)(0x80 | (code & 0x3f));
+	}
+	return out;
+}
+
+/* Reads a JSON string (the reader is after the '"') into the arena. */
+/* Returns the decoded '\0' terminated string and puts its length in *length, or returns NULL if it isn't legal. */
+char *parseJsonString(sourceReader *reader, memoryArena *arena, size_t *length)
+{
+	const char *pos = reader->pos, *endOfStr;
+	char *str, *out;
+	unsigned long code, lowCode;
+
+	/* Find the closing '"' (the decoded string is never longer than the JSON text) */
+	while (pos < reader->end && *pos != '"')
+	{
+		pos += (*pos == '\\') ? 2 : 1;
+	}
+	if (pos >= reader->end)
+	{
+		return NULL;
+	}
+	endOfStr = pos;
+
+	str = (char *)arenaAlloc(arena, endOfStr - reader->pos + 1);
+	if (!str)
+	{
+		return NULL;
+	}
+
+	for (pos = reader->pos, out = str; pos < endOfStr; pos++)
+	{
+		if (*pos != '\\')
+		{
+			*out++ = *pos;
+			continue;
+		}
+
+		switch (*++pos)
+		{
+		case '"': case '\\': case '/':	*out++ = *pos; break;
+		case 'b':	*out++ = '\b'; break;
+		case 'f':	*out++ = '\f'; break;
+		case 'n':	*out++ = '\n'; break;
+		case 'r':	*out++ = '\r'; break;
+		case 't':	*out++ = '\t'; break;
+		case 'u':
+			if (!parseHex4(pos + 1, endOfStr, &code))
+			{
+				return NULL;
+			}
+			pos += 4;
+
+			/* A pair of UTF-16 surrogates is one code point */
+			if (code >= 0xd800 && code < 0xdc00 && endOfStr - pos > 2 && pos[1] == '\\' && pos[2] == 'u'
+				&& parseHex4(pos + 3, endOfStr, &lowCode) && lowCode >= 0xdc00 && lowCode < 0xe000)
+			{
+				code = 0x10000 + ((code - 0xd800) << 10) + (lowCode - 0xdc00);
+				pos += 6;
+			}
+			out = putUtf8(out, code);
+			break;
+		default:
+			return NULL;
+		}
+	}
+
+	*out = '\0';
+	*length = out - str;
+	reader->pos = endOfStr + 1;
+	return str;
+}
+
+/* Parses a JSON value (and the values in it) into the arena. Returns NULL if it isn't legal. */
+jsonValue *parseJsonValue(sourceReader *reader, memoryArena *arena, int depth)
+{
+	jsonValue *value, *item, **nextItem;
+	const char *key = NULL;
+	size_t keyLength;
+	char closing;
+
+	skipJsonSpaces(reader);
+	value = (jsonValue *)arenaAlloc(arena, sizeof(jsonValue));
+	if (!value || reader->pos >= reader->end || depth > MAX_JSON_DEPTH)
+	{
+		return NULL;
+	}
+	memset(value, 0, sizeof(jsonValue));
+	value->raw = reader->pos;
+
+	switch (*reader->pos)
+	{
+	case '"':
+		reader->pos++;
+		value->type = JSON_STRING;
+		value->str = parseJsonString(reader, arena, &value->length);
+		if (!value->str)
+		{
+			return NULL;
+		}
+		break;
+
+	case '[':
+	case '{':
+		value->type = (*reader->pos == '[') ? JSON_ARRAY : JSON_OBJECT;
+		closing = (*reader->pos == '[') ? ']' : '}';
+		reader->pos++;
+		nextItem = &value->child;
+
+		skipJsonSpaces(reader);
+		if (reader->pos < reader->end && *reader->pos == closing)
+		{
+			reader->pos++;
+			break;
+		}
+
+		FOREVER
+		{
+			/* An object member starts with its name */
+			if (value->type == JSON_OBJECT)
+			{
+				skipJsonSpaces(reader);
+				if (reader->pos >= reader->end || *reader->pos != '"')
+				{
+					return NULL;
+				}
+				reader->pos++;
+				key = parseJsonString(reader, arena, &keyLength);
+				skipJsonSpaces(reader);
+				if (!key || reader->pos >= reader->end || *reader->pos != ':')
+				{
+					return NULL;
+				}
+				reader->pos++;
+			}
+
+			item = parseJsonValue(reader, arena, depth + 1);
+			if (!item)
+			{
+				return NULL;
+			}
+			item->key = key;
+			*nextItem = item;
+			nextItem = &item->next;
+
+			skipJsonSpaces(reader);
+			if (reader->pos < reader->end && *reader->pos == ',')
+			{
+				reader->pos++;
+				continue;
+			}
+			if (reader->pos < reader->end && *reader->pos == closing)
+			{
+				reader->pos++;
+				break;
+			}
+			return NULL;
+		}
+		break;
+
+	default:
+		if (reader->end - reader->pos >= 4 && strncmp(reader->pos, "null", 4) == 0)
+		{
+			value->type = JSON_NULL;
+			reader->pos += 4;
+		}
+		else if (reader->end - reader->pos >= 4 && strncmp(reader->pos, "true", 4) == 0)
+		{
+			value->type = JSON_TRUE;
+			reader->pos += 4;
+		}
+		else if (reader->end - reader->pos >= 5 && strncmp(reader->pos, "false", 5) == 0)
+		{
+			value->type = JSON_FALSE;
+			reader->pos += 5;
+		}
+		else
+		{
+			/* A number - its text is kept, and converted when it's used */
+			while (reader->pos < reader->end && strchr("+-.eE0123456789", *reader->pos))
+			{
+				reader->pos++;
+			}
+			if (reader->pos == value->raw)
+			{
+				return NULL;
+			}
+			value->type = JSON_NUMBER;
+			value->length = reader->pos - value->raw;
+			value->str = arenaCopy(arena, value->raw, value->length);
+			if (!value->str)
+			{
+				return NULL;
+			}
+		}
+		break;
+	}
+
+	value->rawLength = reader->pos - value->raw;
+	return value;
+}
+
+/* Returns the member of a JSON object with the given name, or NULL if there isn't (or it isn't an object). */
+jsonValue *getJsonMember(const jsonValue *object, const char *key)
+{
+	jsonValue *member;
+
+	if (!object || object->type != JSON_OBJECT)
+	{
+		return NULL;
+	}
+
+	for (member = object->child; member; member = member->next)
+	{
+		if (strcmp(member->key, key) == 0)
+		{
+			return member;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the value of a JSON number, or defaultValue if it isn't a number. */
+long getJsonNumber(const jsonValue *value, long defaultValue)
+{
+	return (value && value->type == JSON_NUMBER) ? strtol(value->str, NULL, 10) : defaultValue;
+}
+
+/* ====== Messages ====== */
+
+/* Reads the next message from stdin into body. Returns FALSE at the end of the input. */
+bool readMessage(textBuffer *body)
+{
+	char header[MAX_HEADER_LENGTH];
+	long contentLength = -1;
+
+	while (fgets(header, sizeof(header), stdin))
+	{
+		/* The headers end with an empty line */
+		if (strcmp(header, "\r\n") == 0 || strcmp(header, "\n") == 0)
+		{
+			if (contentLength < 0)
+			{
+				continue;
+			}
+
+			body->length = 0;
+			if (!reserveText(body, contentLength + 1) || fread(body->data, 1, contentLength, stdin) != (size_t)contentLength)
+			{
+				return FALSE;
+			}
+			body->length = contentLength;
+			return TRUE;
+		}
+
+		if (strncmp(header, "Content-Length:", 15) == 0)
+		{
+			contentLength = strtol(header + 15, NULL, 10);
+		}
+	}
+
+	return FALSE;
+}
+
+/* Sends the message in server->out (with its header) to stdout, and empties server->out. */
+void sendMessage(lspServer *server)
+{
+	printf("Content-Length: %lu\r\n\r\n", (unsigned long)server->out.length);
+	fwrite(server->out.data, 1, server->out.length, stdout);
+	fflush(stdout);
+	server->out.length = 0;
+}
+
+/* Sends the result of a request. 'result' is a JSON text. */
+void sendResult(lspServer *server, const jsonValue *id, const char *result)
+{
+	appendFormat(&server->out, "{\"jsonrpc\":\"2.0\",\"id\":");
+	appendText(&server->out, id->raw, id->rawLength);
+	appendFormat(&server->out, ",\"result\":%s}", result);
+	sendMessage(server);
+}
+
+/* Sends an error response of a request (a NULL id is sent as null). */
+void sendError(lspServer *server, const jsonValue *id, int code, const char *message)
+{
+	appendFormat(&server->out, "{\"jsonrpc\":\"2.0\",\"id\":");
+	appendText(&server->out, id ? id->raw : "null", id ? id->rawLength : 4);
+	appendFormat(&server->out, ",\"error\":{\"code\":%d,\"message\":", code);
+	appendJsonString(&server->out, message, strlen(message));
+	appendText(&server->out, "}}", 2);
+	sendMessage(server);
+}
+
+/* ====== Symbol Tables ====== */
+
+/* Adds a name defined in 'lineId' line to a symbol table. Returns the new label, or NULL if there isn't enough memory. */
+labelInfo *addSymbol(lspSymbolTable *table, const char *name, int lineId)
+{
+	assemblerContext *names = &table->names;
+	labelInfo *newLabelArr;
+	int *newLines;
+
+	newLabelArr = (labelInfo *)reserveArray(names->labelArr, &names->labelCapacity, names->labelNum + 1, sizeof(labelInfo));
+	if (newLabelArr)
+	{
+		names->labelArr = newLabelArr;
+	}
+	newLines = (int *)reserveArray(table->lines, &table->linesCapacity, names->labelNum + 1, sizeof(int));
+	if (newLines)
+	{
+		table->lines = newLines;
+	}
+	if (!newLabelArr || !newLines)
+	{
+		return NULL;
+	}
+
+	memset(&names->labelArr[names->labelNum], 0, sizeof(labelInfo));
+	strcpy(names->labelArr[names->labelNum].name, name);
+	table->lines[names->labelNum] = lineId;
+	if (!addLabelToIndex(names, names->labelNum))
+	{
+		return NULL;
+	}
+	return &names->labelArr[names->labelNum++];
+}
+
+/* Adds a name to the changed names (if it isn't there already). Returns if it succeeded. */
+bool addChangedName(assemblerContext *changed, const char *name)
+{
+	labelInfo *newLabelArr;
+
+	if (getLabel(changed, (char *)name))
+	{
+		return TRUE;
+	}
+
+	newLabelArr = (labelInfo *)reserveArray(changed->labelArr, &changed->labelCapacity, changed->labelNum + 1, sizeof(labelInfo));
+	if (!newLabelArr)
+	{
+		return FALSE;
+	}
+	changed->labelArr = newLabelArr;
+
+	memset(&changed->labelArr[changed->labelNum], 0, sizeof(labelInfo));
+	strcpy(changed->labelArr[changed->labelNum].name, name);
+	if (!addLabelToIndex(changed, changed->labelNum))
+	{
+		return FALSE;
+	}
+	changed->labelNum++;
+	return TRUE;
+}
+
+/* Removes the names that were defined from 'firstLine' onwards (the last names of the table). */
+/* Each removed name is added to 'changed' (if it isn't NULL). Returns if it succeeded. */
+bool removeSymbols(lspSymbolTable *table, int firstLine, assemblerContext *changed)
+{
+	assemblerContext *names = &table->names;
+
+	while (names->labelNum > 0 && table->lines[names->labelNum - 1] >= firstLine)
+	{
+		if (changed && !addChangedName(changed, names->labelArr[names->labelNum - 1].name))
+		{
+			return FALSE;
+		}
+		removeLabelFromIndex(names, --names->labelNum);
+	}
+	return TRUE;
+}
+
+/* ====== Documents ====== */
+
+/* Copies a label name (at most MAX_LABEL_LENGTH chars) into 'name'. */
+void copyName(char *name, const char *str)
+{
+	strncpy(name, str, MAX_LABEL_LENGTH);
+	name[MAX_LABEL_LENGTH] = '\0';
+}
+
+/* Keeps a diagnostic of the line being parsed (the onDiagnostic of the scratch context). */
+void addLineDiagnostic(void *arg, int lineNum, bool isWarning, const char *message, size_t length)
+{
+	lspLine *line = (lspLine *)arg;
+	char severity = isWarning ? LSP_WARNING : LSP_ERROR;
+
+	appendText(&line->diagnostics, &severity, 1);
+	appendText(&line->diagnostics, message, length);
+	appendText(&line->diagnostics, "", 1);
+}
+
+/* Parses a line of 'length' chars alone, and keeps the results in 'line'. Returns if it succeeded. */
+/* The labels of the line are checked against the other lines later, when the lines are linked. */
+bool parseDocumentLine(lspServer *server, lspLine *line, const char *lineStr, size_t length)
+{
+	assemblerContext *ctx = &server->scratch;
+	lineInfo *parsed, *newLinesArr;
+
+	resetContext(ctx);
+	newLinesArr = (lineInfo *)reserveArray(ctx->linesArr, &ctx->linesCapacity, 1, sizeof(lineInfo));
+	if (!newLinesArr)
+	{
+		return FALSE;
+	}
+	ctx->linesArr = newLinesArr;
+	parsed = &ctx->linesArr[0];
+
+	line->diagnostics.length = 0;
+	line->lineLabel[0] = '\0';
+	line->kind = SYMBOL_NONE;
+	line->entry[0] = '\0';
+	line->numOfRefs = 0;
+	ctx->diagnosticArg = line;
+
+	if (length > MAX_LINE_LENGTH)
+	{
+		printError(ctx, 1, "Line is too long. Max line length is %d.", MAX_LINE_LENGTH);
+		line->isError = TRUE;
+		line->codeWords = 0;
+		line->dataWords = 0;
+		return TRUE;
+	}
+
+	parseLine(ctx, parsed, lineStr, length, 1);
+	if (!parsed->originalString)
+	{
+		return FALSE;
+	}
+	line->isError = parsed->isError;
+	line->codeWords = ctx->IC;
+	line->dataWords = ctx->DC;
+
+	/* The parser ends the label with a '\0' instead of the ':' */
+	if (parsed->labelId != -1)
+	{
+		copyName(line->lineLabel, parsed->originalString);
+	}
+
+	/* The label of the line stays in labelArr, unless it was replaced by an extern label */
+	if (ctx->labelNum > 0)
+	{
+		line->kind = ctx->labelArr[0].isExtern ? SYMBOL_EXTERN : ctx->labelArr[0].isData ? SYMBOL_DATA : SYMBOL_CODE;
+		copyName(line->symbol, ctx->labelArr[0].name);
+	}
+
+	if (ctx->entryLabelsNum > 0)
+	{
+		copyName(line->entry, parsed->lineStr);
+	}
+
+	/* The label operands are resolved only in a legal command line */
+	if (!parsed->isError && parsed->cmd)
+	{
+		if (parsed->op1.type == LABEL)
+		{
+			copyName(line->refs[line->numOfRefs++], parsed->op1.str);
+		}
+		if (parsed->op2.type == LABEL)
+		{
+			copyName(line->refs[line->numOfRefs++], parsed->op2.str);
+		}
+	}
+
+	return TRUE;
+}
+
+/* Links a line with the lines before it (IC and DC are the counters before the line, and they are updated). */
+/* Returns FALSE if there isn't enough memory. */
+bool linkLine(lspServer *server, lspDocument *doc, int lineId, int *IC, int *DC)
+{
+	lspLine *line = &doc->lines[lineId];
+	labelInfo *label;
+
+	line->link = LINK_OK;
+
+	/* A line with a label that already exists isn't a part of the code */
+	if (line->lineLabel[0] && getLabel(&doc->labels.names, line->lineLabel))
+	{
+		line->link = LINK_DUPLICATE_LABEL;
+	}
+	else if (line->kind == SYMBOL_EXTERN && getLabel(&doc->labels.names, line->symbol))
+	{
+		line->link = LINK_DUPLICATE_EXTERN;
+	}
+	else if (line->kind != SYMBOL_NONE)
+	{
+		label = addSymbol(&doc->labels, line->symbol, lineId);
+		if (!label || !addChangedName(&server->changed, line->symbol))
+		{
+			return FALSE;
+		}
+		label->isExtern = (line->kind == SYMBOL_EXTERN);
+		label->isData = (line->kind == SYMBOL_DATA);
+		label->address = (line->kind == SYMBOL_CODE) ? FIRST_ADDRESS + *IC : (line->kind == SYMBOL_DATA) ? FIRST_ADDRESS + *DC : 0;
+	}
+
+	if (line->entry[0] && line->link == LINK_OK)
+	{
+		if (getLabel(&doc->entries.names, line->entry))
+		{
+			line->link = LINK_DUPLICATE_ENTRY;
+		}
+		else if (!addSymbol(&doc->entries, line->entry, lineId))
+		{
+			return FALSE;
+		}
+	}
+
+	if (line->link != LINK_DUPLICATE_LABEL)
+	{
+		*IC += line->codeWords;
+		*DC += line->dataWords;
+	}
+	line->codeEnd = *IC;
+	line->dataEnd = *DC;
+
+	/* The lines after the memory got full aren't read */
+	if (FIRST_ADDRESS + *IC + *DC > MEMORY_SIZE)
+	{
+		line->link = LINK_MEMORY_FULL;
+		doc->fullLine = lineId;
+	}
+	return TRUE;
+}
+
+/* Links the lines from 'firstLine' onwards again (the lines before it are linked already). */
+/* Returns FALSE if there isn't enough memory. */
+bool linkDocument(lspServer *server, lspDocument *doc, int firstLine)
+{
+	int IC = firstLine ? doc->lines[firstLine - 1].codeEnd : 0;
+	int DC = firstLine ? doc->lines[firstLine - 1].dataEnd : 0;
+	int i;
+
+	if (!removeSymbols(&doc->labels, firstLine, &server->changed) || !removeSymbols(&doc->entries, firstLine, NULL))
+	{
+		return FALSE;
+	}
+
+	doc->fullLine = -1;
+	for (i = firstLine; i < doc->numOfLines; i++)
+	{
+		if (doc->fullLine != -1)
+		{
+			doc->lines[i].link = LINK_SKIPPED;
+		}
+		else if (!linkLine(server, doc, i, &IC, &DC))
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* Resolves the labels a line uses (like the second read does). */
+void resolveLine(lspDocument *doc, lspLine *line)
+{
+	labelInfo *label;
+	int i;
+
+	line->resolve = RESOLVE_OK;
+	if (line->link == LINK_SKIPPED || line->link == LINK_DUPLICATE_LABEL)
+	{
+		return;
+	}
+
+	if (line->entry[0] && line->link != LINK_DUPLICATE_ENTRY)
+	{
+		label = getLabel(&doc->labels.names, line->entry);
+		line->resolve = !label ? RESOLVE_NO_ENTRY_LABEL : label->isExtern ? RESOLVE_EXTERN_ENTRY : RESOLVE_OK;
+		return;
+	}
+
+	/* Stop at the first operand that isn't a label */
+	for (i = 0; i < line->numOfRefs; i++)
+	{
+		if (!getLabel(&doc->labels.names, line->refs[i]))
+		{
+			line->resolve = RESOLVE_NO_LABEL;
+			line->failedRef = i;
+			return;
+		}
+	}
+}
+
+/* Returns if a line uses a label that was linked again. */
+bool usesChangedName(lspServer *server, lspLine *line)
+{
+	int i;
+
+	if (line->entry[0] && getLabel(&server->changed, line->entry))
+	{
+		return TRUE;
+	}
+	for (i = 0; i < line->numOfRefs; i++)
+	{
+		if (getLabel(&server->changed, line->refs[i]))
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Finds the offset of each line in the text of a document. Returns if it succeeded. */
+bool findLineStarts(lspDocument *doc)
+{
+	const char *pos = doc->text.data, *end = doc->text.data + doc->text.length;
+	size_t *newLineStarts;
+
+	doc->numOfSourceLines = 0;
+	FOREVER
+	{
+		newLineStarts = (size_t *)reserveArray(doc->lineStarts, &doc->lineStartsCapacity, doc->numOfSourceLines + 1, sizeof(size_t));
+		if (!newLineStarts)
+		{
+			return FALSE;
+		}
+		doc->lineStarts = newLineStarts;
+		doc->lineStarts[doc->numOfSourceLines++] = pos - doc->text.data;
+
+		pos = (pos < end) ? memchr(pos, '\n', end - pos) : NULL;
+		if (!pos)
+		{
+			return TRUE;
+		}
+		pos++;
+	}
+}
+
+/* Returns the line of the char at 'offset' in the text of a document. */
+int getSourceLine(lspDocument *doc, size_t offset)
+{
+	int low = 0, high = doc->numOfSourceLines - 1, middle;
+
+	/* The last line that starts before the offset */
+	while (low < high)
+	{
+		middle = (low + high + 1) / 2;
+		if (doc->lineStarts[middle] <= offset)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+	return low;
+}
+
+/* Returns the length of a line of a document (without the '\n', or the "\r\n"). */
+size_t getSourceLineLength(lspDocument *doc, int sourceLine)
+{
+	size_t end = (sourceLine + 1 < doc->numOfSourceLines) ? doc->lineStarts[sourceLine + 1] - 1 : doc->text.length;
+
+	if (end > doc->lineStarts[sourceLine] && doc->text.data[end - 1] == '\r')
+	{
+		end--;
+	}
+	return end - doc->lineStarts[sourceLine];
+}
+
+/* Returns the offset in the text of a document of an LSP position ({ line, character }). */
+size_t getPositionOffset(lspDocument *doc, const jsonValue *position)
+{
+	long line = getJsonNumber(getJsonMember(position, "line"), 0);
+	long character = getJsonNumber(getJsonMember(position, "character"), 0);
+	size_t length;
+
+	if (line < 0)
+	{
+		return 0;
+	}
+	if (line >= doc->numOfSourceLines)
+	{
+		return doc->text.length;
+	}
+
+	length = getSourceLineLength(doc, (int)line);
+	return doc->lineStarts[line] + ((character < 0) ? 0 : ((size_t)character < length) ? (size_t)character : length);
+}
+
+/* Expands the macros of a document into server->slices (the text is in doc->expansion.expandedSource). */
+/* Returns the number of lines, or -1 if there isn't enough memory. */
+int expandDocument(lspServer *server, lspDocument *doc)
+{
+	macroExpander expander;
+	const char *lineStr;
+	size_t length, offset = 0, position;
+	int numOfLines = 0;
+	lineSlice *newSlices;
+
+	resetContext(&doc->expansion);
+	doc->expansion.keepExpandedSource = TRUE;
+	initMacroExpander(&expander, doc->text.data, doc->text.length);
+
+	while ((lineStr = nextExpandedLine(&doc->expansion, &expander, &length)) != NULL)
+	{
+		newSlices = (lineSlice *)reserveArray(server->slices, &server->slicesCapacity, numOfLines + 1, sizeof(lineSlice));
+		if (!newSlices)
+		{
+			return -1;
+		}
+		server->slices = newSlices;
+
+		/* A line of a macro body is shown on the line of the macro call (the last line that was read) */
+		if (lineStr >= doc->text.data && lineStr < doc->text.data + doc->text.length)
+		{
+			position = lineStr - doc->text.data;
+		}
+		else
+		{
+			position = expander.reader.pos - 1 - doc->text.data;
+		}
+
+		/* Each line is added to the expanded source with a '\n' after it */
+		server->slices[numOfLines].start = offset;
+		server->slices[numOfLines].length = length;
+		server->slices[numOfLines].sourceLine = getSourceLine(doc, position);
+		offset += length + 1;
+		numOfLines++;
+	}
+
+	return (doc->expansion.expandedSource.length == offset) ? numOfLines : -1;
+}
+
+/* Updates the lines of a document after its text changed. Returns FALSE if there isn't enough memory. */
+/* The macros are expanded again, and the new lines are compared with the old ones: only the lines between */
+/* the same first lines and the same last lines are parsed. */
+bool updateDocument(lspServer *server, lspDocument *doc)
+{
+	int numOfLines, oldNumOfLines = doc->numOfLines, prefix = 0, suffix = 0, firstLine, i;
+	lspLine *newLines;
+	lineSlice *slice;
+	textBuffer oldExpanded;
+
+	if (!findLineStarts(doc) || (numOfLines = expandDocument(server, doc)) == -1)
+	{
+		return FALSE;
+	}
+
+	/* Compare the new lines with the old ones (the old text is still in doc->expanded) */
+	while (prefix < oldNumOfLines && prefix < numOfLines
+		&& doc->lines[prefix].textLength == server->slices[prefix].length
+		&& memcmp(doc->expanded.data + doc->lines[prefix].textStart, doc->expansion.expandedSource.data + server->slices[prefix].start, server->slices[prefix].length) == 0)
+	{
+		prefix++;
+	}
+	while (suffix < oldNumOfLines - prefix && suffix < numOfLines - prefix
+		&& doc->lines[oldNumOfLines - 1 - suffix].textLength == server->slices[numOfLines - 1 - suffix].length
+		&& memcmp(doc->expanded.data + doc->lines[oldNumOfLines - 1 - suffix].textStart, doc->expansion.expandedSource.data + server->slices[numOfLines - 1 - suffix].start, server->slices[numOfLines - 1 - suffix].length) == 0)
+	{
+		suffix++;
+	}
+
+	/* Replace the changed lines with new ones, and move the same last lines after them */
+	for (i = prefix; i < oldNumOfLines - suffix; i++)
+	{
+		free(doc->lines[i].diagnostics.data);
+	}
+	newLines = (lspLine *)reserveArray(doc->lines, &doc->linesCapacity, numOfLines > oldNumOfLines ? numOfLines : oldNumOfLines, sizeof(lspLine));
+	if (!newLines)
+	{
+		memmove(&doc->lines[prefix], &doc->lines[oldNumOfLines - suffix], suffix * sizeof(lspLine));
+		doc->numOfLines = prefix + suffix;
+		return FALSE;
+	}
+	doc->lines = newLines;
+	memmove(&doc->lines[numOfLines - suffix], &doc->lines[oldNumOfLines - suffix], suffix * sizeof(lspLine));
+	memset(&doc->lines[prefix], 0, (numOfLines - suffix - prefix) * sizeof(lspLine));
+	doc->numOfLines = numOfLines;
+
+	/* Keep the new expanded source (the old buffer is reused by the next expansion) */
+	oldExpanded = doc->expanded;
+	doc->expanded = doc->expansion.expandedSource;
+	doc->expansion.expandedSource = oldExpanded;
+
+	for (i = 0; i < numOfLines; i++)
+	{
+		slice = &server->slices[i];
+		doc->lines[i].textStart = slice->start;
+		doc->lines[i].textLength = slice->length;
+		doc->lines[i].sourceLine = slice->sourceLine;
+	}
+
+	/* Parse only the changed lines */
+	for (i = prefix; i < numOfLines - suffix; i++)
+	{
+		if (!parseDocumentLine(server, &doc->lines[i], doc->expanded.data + doc->lines[i].textStart, doc->lines[i].textLength))
+		{
+			return FALSE;
+		}
+	}
+
+	/* Link again from the first changed line (or from where the memory got full, the lines after it weren't linked) */
+	firstLine = (doc->fullLine != -1 && doc->fullLine < prefix) ? doc->fullLine : prefix;
+	resetContext(&server->changed);
+	if (!linkDocument(server, doc, firstLine))
+	{
+		return FALSE;
+	}
+
+	/* Resolve the linked lines, and the lines before them that use a label that was linked again */
+	for (i = server->changed.labelNum ? 0 : firstLine; i < numOfLines; i++)
+	{
+		if (i >= firstLine || usesChangedName(server, &doc->lines[i]))
+		{
+			resolveLine(doc, &doc->lines[i]);
+		}
+	}
+
+	return TRUE;
+}
+
+/* Empties a document (all its lines are parsed again on the next update). */
+void clearDocument(lspDocument *doc)
+{
+	int i;
+
+	for (i = 0; i < doc->numOfLines; i++)
+	{
+		free(doc->lines[i].diagnostics.data);
+	}
+	doc->numOfLines = 0;
+	doc->expanded.length = 0;
+	resetContext(&doc->labels.names);
+	resetContext(&doc->entries.names);
+	doc->fullLine = -1;
+}
+
+/* Frees a document and all the memory it holds. */
+void freeDocument(lspDocument *doc)
+{
+	clearDocument(doc);
+	free(doc->uri);
+	free(doc->text.data);
+	free(doc->lineStarts);
+	freeContext(&doc->expansion);
+	free(doc->expanded.data);
+	free(doc->lines);
+	freeContext(&doc->labels.names);
+	free(doc->labels.lines);
+	freeContext(&doc->entries.names);
+	free(doc->entries.lines);
+	free(doc);
+}
+
+/* Returns the open document with the given uri, or NULL if there isn't. */
+lspDocument *getDocument(lspServer *server, const char *uri)
+{
+	int i;
+
+	for (i = 0; i < server->numOfDocs; i++)
+	{
+		if (strcmp(server->docs[i]->uri, uri) == 0)
+		{
+			return server->docs[i];
+		}
+	}
+	return NULL;
+}
+
+/* Adds an empty document with the given uri. Returns it, or NULL if there isn't enough memory. */
+lspDocument *addDocument(lspServer *server, const char *uri)
+{
+	lspDocument *doc, **newDocs;
+
+	newDocs = (lspDocument **)reserveArray(server->docs, &server->docsCapacity, server->numOfDocs + 1, sizeof(lspDocument *));
+	if (!newDocs)
+	{
+		return NULL;
+	}
+	server->docs = newDocs;
+
+	doc = (lspDocument *)calloc(1, sizeof(lspDocument));
+	if (doc)
+	{
+		doc->uri = (char *)malloc(strlen(uri) + 1);
+	}
+	if (!doc || !doc->uri)
+	{
+		free(doc);
+		return NULL;
+	}
+
+	strcpy(doc->uri, uri);
+	initContext(&doc->expansion);
+	initContext(&doc->labels.names);
+	initContext(&doc->entries.names);
+	doc->fullLine = -1;
+	server->docs[server->numOfDocs++] = doc;
+	return doc;
+}
+
+/* ====== Diagnostics ====== */
+
+/* Adds a diagnostic of a line (a JSON object) to server->out. */
+void appendDiagnostic(lspServer *server, lspDocument *doc, lspLine *line, char severity, const char *message, size_t length, bool *isFirst)
+{
+	if (!*isFirst)
+	{
+		appendText(&server->out, ",", 1);
+	}
+	*isFirst = FALSE;
+
+	appendFormat(&server->out, "{\"range\":{\"start\":{\"line\":%d,\"character\":0},\"end\":{\"line\":%d,\"character\":%lu}},",
+		line->sourceLine, line->sourceLine, (unsigned long)getSourceLineLength(doc, line->sourceLine));
+	appendFormat(&server->out, "\"severity\":%c,\"source\":\"assembler\",\"message\":", severity);
+	appendJsonString(&server->out, message, length);
+	appendText(&server->out, "}", 1);
+}
+
+/* Adds the diagnostics of a line (from parsing, linking and resolving it) to server->out. */
+void appendLineDiagnostics(lspServer *server, lspDocument *doc, lspLine *line, bool *isFirst)
+{
+	char message[MAX_MESSAGE_LENGTH];
+	const char *record, *end = line->diagnostics.data + line->diagnostics.length;
+
+	/* The parser doesn't get past a label that already exists */
+	if (line->link == LINK_DUPLICATE_LABEL)
+	{
+		appendDiagnostic(server, doc, line, LSP_ERROR, "Label already exists.", strlen("Label already exists."), isFirst);
+		return;
+	}
+
+	for (record = line->diagnostics.data; record && record < end; record += strlen(record + 1) + 2)
+	{
+		appendDiagnostic(server, doc, line, *record, record + 1, strlen(record + 1), isFirst);
+	}
+
+	message[0] = '\0';
+	switch (line->link)
+	{
+	case LINK_DUPLICATE_EXTERN:	strcpy(message, "Label already exists."); break;
+	case LINK_DUPLICATE_ENTRY:	strcpy(message, "Label already defined as an entry label."); break;
+	case LINK_MEMORY_FULL:		sprintf(message, "Too much data and code. Max memory words is %d.", MEMORY_SIZE - FIRST_ADDRESS); break;
+	default:					break;
+	}
+	if (message[0])
+	{
+		appendDiagnostic(server, doc, line, LSP_ERROR, message, strlen(message), isFirst);
+	}
+
+	message[0] = '\0';
+	switch (line->resolve)
+	{
+	case RESOLVE_NO_ENTRY_LABEL:	sprintf(message, "No such label as \"%s\".", line->entry); break;
+	case RESOLVE_EXTERN_ENTRY:		strcpy(message, "The parameter for .entry can't be an external label."); break;
+	case RESOLVE_NO_LABEL:			sprintf(message, "No such label as \"%s\"", line->refs[line->failedRef]); break;
+	default:						break;
+	}
+	if (message[0])
+	{
+		appendDiagnostic(server, doc, line, LSP_ERROR, message, strlen(message), isFirst);
+	}
+}
+
+/* Sends the diagnostics of a document (an empty list if doc->lines is NULL). */
+void publishDiagnostics(lspServer *server, lspDocument *doc)
+{
+	bool isFirst = TRUE;
+	int i;
+
+	appendFormat(&server->out, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+	appendJsonString(&server->out, doc->uri, strlen(doc->uri));
+	appendFormat(&server->out, ",\"version\":%ld,\"diagnostics\":[", doc->version);
+
+	for (i = 0; i < doc->numOfLines; i++)
+	{
+		if (doc->lines[i].link != LINK_SKIPPED)
+		{
+			appendLineDiagnostics(server, doc, &doc->lines[i], &isFirst);
+		}
+	}
+
+	appendText(&server->out, "]}}", 3);
+	sendMessage(server);
+}
+
+/* ====== Handlers ====== */
+
+/* Updates a document and sends its diagnostics. If there isn't enough memory, the document is emptied. */
+void refreshDocument(lspServer *server, lspDocument *doc)
+{
+	if (!updateDocument(server, doc))
+	{
+		fprintf(stderr, "[Error] Not enough memory - malloc falied.\n");
+		clearDocument(doc);
+	}
+	publishDiagnostics(server, doc);
+}
+
+/* Applies a change of a document ({ range, text }, or only { text } for the whole text). Returns if it succeeded. */
+bool applyChange(lspDocument *doc, const jsonValue *change)
+{
+	const jsonValue *range = getJsonMember(change, "range"), *text = getJsonMember(change, "text");
+	size_t start = 0, end = doc->text.length;
+
+	if (!text || text->type != JSON_STRING)
+	{
+		return TRUE;
+	}
+
+	if (range)
+	{
+		start = getPositionOffset(doc, getJsonMember(range, "start"));
+		end = getPositionOffset(doc, getJsonMember(range, "end"));
+		if (end < start)
+		{
+			end = start;
+		}
+	}
+
+	/* Replace the range with the text (+1 so the text is never NULL) */
+	if (!reserveText(&doc->text, text->length + 1))
+	{
+		return FALSE;
+	}
+	memmove(doc->text.data + start + text->length, doc->text.data + end, doc->text.length - end);
+	memcpy(doc->text.data + start, text->str, text->length);
+	doc->text.length = doc->text.length - (end - start) + text->length;
+
+	/* The positions of the next change are in the changed text */
+	return findLineStarts(doc);
+}
+
+/* Opens a document (textDocument/didOpen) and sends its diagnostics. */
+void openDocument(lspServer *server, const jsonValue *params)
+{
+	const jsonValue *item = getJsonMember(params, "textDocument");
+	const jsonValue *uri = getJsonMember(item, "uri"), *text = getJsonMember(item, "text");
+	lspDocument *doc;
+
+	if (!uri || uri->type != JSON_STRING || !text || text->type != JSON_STRING)
+	{
+		return;
+	}
+
+	/* A document that is opened again starts from the new text */
+	doc = getDocument(server, uri->str);
+	if (doc)
+	{
+		clearDocument(doc);
+	}
+	else if (!(doc = addDocument(server, uri->str)))
+	{
+		fprintf(stderr, "[Error] Not enough memory - malloc falied.\n");
+		return;
+	}
+
+	doc->version = getJsonNumber(getJsonMember(item, "version"), 0);
+	doc->text.length = 0;
+	if (!reserveText(&doc->text, text->length + 1) || !appendText(&doc->text, text->str, text->length))
+	{
+		fprintf(stderr, "[Error] Not enough memory - malloc falied.\n");
+	}
+	refreshDocument(server, doc);
+}
+
+/* Changes a document (textDocument/didChange) and sends its diagnostics. */
+void changeDocument(lspServer *server, const jsonValue *params)
+{
+	const jsonValue *item = getJsonMember(params, "textDocument"), *changes = getJsonMember(params, "contentChanges");
+	const jsonValue *uri = getJsonMember(item, "uri"), *change;
+	lspDocument *doc = (uri && uri->type == JSON_STRING) ? getDocument(server, uri->str) : NULL;
+
+	if (!doc || !changes || changes->type != JSON_ARRAY)
+	{
+		return;
+	}
+
+	doc->version = getJsonNumber(getJsonMember(item, "version"), doc->version);
+	for (change = changes->child; change; change = change->next)
+	{
+		if (!applyChange(doc, change))
+		{
+			fprintf(stderr, "[Error] Not enough memory - malloc falied.\n");
+			break;
+		}
+	}
+	refreshDocument(server, doc);
+}
+
+/* Closes a document (textDocument/didClose), and clears its diagnostics in the editor. */
+void closeDocument(lspServer *server, const jsonValue *params)
+{
+	const jsonValue *uri = getJsonMember(getJsonMember(params, "textDocument"), "uri");
+	int i;
+
+	for (i = 0; uri && uri->type == JSON_STRING && i < server->numOfDocs; i++)
+	{
+		if (strcmp(server->docs[i]->uri, uri->str) == 0)
+		{
+			clearDocument(server->docs[i]);
+			publishDiagnostics(server, server->docs[i]);
+			freeDocument(server->docs[i]);
+			server->docs[i] = server->docs[--server->numOfDocs];
+			return;
+		}
+	}
+}
+
+/* Handles a message from the client. Returns FALSE after the exit notification. */
+bool handleMessage(lspServer *server, const jsonValue *message)
+{
+	const jsonValue *method = getJsonMember(message, "method"), *id = getJsonMember(message, "id");
+	const jsonValue *params = getJsonMember(message, "params");
+
+	if (!method || method->type != JSON_STRING)
+	{
+		/* The server doesn't send requests, so there are no responses to handle */
+		if (id && !getJsonMember(message, "result") && !getJsonMember(message, "error"))
+		{
+			sendError(server, id, -32600, "Invalid request.");
+		}
+		return TRUE;
+	}
+
+	if (strcmp(method->str, "exit") == 0)
+	{
+		return FALSE;
+	}
+
+	/* Notifications (the unknown ones are ignored) */
+	if (!id)
+	{
+		if (strcmp(method->str, "textDocument/didOpen") == 0)
+		{
+			openDocument(server, params);
+		}
+		else if (strcmp(method->str, "textDocument/didChange") == 0)
+		{
+			changeDocument(server, params);
+		}
+		else if (strcmp(method->str, "textDocument/didClose") == 0)
+		{
+			closeDocument(server, params);
+		}
+		return TRUE;
+	}
+
+	/* Requests */
+	if (server->isShutdown)
+	{
+		sendError(server, id, -32600, "The server is shutting down.");
+	}
+	else if (strcmp(method->str, "initialize") == 0)
+	{
+		/* The changes are sent as ranges (2 = incremental) */
+		sendResult(server, id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2}},\"serverInfo\":{\"name\":\"assembler\"}}");
+	}
+	else if (strcmp(method->str, "shutdown") == 0)
+	{
+		server->isShutdown = TRUE;
+		sendResult(server, id, "null");
+	}
+	else
+	{
+		sendError(server, id, -32601, "Method not found.");
+	}
+	return TRUE;
+}
+
+/* Runs the language server on stdin and stdout until the exit notification (or the end of the input). */
+/* Returns the exit code: 0 if the client asked to shut down before the exit, or 1 otherwise. */
+int runLanguageServer()
+{
+	lspServer server;
+	sourceReader reader;
+	jsonValue *message;
+	int i;
+
+	memset(&server, 0, sizeof(server));
+	initContext(&server.scratch);
+	initContext(&server.changed);
+	server.scratch.onDiagnostic = addLineDiagnostic;
+
+	while (readMessage(&server.body))
+	{
+		/* The values of the last message are released at once */
+		arenaRelease(&server.jsonArena);
+		reader.pos = server.body.data;
+		reader.end = server.body.data + server.body.length;
+
+		message = parseJsonValue(&reader, &server.jsonArena, 0);
+		if (!message)
+		{
+			sendError(&server, NULL, -32700, "Parse error.");
+		}
+		else if (!handleMessage(&server, message))
+		{
+			break;
+		}
+	}
+
+	for (i = 0; i < server.numOfDocs; i++)
+	{
+		freeDocument(server.docs[i]);
+	}
+	free(server.docs);
+	freeContext(&server.scratch);
+	freeContext(&server.changed);
+	free(server.slices);
+	arenaFree(&server.jsonArena);
+	free(server.body.data);
+	free(server.out.data);
+	return server.isShutdown ? 0 : 1;
+}
@@ -1,296 +1,349 @@
 /*
-The main file. 
-This file manages the assembling process. 
-It calls the first and second read methods, and then creates the output files.
+The main file.
+This file manages the assembling process of the files in argv.
+It reads each source file, assembles it with the assembler library, and then creates the output files.
+The files can be assembled in parallel on a thread pool (-j N).
+The source after the macros expansion is written to a .am file only with --am (a debug output).
+A binary object (.obj) is written too with --binary.
+With --cache DIR, the outputs of unchanged sources are taken from a cache directory instead of assembling them again.
+With --stats (or --stats-json FILE), the times of the phases and the counters of each file and of the batch are reported.
+With --lsp, it runs as a language server on stdin and stdout instead (see lsp.c).
+With --serve SOCKET, it runs as an assembler server on a Unix domain socket instead, with -j N workers (see server.c).
 */
 
 /* ======== Includes ======== */
 #include "assembler.h"
 
+#include <pthread.h>
 #include <string.h>
-#include <stdarg.h>
 #include <stdlib.h>
-#include <time.h>
-
-/* ====== Global Data Structures ====== */
-/* Labels */
-labelInfo g_labelArr[MAX_LABELS_NUM]; 
-int g_labelNum = 0;
-/* Entry Lines */
-lineInfo *g_entryLines[MAX_LABELS_NUM]; /**/
-int g_entryLabelsNum = 0;
-/* Data */
-int g_dataArr[MAX_DATA_NUM];
 
 /* ====== Methods ====== */
 
-/* Print an error with the line number. */
-void printError(int lineNum, const char *format, ...)
+/* The options from the command line */
+typedef struct
 {
-	va_list args;
-	va_start(args, format);
-	printf("[Error] At line %d: ", lineNum);
-	vprintf(format, args);
-	printf("\n");
-	va_end(args);
+	int numOfWorkers;				/* The number of threads */
+	bool writeExpandedSource;		/* Create the .am files */
+	bool writeBinaryObject;			/* Create the .obj files */
+	char *cacheDir;					/* The outputs cache directory (NULL if there is no cache) */
+	bool runServer;					/* Run the language server instead of assembling files */
+	char *socketPath;				/* Run the assembler server on this socket instead (NULL if not needed) */
+	bool printStats;				/* Add the stats of each file and of the batch to the reports */
+	char *statsFile;				/* Write the stats as JSON to this file (NULL if not needed) */
+} runOptions;
+
+/* Prints the report of a file (and an empty line after it), and empties the report. */
+void printReport(textBuffer *report)
+{
+	appendText(report, "\n", 1);
+	fwrite(report->data, 1, report->length, stdout);
+	fflush(stdout);
+	report->length = 0;
 }
 
-/* Puts in the given buffer a base 32 representation of num. */
-int intToBase32(int num, char *buf)
+/* Adds the [Stats] lines of a file (or of the batch) to the report. */
+void appendStatsText(textBuffer *report, const char *title, assemblerStats *stats)
 {
-    int numMasked; 
-    numMasked = num & 1023;
-	const int base = 32;
-	const char digits[] = "!@#$%^&*<>abcdefghijklmnopqrstuv";
-
-    buf[0] = digits[numMasked / base];
-	buf[1] = digits[numMasked % base];
-
-	return 0;
+	appendFormat(report, "[Stats] %s: macros %.3f ms, first read %.3f ms, second read %.3f ms, outputs %.3f ms.\n",
+		title, stats->expandTime * 1e3, stats->firstReadTime * 1e3, stats->secondReadTime * 1e3, stats->outputTime * 1e3);
+	appendFormat(report, "[Stats] %s: %lu lines, %lu labels, %lu macro calls, IC %lu, DC %lu, %lu symbol lookups.\n",
+		title, stats->lines, stats->labels, stats->macroCalls, stats->codeWords, stats->dataWords, stats->symbolLookups);
+	appendFormat(report, "[Stats] %s: %lu bytes read, %lu bytes written.\n", title, stats->bytesRead, stats->bytesWritten);
 }
 
-void printStrWithZeros(char *str, int strMinWidth)
+/* Adds the fields of the stats to a JSON object in buf (without the braces). */
+void appendStatsJson(textBuffer *buf, assemblerStats *stats)
 {
-	int i, numOfZeros = strMinWidth - strlen(str);
-
-	for (i = 0; i < numOfZeros; i++)
-	{
-		printf("0");
-	}
-	printf("%s", str);
+	appendFormat(buf, "\"expandMs\": %.6f, \"firstReadMs\": %.6f, \"secondReadMs\": %.6f, \"outputMs\": %.6f, ",
+		stats->expandTime * 1e3, stats->firstReadTime * 1e3, stats->secondReadTime * 1e3, stats->outputTime * 1e3);
+	appendFormat(buf, "\"files\": %lu, \"cachedFiles\": %lu, \"lines\": %lu, \"labels\": %lu, \"macroCalls\": %lu, ",
+		stats->files, stats->cachedFiles, stats->lines, stats->labels, stats->macroCalls);
+	appendFormat(buf, "\"codeWords\": %lu, \"dataWords\": %lu, \"symbolLookups\": %lu, \"bytesRead\": %lu, \"bytesWritten\": %lu",
+		stats->codeWords, stats->dataWords, stats->symbolLookups, stats->bytesRead, stats->bytesWritten);
 }
 
-/* Prints a number in base 32 in the file. */
-void fprintfBase32(FILE *file, int num, int strMinWidth)
+/* Adds the stats of one file to the total stats. */
+void addStats(assemblerStats *total, assemblerStats *stats)
 {
-	int numOfZeros, i;
-	/* 2 chars are enough to represent 10 bits in base 32, and the last char is \0. */
-	char buf[3] = { 0 }; 
-
-	intToBase32(num, buf);
-	fprintf(file, "%s", buf);
+	total->expandTime += stats->expandTime;
+	total->firstReadTime += stats->firstReadTime;
+	total->secondReadTime += stats->secondReadTime;
+	total->outputTime += stats->outputTime;
+	total->files += stats->files;
+	total->cachedFiles += stats->cachedFiles;
+	total->lines += stats->lines;
+	total->labels += stats->labels;
+	total->macroCalls += stats->macroCalls;
+	total->codeWords += stats->codeWords;
+	total->dataWords += stats->dataWords;
+	total->symbolLookups += stats->symbolLookups;
+	total->bytesRead += stats->bytesRead;
+	total->bytesWritten += stats->bytesWritten;
 }
 
-/* Creates a file (for writing) from a given name and ending, and returns a pointer to it. */
-FILE *openFile(char *name, char *ending, const char *mode)
+/* The batch of files for the thread pool */
+typedef struct
+{
+	char **fileNames;
+	char *cacheDir;
+	assemblerContext *contexts;		/* One context for each worker, reused for all its files */
+	textBuffer *reports;			/* One report for each worker */
+	assemblerStats *fileStats;		/* The stats of each file (NULL without stats) */
+	bool printStats;				/* Add the stats of each file to its report */
+	pthread_mutex_t outputMutex;	/* Keeps the report of each file as a contiguous block */
+} fileBatch;
+
+/* A job of the thread pool - assembles one file of the batch. */
+void parseFileJob(int jobId, int workerId, void *arg)
 {
-	FILE *file;
-	char *mallocStr = (char *)malloc(strlen(name) + strlen(ending) + 1), *fileName = mallocStr;
-	sprintf(fileName, "%s%s", name, ending);
+	fileBatch *batch = (fileBatch *)arg;
+	assemblerContext *ctx = &batch->contexts[workerId];
+	textBuffer title = { 0 };
 
-	file = fopen(fileName, mode);
-	free(mallocStr);
+	/* Each file has its own stats, so the workers never share them */
+	ctx->stats = batch->fileStats ? &batch->fileStats[jobId] : NULL;
+	parseFile(ctx, batch->fileNames[jobId], batch->cacheDir, &batch->reports[workerId]);
 
-	return file;
+	if (batch->printStats && ctx->stats->files)
+	{
+		if (appendFormat(&title, "\"%s.as\"", batch->fileNames[jobId]))
+		{
+			appendStatsText(&batch->reports[workerId], title.data, ctx->stats);
+		}
+		free(title.data);
+	}
+
+	pthread_mutex_lock(&batch->outputMutex);
+	printReport(&batch->reports[workerId]);
+	pthread_mutex_unlock(&batch->outputMutex);
 }
 
-/* Creates the .obj file, which contains the assembled lines in base 32. */
-void createObjectFile(char *name, int IC, int DC, int *memoryArr)
+/* Prints the total stats of the batch, and writes the stats of all the files as JSON to options->statsFile. */
+void reportStats(fileBatch *batch, int numOfFiles, double wallTime, runOptions *options)
 {
+	textBuffer report = { 0 }, json = { 0 };
+	assemblerStats total;
 	int i;
-	FILE *file;
-	file = openFile(name, ".ob", "w");
 
-	/* Print header*/
-	fprintf(file, "Base32 address  Base32 code\n");
-	fprintf(file, "           m    f");
+	memset(&total, 0, sizeof(total));
+	appendFormat(&json, "{\"files\": [");
+	for (i = 0; i < numOfFiles; i++)
+	{
+		addStats(&total, &batch->fileStats[i]);
+		appendFormat(&json, "%s\n\t{\"name\": ", i ? "," : "");
+		appendJsonString(&json, batch->fileNames[i], strlen(batch->fileNames[i]));
+		appendText(&json, ", ", 2);
+		appendStatsJson(&json, &batch->fileStats[i]);
+		appendText(&json, "}", 1);
+	}
+	appendFormat(&json, "\n],\n\"total\": {\"wallMs\": %.6f, ", wallTime * 1e3);
+	appendStatsJson(&json, &total);
+	appendText(&json, "}}\n", 3);
 
-	/* Print all of memoryArr */
-	for (i = 0; i < IC + DC; i++)
+	if (options->printStats)
 	{
-		fprintf(file, "\n       ");
-		fprintfBase32(file, FIRST_ADDRESS + i, 2);
-		fprintf(file, "\t\t  ");
-		fprintfBase32(file, memoryArr[i], 2);
+		appendStatsText(&report, "Total", &total);
+		appendFormat(&report, "[Stats] Total: %lu files (%lu from the cache) in %.3f ms on %d thread%s.\n",
+			total.files, total.cachedFiles, wallTime * 1e3, options->numOfWorkers, options->numOfWorkers > 1 ? "s" : "");
+	}
+	if (options->statsFile)
+	{
+		writeFile(options->statsFile, "", &json, &report);
+	}
+	if (report.length)
+	{
+		printReport(&report);
 	}
 
-	fclose(file);
+	free(report.data);
+	free(json.data);
 }
 
-/* Creates the .ent file, which contains the addresses for the .entry labels in base 32. */
-void createEntriesFile(char *name)
+/* Assembles the files with the given options. Returns if it succeeded. */
+bool parseFiles(char **fileNames, int numOfFiles, runOptions *options)
 {
-	int i;
-	FILE *file;
-
-	/* Don't create the entries file if there aren't entry lines */
-	if (!g_entryLabelsNum)
+	fileBatch batch;
+	int i, numOfWorkers = options->numOfWorkers;
+	bool needStats = options->printStats || options->statsFile;
+	double start;
+
+	batch.fileNames = fileNames;
+	batch.cacheDir = options->cacheDir;
+	batch.contexts = (assemblerContext *)malloc(numOfWorkers * sizeof(assemblerContext));
+	batch.reports = (textBuffer *)calloc(numOfWorkers, sizeof(textBuffer));
+	batch.fileStats = needStats ? (assemblerStats *)calloc(numOfFiles, sizeof(assemblerStats)) : NULL;
+	batch.printStats = options->printStats;
+	if (!batch.contexts || !batch.reports || (needStats && !batch.fileStats))
 	{
-		return;
+		free(batch.contexts);
+		free(batch.reports);
+		free(batch.fileStats);
+		return FALSE;
 	}
+	pthread_mutex_init(&batch.outputMutex, NULL);
 
-	file = openFile(name, ".ent", "w");
-
-	for (i = 0; i < g_entryLabelsNum; i++)
+	for (i = 0; i < numOfWorkers; i++)
 	{
-		fprintf(file, "%s\t\t", g_entryLines[i]->lineStr);
-		fprintfBase32(file, getLabel(g_entryLines[i]->lineStr)->address, 1);
+		initContext(&batch.contexts[i]);
+		batch.contexts[i].keepExpandedSource = options->writeExpandedSource;
+		batch.contexts[i].createBinaryObject = options->writeBinaryObject;
+	}
 
-		if (i != g_entryLabelsNum - 1)
-		{
-			fprintf(file, "\n");
-		}
+	start = getTime();
+	runJobs(numOfFiles, numOfWorkers, parseFileJob, &batch);
+	if (needStats)
+	{
+		reportStats(&batch, numOfFiles, getTime() - start, options);
 	}
 
-	fclose(file);
+	for (i = 0; i < numOfWorkers; i++)
+	{
+		freeContext(&batch.contexts[i]);
+		free(batch.reports[i].data);
+	}
+	pthread_mutex_destroy(&batch.outputMutex);
+	free(batch.contexts);
+	free(batch.reports);
+	free(batch.fileStats);
+	return TRUE;
 }
 
-/* Creates the .ext file, which contains the addresses for the extern labels operands in base 32. */
-void createExternFile(char *name, lineInfo *linesArr, int linesFound)
+/* Reads the options at the start of argv into *options. */
+/* Returns the index of the first file name, or -1 if an option is illegal. */
+int readOptions(int argc, char *argv[], runOptions *options)
 {
 	int i;
-	labelInfo *label;
-	bool firstPrint = TRUE; /* This bool meant to prevent the creation of the file if there aren't any externs */
-	FILE *file = NULL;
-
-	for (i = 0; i < linesFound; i++)
+	char *endOfNum, *numStr;
+
+	options->numOfWorkers = 1;
+	options->writeExpandedSource = FALSE;
+	options->writeBinaryObject = FALSE;
+	options->cacheDir = NULL;
+	options->runServer = FALSE;
+	options->socketPath = NULL;
+	options->printStats = FALSE;
+	options->statsFile = NULL;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
 	{
-		/* Check if the 1st operand is extern label, and print it. */
-		if (linesArr[i].cmd && linesArr[i].cmd->numOfParams >= 2 && linesArr[i].op1.type == LABEL)
+		if (strcmp(argv[i], "--am") == 0)
+		{
+			options->writeExpandedSource = TRUE;
+		}
+		else if (strcmp(argv[i], "--binary") == 0)
 		{
-			label = getLabel(linesArr[i].op1.str);
-			if (label && label->isExtern)
+			options->writeBinaryObject = TRUE;
+		}
+		else if (strcmp(argv[i], "--stats") == 0)
+		{
+			options->printStats = TRUE;
+		}
+		else if (strcmp(argv[i], "--stats-json") == 0)
+		{
+			if (i + 1 >= argc)
 			{
-				if (firstPrint)
-				{
-					/* Create the file only if there is at least 1 extern */
-					file = openFile(name, ".ext", "w");
-				}
-				else
-				{
-					fprintf(file, "\n");
-				}
-
-				fprintf(file, "%s\t\t", label->name);
-				fprintfBase32(file, linesArr[i].op1.address, 1);
-				firstPrint = FALSE;
+				printf("[Info] \"--stats-json\" must be followed by the file name.\n");
+				return -1;
 			}
+			options->statsFile = argv[++i];
 		}
-
-		/* Check if the 2nd operand is extern label, and print it. */
-		if (linesArr[i].cmd && linesArr[i].cmd->numOfParams >= 1 && linesArr[i].op2.type == LABEL)
+		else if (strcmp(argv[i], "--lsp") == 0)
 		{
-			label = getLabel(linesArr[i].op2.str);
-			if (label && label->isExtern)
+			options->runServer = TRUE;
+		}
+		else if (strcmp(argv[i], "--serve") == 0)
+		{
+			if (i + 1 >= argc)
 			{
-				if (firstPrint)
-				{
-					/* Create the file only if there is at least 1 extern */
-					file = openFile(name, ".ext", "w");
-				}
-				else
-				{
-					fprintf(file, "\n");
-				}
-
-				fprintf(file, "%s\t\t", label->name);
-				fprintfBase32(file, linesArr[i].op2.address, 1);
-				firstPrint = FALSE;
+				printf("[Info] \"--serve\" must be followed by the socket path.\n");
+				return -1;
 			}
+			options->socketPath = argv[++i];
 		}
-	}
+		else if (strcmp(argv[i], "--cache") == 0)
+		{
+			if (i + 1 >= argc)
+			{
+				printf("[Info] \"--cache\" must be followed by the cache directory.\n");
+				return -1;
+			}
+			options->cacheDir = argv[++i];
+			if (!openCache(options->cacheDir))
+			{
+				printf("[Info] Can't use the cache directory \"%s\".\n", options->cacheDir);
+				return -1;
+			}
+		}
+		else if (strncmp(argv[i], "-j", 2) == 0)
+		{
+			/* The number of threads is either in the same arg ("-j4") or in the next one ("-j 4") */
+			numStr = (argv[i][2] != '\0') ? argv[i] + 2 : (i + 1 < argc) ? argv[++i] : "";
+			options->numOfWorkers = strtol(numStr, &endOfNum, 10);
 
-	if (file)
-	{
-		fclose(file);
+			if (*numStr == '\0' || *endOfNum != '\0' || options->numOfWorkers < 0)
+			{
+				printf("[Info] \"-j\" must be followed by the number of threads.\n");
+				return -1;
+			}
+			if (options->numOfWorkers == 0)
+			{
+				options->numOfWorkers = getNumOfCores();
+			}
+		}
+		else
+		{
+			printf("[Info] Unknown option \"%s\".\n", argv[i]);
+			return -1;
+		}
 	}
+
+	return i;
 }
 
-/* Resets all the globals and free all the malloc blocks. */
-void clearData(lineInfo *linesArr, int linesFound, int dataCount)
+/* Main method. Calls the "parsefile" method for each file name in argv. */
+/* Options: "-j N" assembles the files on N threads (N = 0 means a thread for each core), */
+/* "--am" creates the .am files, "--binary" creates the binary objects (.obj files), */
+/* "--cache DIR" keeps the outputs in DIR and reuses them for unchanged sources, */
+/* "--stats" reports the times and the counters of each file and of the batch, "--stats-json FILE" writes them as JSON, */
+/* "--lsp" runs the language server, and "--serve SOCKET" runs the assembler server (the file names aren't needed). */
+int main(int argc, char *argv[])
 {
-	int i;
-
-	/* --- Reset Globals --- */
-
-	/* Reset global labels */
-	for (i = 0; i < g_labelNum; i++)
-	{
-		g_labelArr[i].address = 0;
-		g_labelArr[i].isData = 0;
-		g_labelArr[i].isExtern = 0;
-	}
-	g_labelNum = 0;
+	runOptions options;
+	int firstFile = readOptions(argc, argv, &options);
 
-	/* Reset global entry lines */
-	for (i = 0; i < g_entryLabelsNum; i++)
+	if (firstFile == -1)
 	{
-		g_entryLines[i] = NULL;
+		return 1;
 	}
-	g_entryLabelsNum = 0;
 
-	/* Reset global data */
-	for (i = 0; i < dataCount; i++)
+	if (options.runServer)
 	{
-		g_dataArr[i] = 0;
+		return runLanguageServer();
 	}
 
-	/* Free malloc blocks */
-	for (i = 0; i < linesFound; i++)
+	if (options.socketPath)
 	{
-		free(linesArr[i].originalString);
+		return runAssemblerServer(options.socketPath, options.numOfWorkers, options.cacheDir,
+			options.writeExpandedSource, options.writeBinaryObject);
 	}
-}
-
-/* Parsing a file, and creating the output files. */
-void parseFile(char *fileName)
-{
-    removeMacros(fileName);
- 	FILE *file = openFile(fileName, ".am", "r");
-	lineInfo linesArr[MAX_LINES_NUM];
-	int memoryArr[MAX_DATA_NUM] = { 0 }, IC = 0, DC = 0, numOfErrors = 0, linesFound = 0;
 
-	/* Open File */
-	if (file == NULL)
+	if (argc <= firstFile)
 	{
-		printf("[Info] Can't open the file \"%s.as\".\n", fileName);
-		return;
+		printf("[Info] no file names were observed.\n");
+		return 1;
 	}
-	printf("[Info] Successfully opened the file \"%s.as\".\n", fileName);
 
-	/* First Read */
-	numOfErrors += firstFileRead(file, linesArr, &linesFound, &IC, &DC);
-	/* Second Read */
-	numOfErrors += secondFileRead(memoryArr, linesArr, linesFound, IC, DC);
-
-	/* Create Output Files */
-	if (numOfErrors == 0)
-	{
-		/* Create all the output files */
-		createObjectFile(fileName, IC, DC, memoryArr);
-		createExternFile(fileName, linesArr, linesFound); 
-		createEntriesFile(fileName);
-		printf("[Info] Created output files for the file \"%s.as\".\n", fileName);
-	}
-	else
+	if (options.numOfWorkers > argc - firstFile)
 	{
-		/* print the number of errors. */
-		printf("[Info] A total of %d error%s found throughout \"%s.as\".\n", numOfErrors, (numOfErrors > 1) ? "s were" : " was", fileName);
+		options.numOfWorkers = argc - firstFile;
 	}
 
-	/* Free all malloc pointers, and reset the globals. */
-	clearData(linesArr, linesFound, IC + DC);
-
-	/* Close File */
-	fclose(file);
-}
-
-/* Main method. Calls the "parsefile" method for each file name in argv. */
-int main(int argc, char *argv[])
-{
-	int i;
-
-	if (argc < 2)
+	if (!parseFiles(argv + firstFile, argc - firstFile, &options))
 	{
-		printf("[Info] no file names were observed.\n");
+		printf("[Error] Not enough memory - malloc falied.\n");
 		return 1;
 	}
-		
-	for (i = 1; i < argc; i++)
-	{
-		parseFile(argv[i]);
-		printf("\n");
-	}
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,116 @@
+/*
+The object converter.
+Converts the text object files (.ob, .ent and .ext) of each file name in argv into a binary object (.obj) with -b,
+and a binary object back into the text object files with -t.
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/* ====== Methods ====== */
+
+/* Converts the text object files of a file name into a binary object. Returns if it succeeded. */
+bool convertToBinary(char *fileName, textBuffer *object, textBuffer *entries, textBuffer *externs, textBuffer *binary, textBuffer *report)
+{
+	readTextFile(fileName, ".ob", object);
+	if (object->length == 0)
+	{
+		appendFormat(report, "[Info] Can't open the file \"%s.ob\".\n", fileName);
+		return FALSE;
+	}
+	readTextFile(fileName, ".ent", entries);
+	readTextFile(fileName, ".ext", externs);
+
+	if (!textToBinaryObject(object, entries, externs, binary))
+	{
+		appendFormat(report, "[Error] The object files of \"%s\" aren't legal.\n", fileName);
+		return FALSE;
+	}
+
+	writeFile(fileName, ".obj", binary, report);
+	return TRUE;
+}
+
+/* Converts the binary object of a file name into text object files. Returns if it succeeded. */
+bool convertToText(char *fileName, textBuffer *object, textBuffer *entries, textBuffer *externs, textBuffer *report)
+{
+	const objectHeader *header;
+	const char *content;
+	size_t length;
+	bool isMapped, succeeded = FALSE;
+
+	/* The binary object is used straight from the mapping */
+	content = mapFile(fileName, ".obj", &length, &isMapped);
+	if (content == NULL)
+	{
+		appendFormat(report, "[Info] Can't open the file \"%s.obj\".\n", fileName);
+		return FALSE;
+	}
+
+	header = loadBinaryObject(content, length);
+	if (!header)
+	{
+		appendFormat(report, "[Error] \"%s.obj\" isn't a legal binary object.\n", fileName);
+	}
+	else if (!binaryToTextObject(header, object, entries, externs))
+	{
+		appendFormat(report, "[Error] Not enough memory - malloc falied.\n");
+	}
+	else
+	{
+		/* The .ext and .ent files are created only if they aren't empty, like the assembler does */
+		writeFile(fileName, ".ob", object, report);
+		if (externs->length)
+		{
+			writeFile(fileName, ".ext", externs, report);
+		}
+		if (entries->length)
+		{
+			writeFile(fileName, ".ent", entries, report);
+		}
+		succeeded = TRUE;
+	}
+
+	releaseFile(content, length, isMapped);
+	return succeeded;
+}
+
+/* Main method. Converts each file name in argv in the direction of the first argument. */
+int main(int argc, char *argv[])
+{
+	textBuffer object = { 0 }, entries = { 0 }, externs = { 0 }, binary = { 0 }, report = { 0 };
+	bool toBinary;
+	int i, failed = 0;
+
+	if (argc < 3 || (strcmp(argv[1], "-b") != 0 && strcmp(argv[1], "-t") != 0))
+	{
+		printf("[Info] Usage: %s -b|-t file...\n", argv[0]);
+		printf("[Info] -b converts file.ob, file.ent and file.ext into file.obj, -t converts file.obj back.\n");
+		return 1;
+	}
+	toBinary = (strcmp(argv[1], "-b") == 0);
+
+	for (i = 2; i < argc; i++)
+	{
+		if (toBinary ? !convertToBinary(argv[i], &object, &entries, &externs, &binary, &report) : !convertToText(argv[i], &object, &entries, &externs, &report))
+		{
+			failed++;
+		}
+
+		if (report.length)
+		{
+			fwrite(report.data, 1, report.length, stdout);
+			report.length = 0;
+		}
+	}
+
+	free(object.data);
+	free(entries.data);
+	free(externs.data);
+	free(binary.data);
+	free(report.data);
+	return failed ? 1 : 0;
+}
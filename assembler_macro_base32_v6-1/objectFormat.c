@@ -0,0 +1,293 @@
+/*
+The binary object format.
+A binary object (the .obj file) holds the same content as the text .ob, .ent and .ext files:
+a header with IC and DC, the memory image as 16 bits words, the relocatable words, and the entry and extern tables.
+It can be mapped into memory and used as it is, and converted to and from the text files byte for byte.
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdlib.h>
+
+/* ====== Methods ====== */
+
+/* Returns a pointer to the table at 'offset' in a binary object. */
+const void *getObjectTable(const objectHeader *header, unsigned int offset)
+{
+	return (const char *)header + offset;
+}
+
+/* Parses a .ent or .ext line ("name\t\taddress"). Returns if it's a legal line. */
+bool parseSymbolLine(const char *line, size_t length, const char **name, size_t *nameLength, int *address)
+{
+	const char *addressStr;
+	size_t addressLength;
+
+	*name = getTokenSlice(line, line + length, nameLength);
+	if (!*name)
+	{
+		return FALSE;
+	}
+
+	addressStr = getTokenSlice(*name + *nameLength, line + length, &addressLength);
+	if (!addressStr || getTokenSlice(addressStr + addressLength, line + length, &addressLength))
+	{
+		return FALSE;
+	}
+
+	*address = base32ToInt(addressStr, BASE32_WORD_LENGTH);
+	return addressLength == BASE32_WORD_LENGTH && *address != -1;
+}
+
+/* Adds the symbols of a .ent or .ext file content to the symbols table, and their names to 'names'. */
+/* Returns the number of symbols, or -1 if the content isn't legal or there isn't enough memory. */
+long addSymbols(const textBuffer *text, textBuffer *symbols, textBuffer *names)
+{
+	sourceReader reader;
+	objectSymbol symbol;
+	const char *line, *name;
+	size_t length, nameLength;
+	int address;
+	long numOfSymbols = 0;
+
+	reader.pos = text->data;
+	reader.end = text->data + text->length;
+	while ((line = nextLine(&reader, &length)) != NULL)
+	{
+		if (!parseSymbolLine(line, length, &name, &nameLength, &address))
+		{
+			return -1;
+		}
+
+		symbol.nameOffset = (unsigned int)names->length;
+		symbol.address = (unsigned short)address;
+		symbol.reserved = 0;
+		if (!appendText(symbols, (const char *)&symbol, sizeof(symbol)) || !appendText(names, name, nameLength) || !appendText(names, "", 1))
+		{
+			return -1;
+		}
+		numOfSymbols++;
+	}
+
+	return numOfSymbols;
+}
+
+/* Parses the .ob file content into the words table, and puts the code and data lengths in *IC and *DC. */
+/* The indexes of the relocatable code words are added to the relocations table. Returns if it's a legal content. */
+bool addWords(const textBuffer *object, textBuffer *words, textBuffer *relocations, int *IC, int *DC)
+{
+	sourceReader reader;
+	const char *line, *address, *word;
+	size_t length, addressLength, wordLength;
+	unsigned short value, index;
+	int i;
+
+	reader.pos = object->data;
+	reader.end = object->data + object->length;
+
+	/* The title and the header (IC and DC) */
+	line = nextLine(&reader, &length);
+	if (!line || length + 1 != strlen(OBJECT_TITLE) || strncmp(line, OBJECT_TITLE, length) != 0)
+	{
+		return FALSE;
+	}
+	line = nextLine(&reader, &length);
+	address = line ? getTokenSlice(line, line + length, &addressLength) : NULL;
+	word = address ? getTokenSlice(address + addressLength, line + length, &wordLength) : NULL;
+	if (!word)
+	{
+		return FALSE;
+	}
+	*IC = base32ToInt(address, addressLength);
+	*DC = base32ToInt(word, wordLength);
+	if (*IC == -1 || *DC == -1 || FIRST_ADDRESS + *IC + *DC > MEMORY_SIZE)
+	{
+		return FALSE;
+	}
+
+	/* A line with the address and the value of each word */
+	for (i = 0; i < *IC + *DC; i++)
+	{
+		line = nextLine(&reader, &length);
+		address = line ? getTokenSlice(line, line + length, &addressLength) : NULL;
+		word = address ? getTokenSlice(address + addressLength, line + length, &wordLength) : NULL;
+		if (!word || addressLength != BASE32_WORD_LENGTH || wordLength != BASE32_WORD_LENGTH || base32ToInt(address, addressLength) != FIRST_ADDRESS + i || base32ToInt(word, wordLength) == -1)
+		{
+			return FALSE;
+		}
+
+		value = (unsigned short)base32ToInt(word, wordLength);
+		if (!appendText(words, (const char *)&value, sizeof(value)))
+		{
+			return FALSE;
+		}
+
+		/* A code word with a relocatable ERA holds the address of a label */
+		if (i < *IC && (value & 3) == RELOCATABLE)
+		{
+			index = (unsigned short)i;
+			if (!appendText(relocations, (const char *)&index, sizeof(index)))
+			{
+				return FALSE;
+			}
+		}
+	}
+
+	/* Nothing is allowed after the last word */
+	return nextLine(&reader, &length) == NULL;
+}
+
+/* Adds zero bytes to the end of buf until its length is a multiple of 'alignment'. */
+bool alignText(textBuffer *buf, size_t alignment)
+{
+	static const char zeros[sizeof(unsigned int)] = { 0 };
+
+	return appendText(buf, zeros, (alignment - buf->length % alignment) % alignment);
+}
+
+/* Converts the .ob, .ent and .ext files content into a binary object in 'out' (the old content of out is replaced). */
+/* Returns FALSE if the content isn't legal or there isn't enough memory. */
+bool textToBinaryObject(const textBuffer *object, const textBuffer *entries, const textBuffer *externs, textBuffer *out)
+{
+	textBuffer words = { 0 }, relocations = { 0 }, entrySymbols = { 0 }, externSymbols = { 0 }, names = { 0 };
+	objectHeader header;
+	long numOfEntries, numOfExterns;
+	int IC, DC;
+	bool succeeded = FALSE;
+
+	out->length = 0;
+	if (addWords(object, &words, &relocations, &IC, &DC)
+		&& (numOfEntries = addSymbols(entries, &entrySymbols, &names)) != -1
+		&& (numOfExterns = addSymbols(externs, &externSymbols, &names)) != -1)
+	{
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, OBJECT_MAGIC, sizeof(header.magic));
+		header.byteOrder = OBJECT_BYTE_ORDER;
+		header.version = OBJECT_VERSION;
+		header.firstAddress = FIRST_ADDRESS;
+		header.IC = (unsigned short)IC;
+		header.DC = (unsigned short)DC;
+		header.numOfEntries = (unsigned int)numOfEntries;
+		header.numOfExterns = (unsigned int)numOfExterns;
+		header.numOfRelocations = (unsigned int)(relocations.length / sizeof(unsigned short));
+
+		/* The tables are placed one after the other, each one aligned for the fields of its elements */
+		header.wordsOffset = sizeof(header);
+		header.relocationsOffset = header.wordsOffset + (unsigned int)words.length;
+		header.entriesOffset = header.relocationsOffset + (unsigned int)relocations.length;
+		header.entriesOffset += (sizeof(unsigned int) - header.entriesOffset % sizeof(unsigned int)) % sizeof(unsigned int);
+		header.externsOffset = header.entriesOffset + (unsigned int)entrySymbols.length;
+		header.namesOffset = header.externsOffset + (unsigned int)externSymbols.length;
+		header.namesSize = (unsigned int)names.length;
+
+		succeeded = appendText(out, (const char *)&header, sizeof(header))
+			&& appendText(out, words.data, words.length)
+			&& appendText(out, relocations.data, relocations.length)
+			&& alignText(out, sizeof(unsigned int))
+			&& appendText(out, entrySymbols.data, entrySymbols.length)
+			&& appendText(out, externSymbols.data, externSymbols.length)
+			&& appendText(out, names.data, names.length);
+	}
+
+	free(words.data);
+	free(relocations.data);
+	free(entrySymbols.data);
+	free(externSymbols.data);
+	free(names.data);
+	return succeeded;
+}
+
+/* Returns if the table of 'count' elements of 'elemSize' bytes at 'offset' is inside a binary object of 'length' bytes, */
+/* and the offset is a multiple of 'alignment'. */
+bool isLegalTable(size_t length, unsigned int offset, unsigned int count, size_t elemSize, size_t alignment)
+{
+	return offset % alignment == 0 && offset <= length && count <= (length - offset) / elemSize;
+}
+
+/* Returns if all the names of the symbols table are inside the names table. */
+bool areLegalSymbols(const objectHeader *header, unsigned int offset, unsigned int count)
+{
+	const objectSymbol *symbols = (const objectSymbol *)getObjectTable(header, offset);
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (symbols[i].nameOffset >= header->namesSize)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Checks a binary object of 'length' bytes (mapped into memory, or in any memory aligned like malloc). */
+/* Returns its header, or NULL if it isn't a legal binary object. */
+const objectHeader *loadBinaryObject(const char *data, size_t length)
+{
+	const objectHeader *header = (const objectHeader *)data;
+
+	if (length < sizeof(objectHeader) || memcmp(header->magic, OBJECT_MAGIC, sizeof(header->magic)) != 0
+		|| header->byteOrder != OBJECT_BYTE_ORDER || header->version != OBJECT_VERSION
+		|| header->firstAddress + header->IC + header->DC > MEMORY_SIZE)
+	{
+		return NULL;
+	}
+
+	/* Check that every table is inside the file, and every name is '\0' terminated */
+	if (!isLegalTable(length, header->wordsOffset, header->IC + header->DC, sizeof(unsigned short), sizeof(unsigned short))
+		|| !isLegalTable(length, header->relocationsOffset, header->numOfRelocations, sizeof(unsigned short), sizeof(unsigned short))
+		|| !isLegalTable(length, header->entriesOffset, header->numOfEntries, sizeof(objectSymbol), sizeof(unsigned int))
+		|| !isLegalTable(length, header->externsOffset, header->numOfExterns, sizeof(objectSymbol), sizeof(unsigned int))
+		|| !isLegalTable(length, header->namesOffset, header->namesSize, sizeof(char), sizeof(char))
+		|| (header->namesSize && data[header->namesOffset + header->namesSize - 1] != '\0')
+		|| !areLegalSymbols(header, header->entriesOffset, header->numOfEntries)
+		|| !areLegalSymbols(header, header->externsOffset, header->numOfExterns))
+	{
+		return NULL;
+	}
+
+	return header;
+}
+
+/* Adds the .ent or .ext file content of a symbols table to the end of buf. */
+void appendSymbolsText(const objectHeader *header, unsigned int offset, unsigned int count, textBuffer *buf)
+{
+	const objectSymbol *symbols = (const objectSymbol *)getObjectTable(header, offset);
+	const char *names = (const char *)getObjectTable(header, header->namesOffset);
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+	{
+		appendSymbolLine(buf, names + symbols[i].nameOffset, symbols[i].address);
+	}
+}
+
+/* Converts a binary object (checked by loadBinaryObject) into the .ob, .ent and .ext files content. */
+/* The old content of the buffers is replaced. Returns FALSE if there isn't enough memory. */
+bool binaryToTextObject(const objectHeader *header, textBuffer *object, textBuffer *entries, textBuffer *externs)
+{
+	const unsigned short *words = (const unsigned short *)getObjectTable(header, header->wordsOffset);
+	int i, numOfWords = header->IC + header->DC;
+	int *memory = (int *)malloc((numOfWords ? numOfWords : 1) * sizeof(int));
+
+	if (!memory)
+	{
+		return FALSE;
+	}
+	for (i = 0; i < numOfWords; i++)
+	{
+		memory[i] = words[i];
+	}
+
+	object->length = 0;
+	entries->length = 0;
+	externs->length = 0;
+	appendObjectText(object, memory, header->IC, header->DC);
+	appendSymbolsText(header, header->entriesOffset, header->numOfEntries, entries);
+	appendSymbolsText(header, header->externsOffset, header->numOfExterns, externs);
+
+	free(memory);
+	return TRUE;
+}
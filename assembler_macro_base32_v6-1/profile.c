@@ -0,0 +1,294 @@
+/*
+The profile of a simulator run.
+Reports the counters of a profiled run (see simProfile): a flat profile of the instructions by the times they
+ran, with the words each one fetched (its command word and its operand words, as the second read encodes them)
+and the jumps it took, and the hot loops - the backward jumps, with the instructions run inside them.
+When the source of the image was assembled, the addresses are shown with their labels and their lines in the
+.am source (the lines after the macros expansion).
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdlib.h>
+
+/* ======== Macros ======== */
+#define MAX_HOT_LOOPS			10 /* The loops in the hot loops report */
+#define MAX_SOURCE_LENGTH		40 /* The chars of a source line in the reports */
+
+/* ======== Data Structures ======== */
+
+/* The source of a profiled image */
+typedef struct
+{
+	assemblerContext *ctx;			/* The assembled source (NULL if there isn't) */
+	int lineOf[MEMORY_SIZE];		/* The line of the instruction at each address (0 if it's unknown) */
+	int labelOf[MEMORY_SIZE];		/* The id of the last code label at or before each address (-1 if there isn't) */
+	const char **lineText;			/* The start of each line in the .am source (lineText[0] is the 1st line) */
+	int numOfLines;
+} profileSource;
+
+/* An instruction of the flat profile */
+typedef struct
+{
+	int address;
+	unsigned long runs;
+} profileEntry;
+
+/* A loop of the hot loops report: a backward jump from 'to' to 'from' */
+typedef struct
+{
+	int from;						/* The first address of the loop (the target of the jump) */
+	int to;							/* The address of the jump */
+	unsigned long iterations;		/* The times it jumped back */
+	unsigned long runs;				/* The instructions run from 'from' to 'to' */
+	unsigned long words;			/* The words they fetched */
+} profileLoop;
+
+/* ====== Methods ====== */
+
+/* Maps the addresses of the code to the lines and the labels of the assembled source (if ctx isn't NULL). */
+void initProfileSource(profileSource *source, assemblerContext *ctx)
+{
+	const char *pos, *end;
+	int i, j, address;
+
+	source->ctx = ctx;
+	source->lineText = NULL;
+	source->numOfLines = 0;
+	for (i = 0; i < MEMORY_SIZE; i++)
+	{
+		source->lineOf[i] = 0;
+		source->labelOf[i] = -1;
+	}
+	if (!ctx)
+	{
+		return;
+	}
+
+	/* The first word of each command line and each code label, and then the words after them up to the next one */
+	for (i = 0; i < ctx->linesFound; i++)
+	{
+		address = ctx->linesArr[i].address;
+		if (ctx->linesArr[i].cmd && address >= 0 && address < MEMORY_SIZE)
+		{
+			source->lineOf[address] = ctx->linesArr[i].lineNum;
+		}
+	}
+	for (i = 0; i < ctx->labelNum; i++)
+	{
+		address = ctx->labelArr[i].address;
+		if (!ctx->labelArr[i].isExtern && !ctx->labelArr[i].isData && address >= 0 && address < MEMORY_SIZE)
+		{
+			source->labelOf[address] = i;
+		}
+	}
+	for (i = 1; i < FIRST_ADDRESS + ctx->IC && i < MEMORY_SIZE; i++)
+	{
+		if (source->lineOf[i] == 0)
+		{
+			source->lineOf[i] = source->lineOf[i - 1];
+		}
+		if (source->labelOf[i] == -1)
+		{
+			source->labelOf[i] = source->labelOf[i - 1];
+		}
+	}
+
+	/* The lines of the .am source */
+	end = ctx->expandedSource.data + ctx->expandedSource.length;
+	for (pos = ctx->expandedSource.data, j = 0; pos && pos < end; pos++)
+	{
+		j += *pos == '\n';
+	}
+	source->lineText = (const char **)malloc((j + 1) * sizeof(const char *));
+	if (!source->lineText)
+	{
+		return;
+	}
+	for (pos = ctx->expandedSource.data; pos && pos < end; source->numOfLines++)
+	{
+		source->lineText[source->numOfLines] = pos;
+		while (pos < end && *pos++ != '\n')
+		{
+			/* Skip to the next line */
+		}
+	}
+}
+
+/* Appends the location of an address: its label and the offset from it, and its line. */
+void appendLocation(textBuffer *out, profileSource *source, int address)
+{
+	char location[MAX_LABEL_LENGTH + 32];
+	int labelId = address < MEMORY_SIZE ? source->labelOf[address] : -1;
+
+	if (labelId == -1)
+	{
+		sprintf(location, "%d", address);
+	}
+	else if (source->ctx->labelArr[labelId].address == address)
+	{
+		sprintf(location, "%s", source->ctx->labelArr[labelId].name);
+	}
+	else
+	{
+		sprintf(location, "%s+%d", source->ctx->labelArr[labelId].name, address - source->ctx->labelArr[labelId].address);
+	}
+	if (address < MEMORY_SIZE && source->lineOf[address])
+	{
+		sprintf(location + strlen(location), ":%d", source->lineOf[address]);
+	}
+	appendFormat(out, "%-20s", location);
+}
+
+/* Appends the text of the line of an address in the .am source (trimmed, and cut to MAX_SOURCE_LENGTH chars). */
+void appendSourceLine(textBuffer *out, profileSource *source, int address)
+{
+	const char *text, *end;
+	int line = address < MEMORY_SIZE ? source->lineOf[address] : 0;
+
+	if (line < 1 || line > source->numOfLines)
+	{
+		return;
+	}
+	text = source->lineText[line - 1];
+	end = source->ctx->expandedSource.data + source->ctx->expandedSource.length;
+	while (text < end && (*text == ' ' || *text == '\t'))
+	{
+		text++;
+	}
+	for (end = text; end < source->ctx->expandedSource.data + source->ctx->expandedSource.length
+		&& *end != '\n' && *end != '\r' && end - text < MAX_SOURCE_LENGTH; end++)
+	{
+		/* Find the end of the line */
+	}
+	appendText(out, text, end - text);
+}
+
+/* Orders the entries by their runs (the most first), and then by their addresses. */
+int compareEntries(const void *a, const void *b)
+{
+	const profileEntry *entryA = (const profileEntry *)a, *entryB = (const profileEntry *)b;
+
+	if (entryA->runs != entryB->runs)
+	{
+		return entryA->runs > entryB->runs ? -1 : 1;
+	}
+	return entryA->address - entryB->address;
+}
+
+/* Orders the loops by the instructions run in them (the most first), and then by their addresses. */
+int compareLoops(const void *a, const void *b)
+{
+	const profileLoop *loopA = (const profileLoop *)a, *loopB = (const profileLoop *)b;
+
+	if (loopA->runs != loopB->runs)
+	{
+		return loopA->runs > loopB->runs ? -1 : 1;
+	}
+	return loopA->from - loopB->from;
+}
+
+/* Appends the report of the profile of the last run of a machine (machine->profile) of the image of 'fileName'. */
+/* ctx is the assembled source of the image with its .am source (ctx->keepExpandedSource), or NULL if there isn't. */
+void appendProfile(textBuffer *out, simMachine *machine, char *fileName, assemblerContext *ctx)
+{
+	simProfile *profile = machine->profile;
+	profileSource *source = (profileSource *)malloc(sizeof(profileSource));
+	profileEntry *entries = (profileEntry *)malloc(MEMORY_SIZE * sizeof(profileEntry));
+	profileLoop *loops = (profileLoop *)malloc(MEMORY_SIZE * sizeof(profileLoop));
+	unsigned long totalRuns = 0, totalWords = 0, totalTaken = 0, runs;
+	int numOfEntries = 0, numOfLoops = 0, i, address, words;
+	simInstruction *ins;
+
+	if (!source || !entries || !loops)
+	{
+		appendFormat(out, "[Error] Not enough memory - malloc falied.\n");
+		free(source);
+		free(entries);
+		free(loops);
+		return;
+	}
+	initProfileSource(source, ctx);
+
+	/* The instructions that ran are decoded again (the slots of the written words are left to be decoded) */
+	for (address = 0; address < MEMORY_SIZE; address++)
+	{
+		runs = profile->runs[SIM_SLOT(address)];
+		if (runs == 0)
+		{
+			continue;
+		}
+		decodeInstruction(machine, address);
+		ins = &machine->slots[SIM_SLOT(address)];
+		words = ins->op < SIM_DECODE ? ins->next - address : 1;
+
+		entries[numOfEntries].address = address;
+		entries[numOfEntries++].runs = runs;
+		totalRuns += runs;
+		totalWords += runs * words;
+		totalTaken += profile->taken[SIM_SLOT(address)];
+
+		/* A backward jump to a direct operand is a loop */
+		if ((ins->op == SIM_JMP || ins->op == SIM_BNE) && ins->dst == &ins->imm[1] && ins->imm[1] <= address
+			&& profile->taken[SIM_SLOT(address)])
+		{
+			loops[numOfLoops].from = ins->imm[1];
+			loops[numOfLoops].to = address;
+			loops[numOfLoops++].iterations = profile->taken[SIM_SLOT(address)];
+		}
+	}
+
+	appendFormat(out, "Profile of \"%s\": %lu instructions, %lu words fetched, %lu jumps taken.\n\n", fileName, totalRuns, totalWords, totalTaken);
+
+	/* The flat profile */
+	qsort(entries, numOfEntries, sizeof(profileEntry), compareEntries);
+	appendFormat(out, "Flat profile:\n%12s %7s %12s %6s %10s  %-20s%s\n", "runs", "%", "fetched", "size", "taken", "location", "source");
+	for (i = 0; i < numOfEntries; i++)
+	{
+		address = entries[i].address;
+		ins = &machine->slots[SIM_SLOT(address)];
+		words = ins->op < SIM_DECODE ? ins->next - address : 1;
+		appendFormat(out, "%12lu %7.2f %12lu %6d %10lu  ", entries[i].runs, 100.0 * entries[i].runs / totalRuns,
+			entries[i].runs * words, words, profile->taken[SIM_SLOT(address)]);
+		appendLocation(out, source, address);
+		appendSourceLine(out, source, address);
+		appendText(out, "\n", 1);
+	}
+
+	/* The hot loops */
+	for (i = 0; i < numOfLoops; i++)
+	{
+		loops[i].runs = 0;
+		loops[i].words = 0;
+		for (address = loops[i].from; address <= loops[i].to; address++)
+		{
+			runs = profile->runs[SIM_SLOT(address)];
+			if (runs)
+			{
+				ins = &machine->slots[SIM_SLOT(address)];
+				loops[i].runs += runs;
+				loops[i].words += runs * (ins->op < SIM_DECODE ? ins->next - address : 1);
+			}
+		}
+	}
+	qsort(loops, numOfLoops, sizeof(profileLoop), compareLoops);
+	appendFormat(out, "\nHot loops:\n%12s %12s %7s %12s  %-20s%-20s%s\n", "iterations", "runs", "%", "fetched", "from", "to", "source");
+	for (i = 0; i < numOfLoops && i < MAX_HOT_LOOPS; i++)
+	{
+		appendFormat(out, "%12lu %12lu %7.2f %12lu  ", loops[i].iterations, loops[i].runs, 100.0 * loops[i].runs / totalRuns, loops[i].words);
+		appendLocation(out, source, loops[i].from);
+		appendLocation(out, source, loops[i].to);
+		appendSourceLine(out, source, loops[i].from);
+		appendText(out, "\n", 1);
+	}
+	if (numOfLoops == 0)
+	{
+		appendFormat(out, "No loops were run.\n");
+	}
+
+	free(source->lineText);
+	free(source);
+	free(entries);
+	free(loops);
+}
@@ -0,0 +1,391 @@
+/*
+The batch runner.
+Runs the memory images of a batch of programs (their .ob files, or their .obj files with --binary) on the
+simulator, on the threads of the work stealing pool (see threadPool.c), and writes the results of all of them
+to one JSON file: how each program stopped, its pc, steps and time, its registers and the numbers it printed.
+Each worker has its own machine (and JIT), reused for all its programs, so the programs never share a state.
+Each program has a budget of instructions and a timeout (the defaults of the options, or its line in a list
+file). A timed out program is stopped between slices of RUNNER_SLICE_STEPS instructions.
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/* ======== Macros ======== */
+#define DEFAULT_MAX_STEPS	100000000UL
+#define RUNNER_SLICE_STEPS	(1UL << 20) /* The instructions run between the checks of the timeout */
+
+/* ======== Data Structures ======== */
+
+/* A program of the batch */
+typedef struct
+{
+	char *name;						/* The file name (without the ending) */
+	unsigned long maxSteps;			/* The budget of instructions */
+	double timeout;					/* The max run time in seconds (0 if there isn't) */
+	simResult result;				/* How it stopped (NUM_OF_SIM_RESULTS if it couldn't be loaded) */
+} batchProgram;
+
+/* The state of a worker, reused for all its programs */
+typedef struct
+{
+	simMachine *machine;
+	simJit *jit;					/* NULL runs on the interpreter */
+	textBuffer buffers[3];			/* The .ob file, the .ext file and the binary object */
+	textBuffer report;				/* Why an image couldn't be loaded */
+} batchWorker;
+
+/* The batch being run */
+typedef struct
+{
+	batchProgram *programs;
+	int numOfPrograms;
+	int programsCapacity;
+	batchWorker *workers;
+	textBuffer *results;			/* The JSON result of each program */
+	textBuffer input;				/* The numbers read by get (the same for all the programs) */
+	bool binaryInput;				/* Run the .obj files instead of the .ob files */
+	bool useJit;					/* Run on the JIT (if the host supports it) */
+	memoryArena names;				/* The names of the programs from the list files */
+} programBatch;
+
+/* ====== Methods ====== */
+
+/* Adds a program to the batch. Returns if it succeeded. */
+bool addProgram(programBatch *batch, char *name, unsigned long maxSteps, double timeout)
+{
+	batchProgram *newPrograms = (batchProgram *)reserveArray(batch->programs, &batch->programsCapacity, batch->numOfPrograms + 1, sizeof(batchProgram));
+
+	if (!newPrograms)
+	{
+		return FALSE;
+	}
+	batch->programs = newPrograms;
+	batch->programs[batch->numOfPrograms].name = name;
+	batch->programs[batch->numOfPrograms].maxSteps = maxSteps;
+	batch->programs[batch->numOfPrograms].timeout = timeout;
+	batch->programs[batch->numOfPrograms++].result = NUM_OF_SIM_RESULTS;
+	return TRUE;
+}
+
+/* Adds the programs of a list file: a line for each program, with its name, and optionally its budget of */
+/* instructions and its timeout in ms (the defaults are used for the missing ones). Returns if it succeeded. */
+bool addProgramList(programBatch *batch, char *listFile, unsigned long maxSteps, double timeout)
+{
+	textBuffer list = { 0 };
+	sourceReader reader;
+	const char *line, *token, *end;
+	size_t length, tokLength;
+	char *name, *num;
+	bool isLegal = TRUE;
+
+	readTextFile(listFile, "", &list);
+	if (list.length == 0)
+	{
+		printf("[Info] The list file \"%s\" is empty or can't be opened.\n", listFile);
+		free(list.data);
+		return FALSE;
+	}
+
+	reader.pos = list.data;
+	reader.end = list.data + list.length;
+	while (isLegal && (line = nextLine(&reader, &length)) != NULL)
+	{
+		end = line + length;
+		token = getTokenSlice(line, end, &tokLength);
+		if (!token)
+		{
+			continue;
+		}
+		name = arenaCopy(&batch->names, token, tokLength);
+
+		/* The budget and the timeout (optional) */
+		token = getTokenSlice(token + tokLength, end, &tokLength);
+		num = token ? arenaCopy(&batch->names, token, tokLength) : NULL;
+		isLegal = name && addProgram(batch, name, num ? strtoul(num, NULL, 10) : maxSteps, timeout);
+		if (isLegal && token)
+		{
+			token = getTokenSlice(token + tokLength, end, &tokLength);
+			num = token ? arenaCopy(&batch->names, token, tokLength) : NULL;
+			batch->programs[batch->numOfPrograms - 1].timeout = num ? atof(num) / 1e3 : timeout;
+		}
+	}
+
+	if (!isLegal)
+	{
+		printf("[Error] Not enough memory - malloc falied.\n");
+	}
+	free(list.data);
+	return isLegal;
+}
+
+/* Runs the loaded machine of a worker until it stops, runs out of its budget, or runs out of its time. */
+simResult runProgram(batchWorker *worker, batchProgram *program)
+{
+	simMachine *machine = worker->machine;
+	double start = getTime();
+	unsigned long slice;
+	simResult result;
+
+	do
+	{
+		slice = program->maxSteps - machine->steps < RUNNER_SLICE_STEPS ? program->maxSteps - machine->steps : RUNNER_SLICE_STEPS;
+		result = worker->jit ? runJit(worker->jit, machine, slice) : runMachine(machine, slice);
+	} while (result == SIM_STEP_LIMIT && machine->steps < program->maxSteps
+		&& !(program->timeout > 0 && getTime() - start >= program->timeout));
+
+	return (result == SIM_STEP_LIMIT && machine->steps < program->maxSteps) ? SIM_TIMEOUT : result;
+}
+
+/* Appends the JSON result of a run: how it stopped, its registers and the numbers it printed. */
+void appendRunResult(textBuffer *out, simMachine *machine, simResult result, double runTime)
+{
+	const char *number, *end = machine->output.data + machine->output.length;
+	int i;
+
+	appendFormat(out, ", \"result\": ");
+	appendJsonString(out, getSimResultText(result), strlen(getSimResultText(result)));
+	appendFormat(out, ", \"pc\": %d, \"steps\": %lu, \"timeMs\": %.6f, \"zeroFlag\": %s, \"registers\": [",
+		machine->pc, machine->steps, runTime * 1e3, machine->zeroFlag ? "true" : "false");
+	for (i = 0; i < NUM_OF_REGISTERS; i++)
+	{
+		appendFormat(out, "%s%d", i ? ", " : "", SIGN_EXTEND(machine->registers[i], MEMORY_WORD_LENGTH));
+	}
+
+	/* The output is a number in each line */
+	appendFormat(out, "], \"output\": [");
+	for (number = machine->output.data; number && number < end; number++)
+	{
+		if (number != machine->output.data)
+		{
+			appendText(out, ", ", 2);
+		}
+		for (i = 0; number + i < end && number[i] != '\n'; i++)
+		{
+			/* Find the end of the number */
+		}
+		appendText(out, number, i);
+		number += i;
+	}
+	appendText(out, "]", 1);
+}
+
+/* A job of the thread pool - runs one program of the batch, and keeps its JSON result. */
+void runProgramJob(int jobId, int workerId, void *arg)
+{
+	programBatch *batch = (programBatch *)arg;
+	batchProgram *program = &batch->programs[jobId];
+	batchWorker *worker = &batch->workers[workerId];
+	textBuffer *out = &batch->results[jobId];
+	const objectHeader *header;
+	const char *content;
+	size_t length;
+	bool isMapped;
+	double start;
+
+	appendFormat(out, "%s\n\t{\"name\": ", jobId ? "," : "");
+	appendJsonString(out, program->name, strlen(program->name));
+
+	worker->report.length = 0;
+	header = loadImage(program->name, batch->binaryInput, &worker->buffers[0], &worker->buffers[1], &worker->buffers[2],
+		&content, &length, &isMapped, &worker->report);
+	if (header)
+	{
+		loadMachine(worker->machine, header);
+		worker->machine->input.pos = batch->input.data;
+		worker->machine->input.end = batch->input.data + batch->input.length;
+		if (worker->jit)
+		{
+			flushJit(worker->jit);
+		}
+
+		start = getTime();
+		program->result = runProgram(worker, program);
+		appendRunResult(out, worker->machine, program->result, getTime() - start);
+	}
+	else
+	{
+		/* The report has one line (without the '\n') */
+		appendFormat(out, ", \"error\": ");
+		appendJsonString(out, worker->report.data, worker->report.length ? worker->report.length - 1 : 0);
+	}
+	appendText(out, "}", 1);
+
+	if (content)
+	{
+		releaseFile(content, length, isMapped);
+	}
+}
+
+/* Runs the batch on numOfWorkers threads, and writes the results to resultsFile. Returns the programs that didn't halt. */
+int runBatch(programBatch *batch, int numOfWorkers, char *resultsFile)
+{
+	textBuffer json = { 0 }, report = { 0 };
+	int counts[NUM_OF_SIM_RESULTS + 1] = { 0 };
+	int i, failed;
+	double start;
+
+	if (numOfWorkers > batch->numOfPrograms)
+	{
+		numOfWorkers = batch->numOfPrograms > 0 ? batch->numOfPrograms : 1;
+	}
+	batch->workers = (batchWorker *)calloc(numOfWorkers, sizeof(batchWorker));
+	batch->results = (textBuffer *)calloc(batch->numOfPrograms, sizeof(textBuffer));
+	for (i = 0; batch->workers && i < numOfWorkers; i++)
+	{
+		batch->workers[i].machine = (simMachine *)calloc(1, sizeof(simMachine));
+		batch->workers[i].jit = batch->useJit ? createJit() : NULL;
+		if (!batch->workers[i].machine)
+		{
+			break;
+		}
+	}
+	if (!batch->workers || !batch->results || i < numOfWorkers)
+	{
+		printf("[Error] Not enough memory - malloc falied.\n");
+		failed = batch->numOfPrograms;
+	}
+	else
+	{
+		if (batch->useJit && !batch->workers[0].jit)
+		{
+			printf("[Info] The JIT isn't supported on this host - running on the interpreter.\n");
+		}
+
+		start = getTime();
+		runJobs(batch->numOfPrograms, numOfWorkers, runProgramJob, batch);
+
+		appendFormat(&json, "{\"programs\": [");
+		for (i = 0; i < batch->numOfPrograms; i++)
+		{
+			appendText(&json, batch->results[i].data, batch->results[i].length);
+			counts[batch->programs[i].result]++;
+		}
+		failed = batch->numOfPrograms - counts[SIM_HALTED];
+		appendFormat(&json, "\n],\n\"total\": {\"programs\": %d, \"halted\": %d, \"stepLimit\": %d, \"timeout\": %d, \"errors\": %d, \"notLoaded\": %d, \"wallMs\": %.6f}}\n",
+			batch->numOfPrograms, counts[SIM_HALTED], counts[SIM_STEP_LIMIT], counts[SIM_TIMEOUT],
+			failed - counts[SIM_STEP_LIMIT] - counts[SIM_TIMEOUT] - counts[NUM_OF_SIM_RESULTS], counts[NUM_OF_SIM_RESULTS], (getTime() - start) * 1e3);
+		writeFile(resultsFile, "", &json, &report);
+
+		appendFormat(&report, "[Info] Ran %d programs on %d thread%s: %d halted, %d didn't.\n",
+			batch->numOfPrograms, numOfWorkers, numOfWorkers > 1 ? "s" : "", counts[SIM_HALTED], failed);
+		fwrite(report.data, 1, report.length, stdout);
+	}
+
+	for (i = 0; batch->workers && i < numOfWorkers; i++)
+	{
+		if (batch->workers[i].machine)
+		{
+			free(batch->workers[i].machine->output.data);
+			free(batch->workers[i].machine);
+		}
+		freeJit(batch->workers[i].jit);
+		free(batch->workers[i].buffers[0].data);
+		free(batch->workers[i].buffers[1].data);
+		free(batch->workers[i].buffers[2].data);
+		free(batch->workers[i].report.data);
+	}
+	for (i = 0; batch->results && i < batch->numOfPrograms; i++)
+	{
+		free(batch->results[i].data);
+	}
+	free(batch->workers);
+	free(batch->results);
+	free(json.data);
+	free(report.data);
+	return failed;
+}
+
+/* Main method. Runs the programs in argv and in the list files. */
+/* Options: "-j N" runs on N threads (N = 0, the default, means a thread for each core), "--binary" runs the .obj files, */
+/* "--jit" runs on the JIT, "--steps N" and "--timeout MS" are the default budget and timeout of a program, */
+/* "--input FILE" has the numbers read by get, "--list FILE" adds the programs of a list file, */
+/* and "-o FILE" is the results file (results.json by default). */
+int main(int argc, char *argv[])
+{
+	programBatch batch;
+	char *resultsFile = "results.json", *inputFile = NULL, *endOfNum;
+	unsigned long maxSteps = DEFAULT_MAX_STEPS;
+	double timeout = 0;
+	int i, numOfWorkers = 0, failed;
+	bool isLegal = TRUE;
+
+	memset(&batch, 0, sizeof(batch));
+
+	/* The options, and the programs (the budget and the timeout apply to the programs after them) */
+	for (i = 1; i < argc && isLegal; i++)
+	{
+		if (argv[i][0] != '-')
+		{
+			isLegal = addProgram(&batch, argv[i], maxSteps, timeout);
+		}
+		else if (strcmp(argv[i], "--binary") == 0)
+		{
+			batch.binaryInput = TRUE;
+		}
+		else if (strcmp(argv[i], "--jit") == 0)
+		{
+			batch.useJit = TRUE;
+		}
+		else if (i + 1 >= argc)
+		{
+			printf("[Info] \"%s\" must be followed by a value.\n", argv[i]);
+			isLegal = FALSE;
+		}
+		else if (strcmp(argv[i], "-j") == 0)
+		{
+			numOfWorkers = strtol(argv[++i], &endOfNum, 10);
+			isLegal = *endOfNum == '\0' && numOfWorkers >= 0;
+		}
+		else if (strcmp(argv[i], "--steps") == 0)
+		{
+			maxSteps = strtoul(argv[++i], &endOfNum, 10);
+			isLegal = *endOfNum == '\0';
+		}
+		else if (strcmp(argv[i], "--timeout") == 0)
+		{
+			timeout = strtod(argv[++i], &endOfNum) / 1e3;
+			isLegal = *endOfNum == '\0' && timeout >= 0;
+		}
+		else if (strcmp(argv[i], "--input") == 0)
+		{
+			inputFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "--list") == 0)
+		{
+			isLegal = addProgramList(&batch, argv[++i], maxSteps, timeout);
+		}
+		else if (strcmp(argv[i], "-o") == 0)
+		{
+			resultsFile = argv[++i];
+		}
+		else
+		{
+			printf("[Info] Unknown option \"%s\".\n", argv[i]);
+			isLegal = FALSE;
+		}
+	}
+
+	if (!isLegal || batch.numOfPrograms == 0)
+	{
+		printf("[Info] Usage: %s [-j threads] [--binary] [--jit] [--steps N] [--timeout MS] [--input FILE] [-o results-file] (file | --list list-file)...\n", argv[0]);
+		printf("[Info] A line of a list file is: file [steps [timeout-ms]].\n");
+		free(batch.programs);
+		arenaFree(&batch.names);
+		return 1;
+	}
+
+	if (inputFile)
+	{
+		readTextFile(inputFile, "", &batch.input);
+	}
+	failed = runBatch(&batch, numOfWorkers ? numOfWorkers : getNumOfCores(), resultsFile);
+
+	free(batch.programs);
+	free(batch.input.data);
+	arenaFree(&batch.names);
+	return failed ? 1 : 0;
+}
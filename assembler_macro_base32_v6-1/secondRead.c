@@ -9,51 +9,46 @@ This file gets the data structures from the first file read, and convert them in
 /* Use the commands list from firstRead.c */
 extern const command g_cmdArr[];
 
-/* Use the data from firstRead.c */
-extern labelInfo g_labelArr[MAX_LABELS_NUM];
-extern int g_labelNum;
-lineInfo *g_entryLines[MAX_LABELS_NUM];
-extern int g_entryLabelsNum;
-extern int g_dataArr[MAX_DATA_NUM];
-
 /* ====== Methods ====== */
 
-/* Updates the addresses of all the data labels in g_labelArr. */
-void updateDataLabelsAddress(int IC)
+/* Updates the addresses of all the data labels in ctx->labelArr. */
+void updateDataLabelsAddress(assemblerContext *ctx)
 {
 	int i;
 
 	/* Search in the array for label with isData flag */
-	for (i = 0; i < g_labelNum; i++)
+	for (i = 0; i < ctx->labelNum; i++)
 	{
-		if (g_labelArr[i].isData)
+		if (ctx->labelArr[i].isData)
 		{
 			/* Increase the adress */
-			g_labelArr[i].address += IC;
+			ctx->labelArr[i].address += ctx->IC;
 		}
 	}
 }
 
-/* Returns if there is an illegal entry line in g_entryLines. */
-int countIllegalEntries()
+/* Returns if there is an illegal entry line in ctx->entryLines. */
+int countIllegalEntries(assemblerContext *ctx)
 {
 	int i, ret = 0;
 	labelInfo *label;
+	lineInfo *entryLine;
 
-	for (i = 0; i < g_entryLabelsNum; i++)
+	for (i = 0; i < ctx->entryLabelsNum; i++)
 	{
-		label = getLabel(g_entryLines[i]->lineStr);
+		entryLine = &ctx->linesArr[ctx->entryLines[i]];
+		label = getLabel(ctx, entryLine->lineStr);
 		if (label)
 		{
 			if (label->isExtern)
 			{
-				printError(g_entryLines[i]->lineNum, "The parameter for .entry can't be an external label.");
+				printError(ctx, entryLine->lineNum, "The parameter for .entry can't be an external label.");
 				ret++;
 			}
 		}
 		else
 		{
-			printError(g_entryLines[i]->lineNum, "No such label as \"%s\".", g_entryLines[i]->lineStr);
+			printError(ctx, entryLine->lineNum, "No such label as \"%s\".", entryLine->lineStr);
 			ret++;
 		}
 	}
@@ -64,19 +59,19 @@ int countIllegalEntries()
 
 /* If the op is a label, this method is updating the value of the it to be the address of the label. */
 /* Returns FALSE if there is an error, or TRUE otherwise. */
-bool updateLableOpAddress(operandInfo *op, int lineNum)
+bool updateLableOpAddress(assemblerContext *ctx, operandInfo *op, int lineNum)
 {
 	if (op->type == LABEL)
 	{
-			labelInfo *label = getLabel(op->str);
+			labelInfo *label = getLabelView(ctx, op->str, op->length);
 
 			/* Check if op.str is a real label name */
 			if (label == NULL)
 			{
 				/* Print errors (legal name is illegal or not exists yet) */
-				if (isLegalLabel(op->str, lineNum, TRUE))
+				if (isLegalLabelView(ctx, op->str, op->length, lineNum, TRUE))
 				{
-					printError(lineNum, "No such label as \"%s\"", op->str);
+					printError(ctx, lineNum, "No such label as \"%s\"", op->str);
 				}
 				return FALSE;
 			}
@@ -124,8 +119,27 @@ memoryWord getCmdMemoryWord(lineInfo line)
 	return memory;
 }
 
+/* Adds a use of an extern label at 'address' to ctx->externArr. Returns if it succeeded. */
+bool addExternRef(assemblerContext *ctx, labelInfo *label, int address)
+{
+	externRef *newExternArr = (externRef *)reserveArray(ctx->externArr, &ctx->externCapacity, ctx->externNum + 1, sizeof(externRef));
+
+	if (!newExternArr)
+	{
+		appendFormat(&ctx->messages, "[Error] Not enough memory - malloc falied.\n");
+		return FALSE;
+	}
+	ctx->externArr = newExternArr;
+
+	ctx->externArr[ctx->externNum].labelId = (int)(label - ctx->labelArr);
+	ctx->externArr[ctx->externNum].address = address;
+	ctx->externNum++;
+	return TRUE;
+}
+
 /* Returns a memory word which represents the operand (assuming it's a valid operand). */
-memoryWord getOpMemoryWord(operandInfo op, bool isDest)
+/* A use of an extern label is added to ctx->externArr (op.address must be set). */
+memoryWord getOpMemoryWord(assemblerContext *ctx, operandInfo op, bool isDest)
 {
 	memoryWord memory = { 0 };
 
@@ -146,17 +160,19 @@ memoryWord getOpMemoryWord(operandInfo op, bool isDest)
 	}
 	else
 	{
-		labelInfo *label = getLabel(op.str);
-		labelInfo *structLabel = getLabel(getLabelStruct(op.str));
+		labelInfo *label = (op.type == LABEL) ? getLabelView(ctx, op.str, op.length) : NULL;
+		labelInfo *structLabel = (op.type == STRUCT) ? getLabelView(ctx, op.structLabel, op.structLabelLength) : NULL;
 
-		/* Set era */	
+		/* Set era (and keep the extern uses for the .ext file) */
 		if (op.type == LABEL && label && label->isExtern)
 		{
 			memory.era = EXTENAL;
+			addExternRef(ctx, label, op.address);
 		}
 		else if (op.type == STRUCT && structLabel && structLabel->isExtern)
 		{
 			memory.era = EXTENAL;
+			addExternRef(ctx, structLabel, op.address);
 		}
 		else
 		{
@@ -169,19 +185,19 @@ memoryWord getOpMemoryWord(operandInfo op, bool isDest)
 	return memory;
 }
 
-/* Adds the value of memory word to the memoryArr, and increase the memory counter. */
-void addWordToMemory(int *memoryArr, int *memoryCounter, memoryWord memory)
+/* Adds the value of memory word to the ctx->memoryArr, and increase the memory counter. */
+void addWordToMemory(assemblerContext *ctx, int *memoryCounter, memoryWord memory)
 {
 	/* Check if memoryArr isn't full yet */
-	if (*memoryCounter < MAX_DATA_NUM)
+	if (*memoryCounter < ctx->IC + ctx->DC)
 	{
 		/* Add the memory word and increase memoryCounter */
-		memoryArr[(*memoryCounter)++] = getNumFromMemoryWord(memory);
+		ctx->memoryArr[(*memoryCounter)++] = getNumFromMemoryWord(memory);
 	}
 }
 
-/* Adds a whole line into the memoryArr, and increase the memory counter. */
-bool addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line)
+/* Adds a whole line into the ctx->memoryArr, and increase the memory counter. */
+bool addLineToMemory(assemblerContext *ctx, int *memoryCounter, lineInfo *line)
 {
 	bool foundError = FALSE;
 
@@ -189,14 +205,14 @@ bool addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line)
 	if (!line->isError && line->cmd != NULL)
 	{
 		/* Update the label operands value */
-		if (!updateLableOpAddress(&line->op1, line->lineNum) || !updateLableOpAddress(&line->op2, line->lineNum))
+		if (!updateLableOpAddress(ctx, &line->op1, line->lineNum) || !updateLableOpAddress(ctx, &line->op2, line->lineNum))
 		{
 			line->isError = TRUE;
 			foundError = TRUE;
 		}
 
 		/* Add the command word to the memory */
-		addWordToMemory(memoryArr, memoryCounter, getCmdMemoryWord(*line));
+		addWordToMemory(ctx, memoryCounter, getCmdMemoryWord(*line));
 
 		if (line->op1.type == REGISTER && line->op2.type == REGISTER)
 		{
@@ -207,7 +223,7 @@ bool addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line)
 			memory.valueBits.regBits.srcBits = line->op1.value;
 
 			/* Add the memory to the memoryArr array */
-			addWordToMemory(memoryArr, memoryCounter, memory);
+			addWordToMemory(ctx, memoryCounter, memory);
 		}
 		else
 		{
@@ -216,7 +232,7 @@ bool addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line)
 			{
 				/* Add the op1 word to the memory */
 				line->op1.address = FIRST_ADDRESS + *memoryCounter;
-				addWordToMemory(memoryArr, memoryCounter, getOpMemoryWord(line->op1, FALSE));
+				addWordToMemory(ctx, memoryCounter, getOpMemoryWord(ctx, line->op1, FALSE));
 				/* ^^ The FALSE param means it's not the 2nd op */
 			}
 
@@ -225,7 +241,7 @@ bool addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line)
 			{
 				/* Add the op2 word to the memory */
 				line->op2.address = FIRST_ADDRESS + *memoryCounter;
-				addWordToMemory(memoryArr, memoryCounter, getOpMemoryWord(line->op2, TRUE));
+				addWordToMemory(ctx, memoryCounter, getOpMemoryWord(ctx, line->op2, TRUE));
 				/* ^^ The TRUE param means it's the 2nd op */
 			}
 		}
@@ -234,21 +250,21 @@ bool addLineToMemory(int *memoryArr, int *memoryCounter, lineInfo *line)
 	return !foundError;
 }
 
-/* Adds the data from g_dataArr to the end of memoryArr. */
-void addDataToMemory(int *memoryArr, int *memoryCounter, int DC)
+/* Adds the data from ctx->dataArr to the end of ctx->memoryArr. */
+void addDataToMemory(assemblerContext *ctx, int *memoryCounter)
 {
 	int i;
 	/* Create an int of "MEMORY_WORD_LENGTH" times '1', and all the rest are '0' */
 	unsigned int mask = ~0;
 	mask >>= (sizeof(int) * BYTE_SIZE - MEMORY_WORD_LENGTH);
 
-	/* Add each int from g_dataArr to the end of memoryArr */
-	for (i = 0; i < DC; i++)
+	/* Add each int from ctx->dataArr to the end of memoryArr */
+	for (i = 0; i < ctx->DC; i++)
 	{
-		if (*memoryCounter < MAX_DATA_NUM)
+		if (*memoryCounter < ctx->IC + ctx->DC)
 		{
 			/* The mask makes sure we only use the first "MEMORY_WORD_LENGTH" bits */
-			memoryArr[(*memoryCounter)++] = mask & g_dataArr[i];
+			ctx->memoryArr[(*memoryCounter)++] = mask & ctx->dataArr[i];
 		}
 		else
 		{
@@ -259,29 +275,40 @@ void addDataToMemory(int *memoryArr, int *memoryCounter, int DC)
 }
 
 /* Reads the data from the first read for the second time. */
-/* It converts all the lines into the memory. */
-int secondFileRead(int *memoryArr, lineInfo *linesArr, int lineNum, int IC, int DC)
+/* It converts all the lines into ctx->memoryArr. */
+int secondFileRead(assemblerContext *ctx)
 {
 	int errorsFound = 0, memoryCounter = 0, i;
+	int *newMemoryArr;
+
+	/* Make sure ctx->memoryArr can hold the whole memory image (IC + DC words) */
+	newMemoryArr = (int *)reserveArray(ctx->memoryArr, &ctx->memoryCapacity, ctx->IC + ctx->DC, sizeof(int));
+	if (!newMemoryArr)
+	{
+		appendFormat(&ctx->messages, "[Error] Not enough memory - malloc falied.\n");
+		return ++errorsFound;
+	}
+	ctx->memoryArr = newMemoryArr;
+	memset(ctx->memoryArr, 0, (ctx->IC + ctx->DC) * sizeof(int));
 
 	/* Update the data labels */
-	updateDataLabelsAddress(IC);
+	updateDataLabelsAddress(ctx);
 
 	/* Check if there are illegal entries */
-	errorsFound += countIllegalEntries();
+	errorsFound += countIllegalEntries(ctx);
 
-	/* Add each line in linesArr to the memoryArr */
-	for (i = 0; i < lineNum; i++)
+	/* Add each line in ctx->linesArr to the memoryArr */
+	for (i = 0; i < ctx->linesFound; i++)
 	{
-		if (!addLineToMemory(memoryArr, &memoryCounter, &linesArr[i]))
+		if (!addLineToMemory(ctx, &memoryCounter, &ctx->linesArr[i]))
 		{
 			/* An error was found while adding the line to the memory */
 			errorsFound++;
 		}
 	}
 
-	/* Add the data from g_dataArr to the end of memoryArr */
-	addDataToMemory(memoryArr, &memoryCounter, DC);
+	/* Add the data from ctx->dataArr to the end of memoryArr */
+	addDataToMemory(ctx, &memoryCounter);
 
 	return errorsFound;
-}
\ No newline at end of file
+}
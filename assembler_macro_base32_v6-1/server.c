@@ -0,0 +1,694 @@
+/*
+The assembler server.
+Runs the assembler as a daemon on a Unix domain socket, so a build system can assemble its sources without
+starting a process for each one. A poll loop accepts the connections and waits for their requests, and a fixed
+pool of workers (on the thread pool) serves the requests that are ready. A worker is held for one request, not
+for a whole connection, so idle clients never block the others. Each worker keeps its own assemblerContext and
+buffers, so their memory stays allocated from one request to the next.
+A connection sends requests one after the other, and gets a reply for each one:
+- "file NAME\n" assembles NAME.as like the assembler does (see parseFile), with the options of the server,
+  and writes the output files next to it.
+- "source NAME LENGTH\n" and then LENGTH bytes assembles the source in the request, and sends the outputs back
+  instead of writing them (NAME is only used in the messages).
+- "quit\n" stops the server, after the requests that are running. The idle connections are closed.
+A reply is "errors N\n" (N is -1 if the file can't be opened), then "PART LENGTH\n" and LENGTH bytes for each
+part - the report (the [Info] and [Error] lines), and for a source the am, ob, ent, ext and obj outputs that
+were created - and then "end\n". A request that can't be read gets "error MESSAGE\n", and its connection is closed.
+The connections don't block: a worker never waits for the rest of a request (the connection goes back to the poll
+loop until more bytes arrive), and a reply that the client doesn't read for SERVER_WRITE_TIMEOUT seconds closes it.
+*/
+
+#define _POSIX_C_SOURCE 200112L /* For the sockets, poll and fcntl */
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* ======== Macros ======== */
+#define MAX_REQUEST_LINE	4096 /* The max length of the first line of a request */
+#define MAX_REQUEST_SOURCE	(64UL * 1024 * 1024) /* The max length of the source in a request */
+#define READ_CHUNK_SIZE		65536 /* The bytes asked for in each read of a connection */
+#define SERVER_WRITE_TIMEOUT	30 /* The seconds a worker waits for a client to read its reply */
+
+/* ======== Data Structures ======== */
+
+/* The states of a connection: waiting in the poll loop, waiting in the ready queue, or served by a worker */
+typedef enum { CONNECTION_IDLE, CONNECTION_QUEUED, CONNECTION_BUSY } connectionState;
+
+/* The results of serving a request: it was served, its bytes didn't all arrive yet, or the connection must be closed */
+typedef enum { REQUEST_DONE, REQUEST_WAIT, REQUEST_CLOSE } requestResult;
+
+/* A client connection */
+typedef struct serverConnection
+{
+	int fd;
+	connectionState state;
+	textBuffer in;					/* The bytes read from the connection (from the start of the next request) */
+	size_t lineLength;				/* The length of the first line of the request with its new line (0 until it's read) */
+	size_t sourceLength;			/* The length of the source after the line (0 if it isn't a source request) */
+	bool isSource;					/* The request is a source request */
+	struct serverConnection *next;	/* The next connection in the ready queue */
+} serverConnection;
+
+/* The state of a worker, reused for all its requests */
+typedef struct
+{
+	assemblerContext ctx;
+	textBuffer report;				/* The report of a request */
+	textBuffer reply;				/* The reply to a request */
+} serverWorker;
+
+/* The shared state of the server */
+typedef struct
+{
+	int listenFd;
+	int wakeFds[2];					/* A pipe that wakes the poll loop (a connection is idle again, or the server stops) */
+	char *cacheDir;					/* The outputs cache directory of the file requests (NULL if there is no cache) */
+	serverWorker *workers;			/* One for each worker */
+	serverConnection **connections;	/* All the open connections */
+	int numOfConnections;
+	int connectionsCapacity;
+	serverConnection *queueHead;	/* The connections with a request to serve, in order */
+	serverConnection *queueTail;
+	bool isStopping;				/* A quit request was received */
+	pthread_mutex_t mutex;			/* Guards the connections, the queue and isStopping */
+	pthread_cond_t queueCond;		/* Signaled when a connection is queued or the server stops */
+} assemblerServer;
+
+/* ====== Methods ====== */
+
+/* Wakes the poll loop. */
+void wakePollLoop(assemblerServer *server)
+{
+	char byte = 0;
+	ssize_t result;
+
+	do
+	{
+		result = write(server->wakeFds[1], &byte, 1);
+	} while (result == -1 && errno == EINTR);
+}
+
+/* Makes the reads and writes of a file descriptor not block. Returns if it succeeded. */
+bool setNonBlocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/* Stops the server: the waiting connections are closed by the poll loop, and the workers return after their request. */
+void stopServer(assemblerServer *server)
+{
+	pthread_mutex_lock(&server->mutex);
+	server->isStopping = TRUE;
+	pthread_cond_broadcast(&server->queueCond);
+	pthread_mutex_unlock(&server->mutex);
+
+	wakePollLoop(server);
+}
+
+/* Adds a connection to the end of the ready queue (the mutex must be locked). */
+void queueConnection(assemblerServer *server, serverConnection *conn)
+{
+	conn->state = CONNECTION_QUEUED;
+	conn->next = NULL;
+	if (server->queueTail)
+	{
+		server->queueTail->next = conn;
+	}
+	else
+	{
+		server->queueHead = conn;
+	}
+	server->queueTail = conn;
+	pthread_cond_signal(&server->queueCond);
+}
+
+/* Adds an accepted connection to the server as an idle connection. Returns FALSE if there isn't enough memory. */
+bool addConnection(assemblerServer *server, int fd)
+{
+	serverConnection **newConnections, *conn = (serverConnection *)calloc(1, sizeof(serverConnection));
+
+	pthread_mutex_lock(&server->mutex);
+	newConnections = (serverConnection **)reserveArray(server->connections, &server->connectionsCapacity, server->numOfConnections + 1, sizeof(serverConnection *));
+	if (newConnections)
+	{
+		server->connections = newConnections;
+	}
+	if (!conn || !newConnections)
+	{
+		pthread_mutex_unlock(&server->mutex);
+		free(conn);
+		return FALSE;
+	}
+	conn->fd = fd;
+	conn->state = CONNECTION_IDLE;
+	server->connections[server->numOfConnections++] = conn;
+	pthread_mutex_unlock(&server->mutex);
+	return TRUE;
+}
+
+/* Closes a connection and removes it from the server (the mutex must be locked). */
+void removeConnection(assemblerServer *server, serverConnection *conn)
+{
+	int i;
+
+	for (i = 0; i < server->numOfConnections; i++)
+	{
+		if (server->connections[i] == conn)
+		{
+			server->connections[i] = server->connections[--server->numOfConnections];
+			break;
+		}
+	}
+	close(conn->fd);
+	free(conn->in.data);
+	free(conn);
+}
+
+/* Reads the bytes that wait in a connection into conn->in. */
+/* Returns the number of bytes read, 0 if no bytes are waiting, or -1 when it's closed (or it failed). */
+int readConnection(serverConnection *conn)
+{
+	ssize_t result;
+
+	if (!reserveText(&conn->in, READ_CHUNK_SIZE))
+	{
+		return -1;
+	}
+	do
+	{
+		result = read(conn->fd, conn->in.data + conn->in.length, READ_CHUNK_SIZE);
+	} while (result == -1 && errno == EINTR);
+	if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		return 0;
+	}
+	if (result <= 0)
+	{
+		return -1;
+	}
+	conn->in.length += result;
+	return (int)result;
+}
+
+/* Writes all of buf to a connection (waiting up to SERVER_WRITE_TIMEOUT seconds for the client to read). */
+/* Returns if it succeeded. */
+bool writeConnection(int fd, textBuffer *buf)
+{
+	struct pollfd writable;
+	size_t written = 0;
+	ssize_t result;
+
+	writable.fd = fd;
+	writable.events = POLLOUT;
+	while (written < buf->length)
+	{
+		result = write(fd, buf->data + written, buf->length - written);
+		if (result == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			if (poll(&writable, 1, SERVER_WRITE_TIMEOUT * 1000) <= 0)
+			{
+				return FALSE;
+			}
+			continue;
+		}
+		if (result <= 0)
+		{
+			return FALSE;
+		}
+		written += result;
+	}
+	return TRUE;
+}
+
+/* Parses the first line of a request (from the start of conn->in, of conn->lineLength chars with its new line). */
+/* The line is '\0' terminated, and the source length of a source request is kept. Returns NULL, or the error. */
+const char *parseRequestLine(serverConnection *conn)
+{
+	char *line = conn->in.data, *end = line + conn->lineLength - 1, *lengthStr, *endOfNum;
+	unsigned long length;
+
+	if (end > line && end[-1] == '\r')
+	{
+		end--;
+	}
+	*end = '\0';
+	if (end - line > MAX_REQUEST_LINE)
+	{
+		return "the request line is too long";
+	}
+
+	conn->isSource = strncmp(line, "source ", 7) == 0 && (lengthStr = strrchr(line, ' ')) > line + 6;
+	conn->sourceLength = 0;
+	if (conn->isSource)
+	{
+		/* The source follows the line */
+		*lengthStr++ = '\0';
+		length = strtoul(lengthStr, &endOfNum, 10);
+		if (*lengthStr < '0' || *lengthStr > '9' || *endOfNum != '\0' || length > MAX_REQUEST_SOURCE)
+		{
+			return "the length of the source isn't legal";
+		}
+		conn->sourceLength = length;
+	}
+	return NULL;
+}
+
+/* Reads the next request of a connection (its line, and its source) into conn->in, without waiting for bytes. */
+/* Returns REQUEST_WAIT if it didn't all arrive yet, and REQUEST_CLOSE if the connection was closed or the */
+/* request isn't legal (*error is the reason then, or NULL if it was closed). */
+requestResult readRequest(serverConnection *conn, const char **error)
+{
+	char *end;
+	int result;
+
+	*error = NULL;
+	while (!conn->lineLength)
+	{
+		end = conn->in.length ? (char *)memchr(conn->in.data, '\n', conn->in.length) : NULL;
+		if (end)
+		{
+			conn->lineLength = end + 1 - conn->in.data;
+			*error = parseRequestLine(conn);
+			if (*error)
+			{
+				return REQUEST_CLOSE;
+			}
+			break;
+		}
+		if (conn->in.length > MAX_REQUEST_LINE)
+		{
+			*error = "the request line is too long";
+			return REQUEST_CLOSE;
+		}
+
+		result = readConnection(conn);
+		if (result <= 0)
+		{
+			return result ? REQUEST_CLOSE : REQUEST_WAIT;
+		}
+	}
+
+	while (conn->in.length < conn->lineLength + conn->sourceLength)
+	{
+		result = readConnection(conn);
+		if (result <= 0)
+		{
+			return result ? REQUEST_CLOSE : REQUEST_WAIT;
+		}
+	}
+	return REQUEST_DONE;
+}
+
+/* Adds a part of a reply: its name and length, and then its bytes. */
+void appendReplyPart(textBuffer *reply, const char *name, textBuffer *part)
+{
+	appendFormat(reply, "%s %lu\n", name, (unsigned long)part->length);
+	appendText(reply, part->data, part->length);
+}
+
+/* Assembles the source of a request, and puts the reply with its outputs in worker->reply. */
+void assembleSource(serverWorker *worker, const char *name, const char *source, size_t length)
+{
+	assemblerContext *ctx = &worker->ctx;
+	int numOfErrors = assemble(source, length, ctx);
+
+	appendText(&worker->report, ctx->messages.data, ctx->messages.length);
+	if (numOfErrors == 0)
+	{
+		appendFormat(&worker->report, "[Info] Created the outputs of the source \"%s\".\n", name);
+	}
+	else
+	{
+		appendFormat(&worker->report, "[Info] A total of %d error%s found throughout \"%s\".\n", numOfErrors, (numOfErrors > 1) ? "s were" : " was", name);
+	}
+
+	appendFormat(&worker->reply, "errors %d\n", numOfErrors);
+	appendReplyPart(&worker->reply, "report", &worker->report);
+	if (ctx->keepExpandedSource)
+	{
+		appendReplyPart(&worker->reply, "am", &ctx->expandedSource);
+	}
+	if (numOfErrors == 0)
+	{
+		/* The same outputs as the files of the assembler (the .ext and .ent only if they aren't empty) */
+		appendReplyPart(&worker->reply, "ob", &ctx->objectOut);
+		if (ctx->entriesOut.length)
+		{
+			appendReplyPart(&worker->reply, "ent", &ctx->entriesOut);
+		}
+		if (ctx->externOut.length)
+		{
+			appendReplyPart(&worker->reply, "ext", &ctx->externOut);
+		}
+		if (ctx->createBinaryObject)
+		{
+			appendReplyPart(&worker->reply, "obj", &ctx->binaryOut);
+		}
+	}
+	appendText(&worker->reply, "end\n", 4);
+
+	resetContext(ctx);
+}
+
+/* Serves the next request of a connection, if all of it was read. */
+/* Returns REQUEST_CLOSE if the connection must be closed (it was closed, the request isn't legal, or the reply can't be sent). */
+requestResult serveRequest(assemblerServer *server, serverWorker *worker, serverConnection *conn)
+{
+	const char *error;
+	char *line;
+	requestResult result = readRequest(conn, &error);
+	int numOfErrors;
+
+	worker->report.length = 0;
+	worker->reply.length = 0;
+	line = conn->in.data;
+	if (result == REQUEST_WAIT)
+	{
+		return result;
+	}
+
+	if (result == REQUEST_DONE && conn->isSource)
+	{
+		assembleSource(worker, line + 7, line + conn->lineLength, conn->sourceLength);
+	}
+	else if (result == REQUEST_DONE && strncmp(line, "file ", 5) == 0 && line[5])
+	{
+		numOfErrors = parseFile(&worker->ctx, line + 5, server->cacheDir, &worker->report);
+		appendFormat(&worker->reply, "errors %d\n", numOfErrors);
+		appendReplyPart(&worker->reply, "report", &worker->report);
+		appendText(&worker->reply, "end\n", 4);
+	}
+	else if (result == REQUEST_DONE && strcmp(line, "quit") == 0)
+	{
+		stopServer(server);
+		appendText(&worker->reply, "end\n", 4);
+	}
+	else if (result == REQUEST_DONE)
+	{
+		error = "unknown request";
+		result = REQUEST_CLOSE;
+	}
+
+	if (result == REQUEST_CLOSE)
+	{
+		/* Nothing is sent back to a connection that was closed */
+		if (error)
+		{
+			appendFormat(&worker->reply, "error %s\n", error);
+			writeConnection(conn->fd, &worker->reply);
+		}
+		return result;
+	}
+
+	/* Drop the bytes of the request (the bytes of the next requests stay) */
+	conn->in.length -= conn->lineLength + conn->sourceLength;
+	memmove(conn->in.data, conn->in.data + conn->lineLength + conn->sourceLength, conn->in.length);
+	conn->lineLength = 0;
+	return writeConnection(conn->fd, &worker->reply) ? REQUEST_DONE : REQUEST_CLOSE;
+}
+
+/* A job of the thread pool - a worker that serves the requests of the ready queue until the server stops. */
+/* After a request the connection goes back to the queue if more of its requests were read, and to the poll loop otherwise. */
+void serverWorkerJob(assemblerServer *server, serverWorker *worker)
+{
+	serverConnection *conn;
+	requestResult result;
+
+	pthread_mutex_lock(&server->mutex);
+	FOREVER
+	{
+		while (!server->queueHead && !server->isStopping)
+		{
+			pthread_cond_wait(&server->queueCond, &server->mutex);
+		}
+		if (server->isStopping)
+		{
+			break;
+		}
+
+		conn = server->queueHead;
+		server->queueHead = conn->next;
+		if (!server->queueHead)
+		{
+			server->queueTail = NULL;
+		}
+		conn->state = CONNECTION_BUSY;
+		pthread_mutex_unlock(&server->mutex);
+
+		result = serveRequest(server, worker, conn);
+
+		pthread_mutex_lock(&server->mutex);
+		if (result == REQUEST_CLOSE || server->isStopping)
+		{
+			removeConnection(server, conn);
+		}
+		else if (result == REQUEST_DONE && conn->in.length)
+		{
+			queueConnection(server, conn);
+		}
+		else
+		{
+			conn->state = CONNECTION_IDLE;
+			wakePollLoop(server);
+		}
+	}
+	pthread_mutex_unlock(&server->mutex);
+}
+
+/* A job of the thread pool - the poll loop, which accepts the connections and queues the ones with a request. */
+/* When the server stops, it closes the connections that aren't served. */
+void serverPollJob(assemblerServer *server)
+{
+	struct pollfd *fds = NULL, *newFds;
+	serverConnection **polled = NULL, **newPolled;
+	int fdsCapacity = 0, polledCapacity = 0, numOfFds, fd, i;
+	char drain[64];
+
+	pthread_mutex_lock(&server->mutex);
+	while (!server->isStopping)
+	{
+		/* The wake pipe, the listening socket and the idle connections */
+		newFds = (struct pollfd *)reserveArray(fds, &fdsCapacity, server->numOfConnections + 2, sizeof(struct pollfd));
+		fds = newFds ? newFds : fds;
+		newPolled = (serverConnection **)reserveArray(polled, &polledCapacity, server->numOfConnections + 2, sizeof(serverConnection *));
+		polled = newPolled ? newPolled : polled;
+		if (!newFds || !newPolled)
+		{
+			printf("[Error] Not enough memory - malloc falied.\n");
+			break;
+		}
+		fds[0].fd = server->wakeFds[0];
+		fds[1].fd = server->listenFd;
+		numOfFds = 2;
+		for (i = 0; i < server->numOfConnections; i++)
+		{
+			if (server->connections[i]->state == CONNECTION_IDLE)
+			{
+				polled[numOfFds] = server->connections[i];
+				fds[numOfFds++].fd = server->connections[i]->fd;
+			}
+		}
+		for (i = 0; i < numOfFds; i++)
+		{
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		pthread_mutex_unlock(&server->mutex);
+
+		if (poll(fds, numOfFds, -1) == -1 && errno != EINTR)
+		{
+			pthread_mutex_lock(&server->mutex);
+			break;
+		}
+		if (fds[0].revents)
+		{
+			while (read(server->wakeFds[0], drain, sizeof(drain)) == (ssize_t)sizeof(drain))
+			{
+				continue;
+			}
+		}
+
+		/* Accept all the waiting connections (the listening socket doesn't block) */
+		while (fds[1].revents && (fd = accept(server->listenFd, NULL, NULL)) != -1)
+		{
+			if (!setNonBlocking(fd) || !addConnection(server, fd))
+			{
+				close(fd);
+			}
+		}
+
+		/* A connection with bytes to read (or that was closed) is served by a worker */
+		pthread_mutex_lock(&server->mutex);
+		for (i = 2; i < numOfFds; i++)
+		{
+			if (fds[i].revents && polled[i]->state == CONNECTION_IDLE)
+			{
+				queueConnection(server, polled[i]);
+			}
+		}
+	}
+
+	/* The connections that wait (idle or queued) are closed, the served ones are closed by their workers */
+	server->isStopping = TRUE;
+	server->queueHead = server->queueTail = NULL;
+	for (i = server->numOfConnections - 1; i >= 0; i--)
+	{
+		if (server->connections[i]->state != CONNECTION_BUSY)
+		{
+			removeConnection(server, server->connections[i]);
+		}
+	}
+	pthread_cond_broadcast(&server->queueCond);
+	pthread_mutex_unlock(&server->mutex);
+
+	free(fds);
+	free(polled);
+}
+
+/* A job of the thread pool - job 0 is the poll loop, and the others are the workers. */
+void serverJob(int jobId, int workerId, void *arg)
+{
+	assemblerServer *server = (assemblerServer *)arg;
+
+	if (jobId == 0)
+	{
+		serverPollJob(server);
+	}
+	else
+	{
+		serverWorkerJob(server, &server->workers[jobId - 1]);
+	}
+}
+
+/* Returns if a server is listening on the socket at a path. */
+bool isSocketInUse(struct sockaddr_un *address)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	bool inUse;
+
+	if (fd == -1)
+	{
+		return FALSE;
+	}
+	inUse = connect(fd, (struct sockaddr *)address, sizeof(*address)) == 0;
+	close(fd);
+	return inUse;
+}
+
+/* Closes the listening socket and the wake pipe of a server, and removes the socket file (if socketPath isn't NULL). */
+void closeServerFds(assemblerServer *server, char *socketPath)
+{
+	if (server->listenFd != -1)
+	{
+		close(server->listenFd);
+	}
+	if (socketPath)
+	{
+		unlink(socketPath);
+	}
+	if (server->wakeFds[0] != -1)
+	{
+		close(server->wakeFds[0]);
+		close(server->wakeFds[1]);
+	}
+}
+
+/* Runs the assembler server on the Unix domain socket at socketPath, with numOfWorkers workers (and a thread for the poll loop). */
+/* The file requests use cacheDir (NULL if there is no cache), and all the requests create the .am outputs */
+/* with writeExpandedSource and the binary objects with writeBinaryObject. Returns the exit code of the process. */
+int runAssemblerServer(char *socketPath, int numOfWorkers, char *cacheDir, bool writeExpandedSource, bool writeBinaryObject)
+{
+	assemblerServer server;
+	struct sockaddr_un address;
+	struct stat info;
+	int i;
+
+	if (strlen(socketPath) >= sizeof(address.sun_path))
+	{
+		printf("[Info] The socket path \"%s\" is too long.\n", socketPath);
+		return 1;
+	}
+	memset(&server, 0, sizeof(server));
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+
+	/* A socket left by a server that stopped is replaced, but not a running server's socket or another file */
+	if (stat(socketPath, &info) == 0)
+	{
+		if (!S_ISSOCK(info.st_mode) || isSocketInUse(&address))
+		{
+			printf("[Info] Can't use \"%s\" - it's %s.\n", socketPath, S_ISSOCK(info.st_mode) ? "in use by a running server" : "not a socket");
+			return 1;
+		}
+		unlink(socketPath);
+	}
+
+	/* The poll loop waits on the listening socket and the wake pipe, so none of them blocks */
+	server.wakeFds[0] = server.wakeFds[1] = -1;
+	server.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server.listenFd == -1 || bind(server.listenFd, (struct sockaddr *)&address, sizeof(address)) != 0
+		|| listen(server.listenFd, SOMAXCONN) != 0 || !setNonBlocking(server.listenFd)
+		|| pipe(server.wakeFds) != 0 || !setNonBlocking(server.wakeFds[0]) || !setNonBlocking(server.wakeFds[1]))
+	{
+		printf("[Info] Can't listen on the socket \"%s\" (%s).\n", socketPath, strerror(errno));
+		closeServerFds(&server, NULL);
+		return 1;
+	}
+
+	server.cacheDir = cacheDir;
+	server.workers = (serverWorker *)calloc(numOfWorkers, sizeof(serverWorker));
+	if (!server.workers)
+	{
+		printf("[Error] Not enough memory - malloc falied.\n");
+		closeServerFds(&server, socketPath);
+		return 1;
+	}
+	pthread_mutex_init(&server.mutex, NULL);
+	pthread_cond_init(&server.queueCond, NULL);
+	for (i = 0; i < numOfWorkers; i++)
+	{
+		initContext(&server.workers[i].ctx);
+		server.workers[i].ctx.keepExpandedSource = writeExpandedSource;
+		server.workers[i].ctx.createBinaryObject = writeBinaryObject;
+	}
+
+	/* A client that closes its connection before the reply doesn't stop the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("[Info] The assembler server is listening on \"%s\" with %d worker%s.\n", socketPath, numOfWorkers, numOfWorkers > 1 ? "s" : "");
+	fflush(stdout);
+	runJobs(numOfWorkers + 1, numOfWorkers + 1, serverJob, &server);
+
+	closeServerFds(&server, socketPath);
+	for (i = 0; i < numOfWorkers; i++)
+	{
+		freeContext(&server.workers[i].ctx);
+		free(server.workers[i].report.data);
+		free(server.workers[i].reply.data);
+	}
+	pthread_cond_destroy(&server.queueCond);
+	pthread_mutex_destroy(&server.mutex);
+	free(server.connections);
+	free(server.workers);
+	printf("[Info] The assembler server stopped.\n");
+	return 0;
+}
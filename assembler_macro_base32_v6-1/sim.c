@@ -0,0 +1,404 @@
+/*
+The simulator tool.
+Runs the memory image of each file name in argv (its .ob file, or its .obj file with -b) on the simulator,
+prints the numbers it printed, and reports how it stopped and how many instructions per second were run.
+With -j the images run on the JIT (see jit.c), when the host supports it.
+With -p the images run on the interpreter with the profile counters, and the report of each one is written
+to file.prof (see profile.c), with the labels and the lines of file.as when it's the source of the image.
+With -v the image runs once for each line of a vectors file, with the numbers of the line as its input, and the
+result of each run is reported on its own line. With -l too, the runs are run together on the lockstep simulator
+(see lockstep.c), SIM_LANES runs at a time.
+An image with extern labels isn't complete, so it has to be linked first (see linker.c).
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/* ======== Macros ======== */
+#define DEFAULT_MAX_STEPS	100000000UL
+
+/* ======== Data Structures ======== */
+
+/* The options from the command line */
+typedef struct
+{
+	bool binaryInput;			/* Run the .obj files instead of the .ob files */
+	int repeats;				/* How many times each image is run (the best time is taken) */
+	unsigned long maxSteps;		/* The max instructions of a run */
+	char *inputFile;			/* The numbers read by get (NULL if there aren't) */
+	bool printOutput;			/* Print the numbers printed by prn */
+	simJit *jit;				/* Run on the JIT (NULL runs on the interpreter) */
+	bool profile;				/* Count the instructions, and write the profile reports */
+	sourceReader *vectors;		/* The input of each run (the lines of the vectors file), or NULL to run once */
+	int numOfVectors;
+	bool lockstep;				/* Run the vectors on the lockstep simulator */
+} simOptions;
+
+/* ====== Methods ====== */
+
+/* Returns if a source was assembled into the image of 'header' (so its labels and lines are the image's). */
+bool isSourceOfImage(assemblerContext *ctx, const objectHeader *header)
+{
+	const unsigned short *words = (const unsigned short *)((const char *)header + header->wordsOffset);
+	int i;
+
+	if (ctx->IC != header->IC || ctx->DC != header->DC)
+	{
+		return FALSE;
+	}
+	for (i = 0; i < ctx->IC + ctx->DC; i++)
+	{
+		if ((ctx->memoryArr[i] & WORD_MASK) != (words[i] & WORD_MASK))
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* Writes the profile of the last run of the image of a file name to file.prof. */
+void writeProfile(char *fileName, const objectHeader *header, simMachine *machine, textBuffer *report)
+{
+	assemblerContext ctx;
+	textBuffer source = { 0 }, out = { 0 };
+	bool hasSource;
+
+	initContext(&ctx);
+	ctx.keepExpandedSource = TRUE;
+	readTextFile(fileName, ".as", &source);
+	hasSource = source.length > 0 && assemble(source.data, source.length, &ctx) == 0 && isSourceOfImage(&ctx, header);
+	if (!hasSource)
+	{
+		appendFormat(report, "[Info] \"%s.as\" isn't the source of the image - the profile has only addresses.\n", fileName);
+	}
+
+	appendProfile(&out, machine, fileName, hasSource ? &ctx : NULL);
+	writeFile(fileName, ".prof", &out, report);
+
+	freeContext(&ctx);
+	free(source.data);
+	free(out.data);
+}
+
+/* Splits a text into its lines (the last line may end without a new line). Returns the number of lines. */
+int splitLines(textBuffer *text, sourceReader **lines)
+{
+	const char *pos = text->data, *end = text->data + text->length;
+	int numOfLines = 0;
+
+	*lines = (sourceReader *)malloc((text->length + 1) * sizeof(sourceReader));
+	if (!*lines)
+	{
+		return 0;
+	}
+	while (pos < end)
+	{
+		(*lines)[numOfLines].pos = pos;
+		while (pos < end && *pos != '\n')
+		{
+			pos++;
+		}
+		(*lines)[numOfLines++].end = pos;
+		pos += pos < end;
+	}
+	return numOfLines;
+}
+
+/* Adds the result of the run of an input vector to the report, with the numbers it printed on the same line. */
+void appendVectorResult(textBuffer *report, char *fileName, int vector, simResult result, int pc, unsigned long steps, textBuffer *output, bool printOutput)
+{
+	size_t i;
+
+	appendFormat(report, "[Info] \"%s\" input %d %s at %d after %lu instructions", fileName, vector + 1, getSimResultText(result), pc, steps);
+	if (printOutput)
+	{
+		appendText(report, ":", 1);
+		for (i = 0; i < output->length; i++)
+		{
+			if (i == 0 || output->data[i - 1] == '\n')
+			{
+				appendText(report, " ", 1);
+			}
+			if (output->data[i] != '\n')
+			{
+				appendText(report, &output->data[i], 1);
+			}
+		}
+	}
+	appendText(report, "\n", 1);
+}
+
+/* Runs an image once for each input vector (on its own, or in lockstep), and adds the results to the report. */
+/* Returns if all the runs halted. */
+bool runVectors(char *fileName, const objectHeader *header, simOptions *options, simMachine *machine, lockstepMachine *lockstep, textBuffer *report)
+{
+	size_t reportStart = report->length;
+	unsigned long totalSteps = 0;
+	double start, runTime, bestTime = 0;
+	int i, first, lanes, l, halted = 0;
+	simResult result;
+
+	for (i = 0; i < options->repeats; i++)
+	{
+		report->length = reportStart;
+		totalSteps = 0;
+		halted = 0;
+		start = getTime();
+		for (first = 0; first < options->numOfVectors; first += lanes)
+		{
+			if (options->lockstep)
+			{
+				lanes = options->numOfVectors - first < SIM_LANES ? options->numOfVectors - first : SIM_LANES;
+				loadLockstep(lockstep, header, &options->vectors[first], lanes);
+				runLockstep(lockstep, options->maxSteps);
+				for (l = 0; l < lanes; l++)
+				{
+					appendVectorResult(report, fileName, first + l, lockstep->result[l], lockstep->pc[l], lockstep->steps[l],
+						&lockstep->output[l], options->printOutput);
+					totalSteps += lockstep->steps[l];
+					halted += lockstep->result[l] == SIM_HALTED;
+				}
+			}
+			else
+			{
+				lanes = 1;
+				loadMachine(machine, header);
+				machine->input = options->vectors[first];
+				result = runMachine(machine, options->maxSteps);
+				appendVectorResult(report, fileName, first, result, machine->pc, machine->steps, &machine->output, options->printOutput);
+				totalSteps += machine->steps;
+				halted += result == SIM_HALTED;
+			}
+		}
+		runTime = getTime() - start;
+		if (i == 0 || runTime < bestTime)
+		{
+			bestTime = runTime;
+		}
+	}
+
+	appendFormat(report, "[Info] \"%s\" ran %d inputs%s, %d halted, %lu instructions in %.3f seconds (%.0f instructions per second).\n",
+		fileName, options->numOfVectors, options->lockstep ? " in lockstep" : "", halted, totalSteps, bestTime,
+		bestTime > 0 ? totalSteps / bestTime : 0.0);
+	return halted == options->numOfVectors;
+}
+
+/* Runs the image of a file name, and adds the results to the report. Returns if the image halted. */
+bool runFile(char *fileName, simOptions *options, simMachine *machine, lockstepMachine *lockstep, textBuffer *input, textBuffer *buffers, textBuffer *report)
+{
+	const objectHeader *header;
+	const char *content;
+	size_t length;
+	bool isMapped, isHalted = FALSE;
+	simResult result = SIM_HALTED;
+	double start, runTime, bestTime = 0;
+	int i;
+
+	header = loadImage(fileName, options->binaryInput, &buffers[0], &buffers[1], &buffers[2], &content, &length, &isMapped, report);
+	if (header && options->vectors)
+	{
+		isHalted = runVectors(fileName, header, options, machine, lockstep, report);
+	}
+	else if (header)
+	{
+		for (i = 0; i < options->repeats; i++)
+		{
+			loadMachine(machine, header);
+			machine->input.pos = input->data;
+			machine->input.end = input->data + input->length;
+
+			start = getTime();
+			if (options->jit && !options->profile)
+			{
+				flushJit(options->jit);
+				result = runJit(options->jit, machine, options->maxSteps);
+			}
+			else
+			{
+				result = runMachine(machine, options->maxSteps);
+			}
+			runTime = getTime() - start;
+			if (i == 0 || runTime < bestTime)
+			{
+				bestTime = runTime;
+			}
+		}
+
+		if (options->printOutput)
+		{
+			appendText(report, machine->output.data, machine->output.length);
+		}
+		appendFormat(report, "[Info] \"%s\" %s at %d after %lu instructions (%.0f instructions per second).\n",
+			fileName, getSimResultText(result), machine->pc, machine->steps, bestTime > 0 ? machine->steps / bestTime : 0.0);
+		if (options->profile)
+		{
+			writeProfile(fileName, header, machine, report);
+		}
+		else if (options->jit)
+		{
+			appendFormat(report, "[Info] The JIT compiled %d blocks, and threw its code away %d times.\n",
+				options->jit->numOfBlocks, options->jit->numOfFlushes);
+		}
+		isHalted = result == SIM_HALTED;
+	}
+
+	if (content)
+	{
+		releaseFile(content, length, isMapped);
+	}
+	return isHalted;
+}
+
+/* Main method. Runs the image of each file name in argv. */
+int main(int argc, char *argv[])
+{
+	textBuffer input = { 0 }, vectors = { 0 }, report = { 0 };
+	textBuffer buffers[3] = { { 0 } }; /* The .ob file, the .ext file and the binary object */
+	simOptions options;
+	simMachine *machine;
+	lockstepMachine *lockstep = NULL;
+	char *vectorsFile = NULL;
+	int i, failed = 0;
+	bool useJit = FALSE;
+
+	options.binaryInput = FALSE;
+	options.repeats = 1;
+	options.maxSteps = DEFAULT_MAX_STEPS;
+	options.inputFile = NULL;
+	options.printOutput = TRUE;
+	options.jit = NULL;
+	options.profile = FALSE;
+	options.vectors = NULL;
+	options.numOfVectors = 0;
+	options.lockstep = FALSE;
+
+	/* Read the options */
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (strcmp(argv[i], "-b") == 0)
+		{
+			options.binaryInput = TRUE;
+		}
+		else if (strcmp(argv[i], "-j") == 0)
+		{
+			useJit = TRUE;
+		}
+		else if (strcmp(argv[i], "-l") == 0)
+		{
+			options.lockstep = TRUE;
+		}
+		else if (strcmp(argv[i], "-p") == 0)
+		{
+			options.profile = TRUE;
+		}
+		else if (strcmp(argv[i], "-q") == 0)
+		{
+			options.printOutput = FALSE;
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+		{
+			options.repeats = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+		{
+			options.maxSteps = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+		{
+			options.inputFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+		{
+			vectorsFile = argv[++i];
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (i >= argc || argv[i][0] == '-')
+	{
+		printf("[Info] Usage: %s [-b] [-j] [-p] [-q] [-r repeats] [-s max-steps] [-i input-file] [-v vectors-file [-l]] file...\n", argv[0]);
+		printf("[Info] Runs file.ob (-b runs file.obj). -j runs on the JIT. -p writes the profile to file.prof. -q doesn't print the numbers the program printed.\n");
+		printf("[Info] -v runs each file once for each line of vectors-file (its input), and -l runs them in lockstep.\n");
+		return 1;
+	}
+
+	if (options.inputFile)
+	{
+		readTextFile(options.inputFile, "", &input);
+	}
+	if (vectorsFile)
+	{
+		readTextFile(vectorsFile, "", &vectors);
+		options.numOfVectors = splitLines(&vectors, &options.vectors);
+		if (!options.vectors)
+		{
+			printf("[Error] Not enough memory - malloc falied.\n");
+			return 1;
+		}
+	}
+	machine = (simMachine *)calloc(1, sizeof(simMachine));
+	if (options.vectors && options.lockstep)
+	{
+		lockstep = (lockstepMachine *)calloc(1, sizeof(lockstepMachine));
+	}
+	if (!machine || (options.vectors && options.lockstep && !lockstep))
+	{
+		printf("[Error] Not enough memory - malloc falied.\n");
+		return 1;
+	}
+	if (options.profile)
+	{
+		machine->profile = (simProfile *)malloc(sizeof(simProfile));
+		if (!machine->profile)
+		{
+			printf("[Error] Not enough memory - malloc falied.\n");
+			return 1;
+		}
+	}
+	if (useJit)
+	{
+		options.jit = createJit();
+		if (!options.jit)
+		{
+			printf("[Info] The JIT isn't supported on this host - running on the interpreter.\n");
+		}
+	}
+
+	for (; i < argc; i++)
+	{
+		if (!runFile(argv[i], &options, machine, lockstep, &input, buffers, &report))
+		{
+			failed++;
+		}
+		fwrite(report.data, 1, report.length, stdout);
+		report.length = 0;
+	}
+
+	freeJit(options.jit);
+	free(machine->profile);
+	free(machine->output.data);
+	free(machine);
+	if (lockstep)
+	{
+		for (i = 0; i < SIM_LANES; i++)
+		{
+			free(lockstep->output[i].data);
+		}
+		free(lockstep);
+	}
+	free(options.vectors);
+	free(vectors.data);
+	free(input.data);
+	for (i = 0; i < 3; i++)
+	{
+		free(buffers[i].data);
+	}
+	free(report.data);
+	return failed ? 1 : 0;
+}
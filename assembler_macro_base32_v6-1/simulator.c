@@ -0,0 +1,415 @@
+/*
+The simulator of the 10 bits machine.
+The memory image is predecoded into an instruction for each address, with its operands resolved into pointers
+(to a register, to a memory word, or to an immediate value in the instruction), so running an instruction
+never decodes its words again.
+With GCC the instructions are dispatched with computed gotos (threaded code), and with a switch otherwise
+(or when SIM_SWITCH_DISPATCH is defined). The labels as values are a GNU extension, so this file is compiled
+without -pedantic.
+
+The machine:
+- The image is loaded at FIRST_ADDRESS, and it starts to run from there. The registers and the other words are 0.
+- The words and the registers are 10 bits. prn prints a word as a signed number, get reads a signed number.
+- An immediate operand is the signed 8 bits number in its word. A direct (label) operand is the word at the
+  8 bits address in its word. A struct operand word is run like a direct operand too, but the assembler
+  leaves its address at 0 (the struct and the field aren't encoded), so it reads and writes the word at
+  address 0. Only the word of an extern struct operand holds an address, after the linker patches it.
+- cmp sets the zero flag if the source minus the destination is 0, and bne jumps if the zero flag isn't set.
+- jmp, bne and jsr jump to the address in a direct operand, or to the value of a register.
+- jsr keeps the return address in a stack of SIM_STACK_SIZE addresses, and rst returns to it.
+A write to a memory word decodes the instructions that may use the word again when they run.
+When machine->profile isn't NULL, each instruction is counted before it runs, and a jump is counted when the
+next instruction isn't at the address after it (see profile.c for the report).
+*/
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <stdlib.h>
+
+/* ======== Macros ======== */
+#if defined(__GNUC__) && !defined(SIM_SWITCH_DISPATCH)
+	#define SIM_THREADED
+#endif
+
+/* ====== Externs ====== */
+/* Use the commands list from firstRead.c */
+extern const command g_cmdArr[];
+
+/* ====== Methods ====== */
+
+/* Resolves the operand of an instruction in the word at 'address' into *value. Returns if it's a legal operand. */
+/* 'imm' keeps an immediate value, and 'dirty' gets the slots to decode again when a direct operand is written. */
+bool decodeOperand(simMachine *machine, int address, opType mode, bool isDest, int **value, int *imm, int *dirty)
+{
+	int word, reg;
+
+	if (address >= MEMORY_SIZE)
+	{
+		return FALSE;
+	}
+	word = machine->memory[address];
+
+	switch (mode)
+	{
+	case NUMBER:
+		*imm = SIGN_EXTEND(word >> ERA_BITS, MEMORY_WORD_LENGTH - ERA_BITS) & WORD_MASK;
+		*value = imm;
+		return TRUE;
+
+	case LABEL:
+	case STRUCT:
+		*value = &machine->memory[word >> ERA_BITS];
+		if (isDest)
+		{
+			/* The instructions that may have the word as an operand start up to 2 words before it */
+			*dirty = SIM_SLOT((word >> ERA_BITS) - 2);
+		}
+		return TRUE;
+
+	default:
+		reg = (word >> (isDest ? ERA_BITS : ERA_BITS + 4)) & 0xF;
+		if (reg >= NUM_OF_REGISTERS)
+		{
+			return FALSE;
+		}
+		*value = &machine->registers[reg];
+		return TRUE;
+	}
+}
+
+/* Decodes the instruction at 'address' into its slot (a SIM_BAD_INSTRUCTION if it isn't a legal instruction). */
+void decodeInstruction(simMachine *machine, int address)
+{
+	simInstruction *ins = &machine->slots[SIM_SLOT(address)];
+	int word = machine->memory[address], next = address + 1;
+	int opcode = word >> (ERA_BITS + 4), numOfParams = g_cmdArr[opcode].numOfParams;
+	opType srcMode = (opType)((word >> (ERA_BITS + 2)) & 3), dstMode = (opType)((word >> ERA_BITS) & 3);
+	bool isLegal = (word & ((1 << ERA_BITS) - 1)) == ABSOLUTE;
+
+	ins->op = SIM_BAD_INSTRUCTION;
+	ins->dirty = SIM_SCRATCH_SLOT;
+	if (numOfParams == 2)
+	{
+		isLegal = isLegal && (g_cmdArr[opcode].srcTypes & OP_TYPE_BIT(srcMode)) && (g_cmdArr[opcode].destTypes & OP_TYPE_BIT(dstMode));
+	}
+	else if (numOfParams == 1)
+	{
+		isLegal = isLegal && (g_cmdArr[opcode].destTypes & OP_TYPE_BIT(dstMode));
+	}
+
+	/* Two registers share one word */
+	if (isLegal && numOfParams == 2 && srcMode == REGISTER && dstMode == REGISTER)
+	{
+		isLegal = decodeOperand(machine, next, REGISTER, FALSE, &ins->src, &ins->imm[0], &ins->dirty)
+			&& decodeOperand(machine, next, REGISTER, TRUE, &ins->dst, &ins->imm[1], &ins->dirty);
+		next++;
+	}
+	else
+	{
+		if (isLegal && numOfParams == 2)
+		{
+			isLegal = decodeOperand(machine, next++, srcMode, FALSE, &ins->src, &ins->imm[0], &ins->dirty);
+		}
+		if (isLegal && numOfParams >= 1)
+		{
+			isLegal = decodeOperand(machine, next++, dstMode, TRUE, &ins->dst, &ins->imm[1], &ins->dirty);
+		}
+	}
+	if (!isLegal)
+	{
+		return;
+	}
+
+	/* lea takes the address of its source, and the jumps take the address of their destination */
+	if (opcode == SIM_LEA)
+	{
+		ins->imm[0] = (int)(ins->src - machine->memory);
+		ins->src = &ins->imm[0];
+	}
+	if ((opcode == SIM_JMP || opcode == SIM_BNE || opcode == SIM_JSR) && dstMode != REGISTER)
+	{
+		ins->imm[1] = (int)(ins->dst - machine->memory);
+		ins->dst = &ins->imm[1];
+	}
+
+	ins->op = opcode;
+	ins->next = next;
+}
+
+/* Marks all the addresses to be decoded when they run (the addresses after the memory can't be run). */
+void invalidateSlots(simMachine *machine)
+{
+	int i;
+
+	for (i = 0; i < SIM_SLOTS; i++)
+	{
+		machine->slots[i].op = (i >= SIM_SLOT(0) && i < SIM_SLOT(MEMORY_SIZE)) ? SIM_DECODE : SIM_BAD_ADDRESS;
+	}
+}
+
+/* Loads a memory image (checked by loadBinaryObject) into the machine, and predecodes its code. */
+/* The registers, the flag, the stack and the output are cleared, and the input is kept. */
+void loadMachine(simMachine *machine, const objectHeader *header)
+{
+	const unsigned short *words = (const unsigned short *)((const char *)header + header->wordsOffset);
+	int i;
+
+	memset(machine->memory, 0, sizeof(machine->memory));
+	for (i = 0; i < header->IC + header->DC; i++)
+	{
+		machine->memory[FIRST_ADDRESS + i] = words[i] & WORD_MASK;
+	}
+	memset(machine->registers, 0, sizeof(machine->registers));
+	if (machine->profile)
+	{
+		memset(machine->profile, 0, sizeof(simProfile));
+	}
+	machine->zeroFlag = FALSE;
+	machine->pc = FIRST_ADDRESS;
+	machine->stackSize = 0;
+	machine->steps = 0;
+	machine->output.length = 0;
+
+	/* The other addresses are decoded when they are run */
+	invalidateSlots(machine);
+	for (i = 0; i < header->IC; i++)
+	{
+		decodeInstruction(machine, FIRST_ADDRESS + i);
+	}
+}
+
+/* Reads the next number of the input (0 if there are no more numbers). */
+int readInputNumber(sourceReader *input)
+{
+	int sign = 1, num = 0;
+
+	while (input->pos < input->end && !(*input->pos == '-' || (*input->pos >= '0' && *input->pos <= '9')))
+	{
+		input->pos++;
+	}
+	if (input->pos < input->end && *input->pos == '-')
+	{
+		sign = -1;
+		input->pos++;
+	}
+	while (input->pos < input->end && *input->pos >= '0' && *input->pos <= '9')
+	{
+		num = (num * 10 + (*input->pos++ - '0')) & WORD_MASK;
+	}
+
+	return (sign * num) & WORD_MASK;
+}
+
+/* Runs the machine from machine->pc until it stops, or until it runs maxSteps instructions. */
+/* machine->pc is left at the instruction that stopped it. */
+simResult runMachine(simMachine *machine, unsigned long maxSteps)
+{
+	simInstruction *slots = machine->slots, *ins, *prev = NULL;
+	simProfile *profile = machine->profile;
+	int pc = machine->pc, prevPc = 0;
+	unsigned long stepsLeft = maxSteps;
+	simResult result;
+
+#ifdef SIM_THREADED
+	/* The code of each operation, in the order of the opcodes and simOp */
+	static const void *handlers[NUM_OF_SIM_OPS] =
+	{
+		&&opMov, &&opCmp, &&opAdd, &&opSub, &&opNot, &&opClr, &&opLea, &&opInc,
+		&&opDec, &&opJmp, &&opBne, &&opGet, &&opPrn, &&opJsr, &&opRst, &&opHlt,
+		&&opDecode, &&opBadInstruction, &&opBadAddress
+	};
+	/* A profiled run counts each instruction before it runs */
+	static const void *profileHandlers[NUM_OF_SIM_OPS] =
+	{
+		&&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile,
+		&&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile, &&opProfile,
+		&&opProfile, &&opProfile, &&opProfile
+	};
+	const void **table = profile ? profileHandlers : handlers;
+
+	#define SIM_CASE(label, op)	label:
+	#define SIM_DISPATCH()		goto *table[ins->op]
+	#define SIM_RUN()			goto *handlers[ins->op]
+#else
+	#define SIM_CASE(label, op)	case op:
+	#define SIM_DISPATCH()		goto dispatch
+	#define SIM_RUN()			goto run
+#endif
+
+	/* Runs the instruction at pc (when there are steps left) */
+	#define SIM_NEXT()			do { ins = &slots[SIM_SLOT(pc)]; if (stepsLeft-- == 0) goto stepLimit; SIM_DISPATCH(); } while (0)
+	/* Counts the instruction at pc, and the jump of the instruction before it */
+	#define SIM_PROFILE()		do { profile->runs[SIM_SLOT(pc)]++; if (prev && prev->next != pc) profile->taken[SIM_SLOT(prevPc)]++; prev = ins; prevPc = pc; } while (0)
+	/* Writes the destination, and decodes the instructions that may use it again when they run */
+	#define SIM_WRITE(value)	do { *ins->dst = (value) & WORD_MASK; slots[ins->dirty].op = SIM_DECODE; slots[ins->dirty + 1].op = SIM_DECODE; slots[ins->dirty + 2].op = SIM_DECODE; } while (0)
+
+	ins = &slots[SIM_SLOT(pc)];
+	if (stepsLeft-- == 0)
+	{
+		goto stepLimit;
+	}
+
+#ifdef SIM_THREADED
+	SIM_DISPATCH();
+
+opProfile:
+	SIM_PROFILE();
+	SIM_RUN();
+#else
+dispatch:
+	if (profile)
+	{
+		SIM_PROFILE();
+	}
+run:
+	switch (ins->op)
+	{
+#endif
+
+	SIM_CASE(opMov, SIM_MOV)
+		SIM_WRITE(*ins->src);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opCmp, SIM_CMP)
+		machine->zeroFlag = ((*ins->src - *ins->dst) & WORD_MASK) == 0;
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opAdd, SIM_ADD)
+		SIM_WRITE(*ins->dst + *ins->src);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opSub, SIM_SUB)
+		SIM_WRITE(*ins->dst - *ins->src);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opNot, SIM_NOT)
+		SIM_WRITE(~*ins->dst);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opClr, SIM_CLR)
+		SIM_WRITE(0);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opLea, SIM_LEA)
+		SIM_WRITE(*ins->src);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opInc, SIM_INC)
+		SIM_WRITE(*ins->dst + 1);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opDec, SIM_DEC)
+		SIM_WRITE(*ins->dst - 1);
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opJmp, SIM_JMP)
+		pc = *ins->dst;
+		SIM_NEXT();
+
+	SIM_CASE(opBne, SIM_BNE)
+		pc = machine->zeroFlag ? ins->next : *ins->dst;
+		SIM_NEXT();
+
+	SIM_CASE(opGet, SIM_GET)
+		SIM_WRITE(readInputNumber(&machine->input));
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opPrn, SIM_PRN)
+		appendFormat(&machine->output, "%d\n", SIGN_EXTEND(*ins->dst, MEMORY_WORD_LENGTH));
+		pc = ins->next;
+		SIM_NEXT();
+
+	SIM_CASE(opJsr, SIM_JSR)
+		if (machine->stackSize == SIM_STACK_SIZE)
+		{
+			result = SIM_STACK_OVERFLOW;
+			goto stop;
+		}
+		machine->stack[machine->stackSize++] = ins->next;
+		pc = *ins->dst;
+		SIM_NEXT();
+
+	SIM_CASE(opRst, SIM_RST)
+		if (machine->stackSize == 0)
+		{
+			result = SIM_STACK_UNDERFLOW;
+			goto stop;
+		}
+		pc = machine->stack[--machine->stackSize];
+		SIM_NEXT();
+
+	SIM_CASE(opHlt, SIM_HLT)
+		result = SIM_HALTED;
+		goto stop;
+
+	SIM_CASE(opDecode, SIM_DECODE)
+		/* The decoded instruction runs in the step that was counted for this slot */
+		decodeInstruction(machine, pc);
+		SIM_RUN();
+
+	SIM_CASE(opBadInstruction, SIM_BAD_INSTRUCTION)
+		result = SIM_ILLEGAL_INSTRUCTION;
+		goto stop;
+
+	SIM_CASE(opBadAddress, SIM_BAD_ADDRESS)
+		result = SIM_ILLEGAL_ADDRESS;
+		goto stop;
+
+#ifndef SIM_THREADED
+	}
+#endif
+
+stepLimit:
+	result = SIM_STEP_LIMIT;
+
+stop:
+	/* hlt is a step, but an instruction that couldn't run isn't */
+	machine->steps += maxSteps - stepsLeft - (result == SIM_HALTED ? 0 : 1);
+	machine->pc = pc;
+	if (profile)
+	{
+		/* The jump to the instruction that wasn't run is counted, but the instruction isn't */
+		if (result == SIM_STEP_LIMIT && prev && prev->next != pc)
+		{
+			profile->taken[SIM_SLOT(prevPc)]++;
+		}
+		else if (result != SIM_HALTED && result != SIM_STEP_LIMIT)
+		{
+			profile->runs[SIM_SLOT(pc)]--;
+		}
+	}
+	return result;
+
+	#undef SIM_CASE
+	#undef SIM_DISPATCH
+	#undef SIM_RUN
+	#undef SIM_PROFILE
+	#undef SIM_NEXT
+	#undef SIM_WRITE
+}
+
+/* Returns a description of why the simulator stopped. */
+const char *getSimResultText(simResult result)
+{
+	switch (result)
+	{
+	case SIM_HALTED:				return "halted";
+	case SIM_STEP_LIMIT:			return "reached the steps limit";
+	case SIM_ILLEGAL_INSTRUCTION:	return "ran an illegal instruction";
+	case SIM_ILLEGAL_ADDRESS:		return "ran past the end of the memory";
+	case SIM_STACK_OVERFLOW:		return "called too many nested subroutines";
+	case SIM_STACK_UNDERFLOW:		return "returned without a call";
+	default:						return "ran out of time";
+	}
+}
@@ -0,0 +1,200 @@
+/*
+A work stealing thread pool.
+Runs a batch of independent jobs on a number of worker threads.
+Each worker starts with an equal range of the jobs, and when it runs out of jobs it steals
+half of the remaining range of another worker, so the load stays balanced without a shared queue.
+*/
+
+#define _POSIX_C_SOURCE 200112L /* For sysconf */
+
+/* ======== Includes ======== */
+#include "assembler.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* ====== Data Structures ====== */
+
+/* The jobs range of one worker. The owner takes jobs from the start, thieves take from the end. */
+typedef struct
+{
+	pthread_mutex_t mutex;
+	int next;					/* The next job to run */
+	int end;					/* The end of the range (not included) */
+} jobRange;
+
+/* The shared state of the pool */
+typedef struct
+{
+	jobRange *ranges;			/* One range for each worker */
+	int numOfWorkers;
+	jobFunc func;
+	void *arg;
+} threadPool;
+
+/* The argument of a worker thread */
+typedef struct
+{
+	threadPool *pool;
+	int workerId;
+} workerInfo;
+
+/* ====== Methods ====== */
+
+/* Returns the number of the online cores (at least 1). */
+int getNumOfCores()
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (cores > 0) ? (int)cores : 1;
+}
+
+/* Takes the next job from the worker's own range. Returns the job id, or -1 if the range is empty. */
+int takeOwnJob(jobRange *range)
+{
+	int jobId = -1;
+
+	pthread_mutex_lock(&range->mutex);
+	if (range->next < range->end)
+	{
+		jobId = range->next++;
+	}
+	pthread_mutex_unlock(&range->mutex);
+
+	return jobId;
+}
+
+/* Steals half of the remaining jobs of another worker into the worker's own range. */
+/* Returns if any job was stolen. */
+bool stealJobs(threadPool *pool, int workerId)
+{
+	int i, victimId, start = 0, end = 0;
+	jobRange *victim, *own = &pool->ranges[workerId];
+
+	/* Try the other workers, starting from the next one */
+	for (i = 1; i < pool->numOfWorkers && start == end; i++)
+	{
+		victimId = (workerId + i) % pool->numOfWorkers;
+		victim = &pool->ranges[victimId];
+
+		/* Take the upper half of the victim's range (the owner keeps working on the lower half) */
+		pthread_mutex_lock(&victim->mutex);
+		if (victim->next < victim->end)
+		{
+			start = victim->next + (victim->end - victim->next) / 2;
+			end = victim->end;
+			victim->end = start;
+		}
+		pthread_mutex_unlock(&victim->mutex);
+	}
+
+	if (start == end)
+	{
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&own->mutex);
+	own->next = start;
+	own->end = end;
+	pthread_mutex_unlock(&own->mutex);
+	return TRUE;
+}
+
+/* The main function of a worker thread. Runs jobs until no worker has jobs left. */
+void *workerMain(void *arg)
+{
+	workerInfo *info = (workerInfo *)arg;
+	threadPool *pool = info->pool;
+	int jobId;
+
+	FOREVER
+	{
+		jobId = takeOwnJob(&pool->ranges[info->workerId]);
+		if (jobId != -1)
+		{
+			pool->func(jobId, info->workerId, pool->arg);
+		}
+		else if (!stealJobs(pool, info->workerId))
+		{
+			/* All the ranges are empty, jobs are never added, so the work is done */
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Runs func(jobId, workerId, arg) for each job id in [0, numOfJobs) on numOfWorkers threads. */
+/* workerId is in [0, numOfWorkers), and a worker runs one job at a time. Returns when all the jobs are done. */
+void runJobs(int numOfJobs, int numOfWorkers, jobFunc func, void *arg)
+{
+	threadPool pool;
+	pthread_t *threads;
+	workerInfo *infos;
+	int i, started = 0;
+
+	if (numOfWorkers < 1)
+	{
+		numOfWorkers = 1;
+	}
+	if (numOfWorkers > numOfJobs)
+	{
+		numOfWorkers = numOfJobs > 0 ? numOfJobs : 1;
+	}
+
+	pool.numOfWorkers = numOfWorkers;
+	pool.func = func;
+	pool.arg = arg;
+	pool.ranges = (jobRange *)malloc(numOfWorkers * sizeof(jobRange));
+	threads = (pthread_t *)malloc(numOfWorkers * sizeof(pthread_t));
+	infos = (workerInfo *)malloc(numOfWorkers * sizeof(workerInfo));
+
+	if (!pool.ranges || !threads || !infos)
+	{
+		/* Not enough memory for the pool - run the jobs on this thread */
+		for (i = 0; i < numOfJobs; i++)
+		{
+			func(i, 0, arg);
+		}
+		free(pool.ranges);
+		free(threads);
+		free(infos);
+		return;
+	}
+
+	/* Split the jobs into equal ranges */
+	for (i = 0; i < numOfWorkers; i++)
+	{
+		pthread_mutex_init(&pool.ranges[i].mutex, NULL);
+		pool.ranges[i].next = (int)((long)numOfJobs * i / numOfWorkers);
+		pool.ranges[i].end = (int)((long)numOfJobs * (i + 1) / numOfWorkers);
+		infos[i].pool = &pool;
+		infos[i].workerId = i;
+	}
+
+	/* Worker 0 is the calling thread */
+	for (i = 1; i < numOfWorkers; i++)
+	{
+		if (pthread_create(&threads[i], NULL, workerMain, &infos[i]) != 0)
+		{
+			/* The jobs of a worker that didn't start are stolen by the others */
+			break;
+		}
+		started = i;
+	}
+	workerMain(&infos[0]);
+
+	for (i = 1; i <= started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	for (i = 0; i < numOfWorkers; i++)
+	{
+		pthread_mutex_destroy(&pool.ranges[i].mutex);
+	}
+	free(pool.ranges);
+	free(threads);
+	free(infos);
+}
@@ -10,208 +10,345 @@ This file contains utility parsing functions, mainly for the first read.
 
 /* ====== Methods ====== */
 extern const command g_cmdArr[];
-extern labelInfo g_labelArr[];
-extern int g_labelNum;
-lineInfo *g_entryLines[MAX_LABELS_NUM];
-extern int g_entryLabelsNum;
-FILE *openFile(char *name, char *ending, const char *mode);
-bool readLine(FILE *file, char *buf, size_t maxLength);
+extern const signed char g_cmdHash[CMD_HASH_SIZE];
+extern const directive g_dircArr[];
+extern const signed char g_dircHash[DIRC_HASH_SIZE];
 
+/* Returns the hash of the first 'length' chars of name (FNV-1a). */
+unsigned int hashName(const char *name, size_t length)
+{
+	unsigned int hash = 2166136261u;
+
+	while (length--)
+	{
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Returns the name of the label with 'labelId' id in ctx->labelArr. */
+const char *getLabelName(assemblerContext *ctx, int labelId)
+{
+	return ctx->labelArr[labelId].name;
+}
+
+/* Returns the name of the entry label with 'entryId' id in ctx->entryLines. */
+const char *getEntryName(assemblerContext *ctx, int entryId)
+{
+	return ctx->linesArr[ctx->entryLines[entryId]].lineStr;
+}
 
+/* Returns the name of the macro with 'macroId' id in ctx->macroArr. */
+const char *getMacroName(assemblerContext *ctx, int macroId)
+{
+	return ctx->macroArr[macroId].name;
+}
 
-/* Returns a pointer to the label with 'labelName' name in g_labelArr or NULL if there isn't such label. */
-labelInfo *getLabel(char *labelName)
+/* Returns the slot of 'name' (of 'length' chars, not '\0' terminated) in the open addressing 'index', */
+/* or the empty slot where it should be added. 'getName' returns the name of the id stored in a slot. */
+int findIndexSlot(assemblerContext *ctx, const int *index, int indexSize, const char *name, size_t length, const char *(*getName)(assemblerContext *, int))
 {
-	int i = 0;
+	int slot = hashName(name, length) & (indexSize - 1);
+	const char *slotName;
 
-	if (labelName)
+	/* Linear probing until the name or an empty slot is found */
+	while (index[slot] && (slotName = getName(ctx, index[slot] - 1), strncmp(name, slotName, length) != 0 || slotName[length] != '\0'))
 	{
-		for (i = 0; i < g_labelNum; i++)
-		{
-			if (strcmp(labelName, g_labelArr[i].name) == 0)
-			{
-				return &g_labelArr[i];
-			}
-		}
+		slot = (slot + 1) & (indexSize - 1);
 	}
-	return NULL;
+	return slot;
 }
 
-/* Returns the ID of the command with 'cmdName' name in g_cmdArr or -1 if there isn't such command. */
-int getCmdId(char *cmdName)
+/* Makes sure the hash index has at least twice the slots than 'count' ids. */
+/* If it doesn't, the index is rebuilt in a bigger size with the ids [0, count - 1). Returns if it succeeded. */
+bool reserveIndex(assemblerContext *ctx, int **index, int *indexSize, int count, const char *(*getName)(assemblerContext *, int))
 {
-	int i = 0;
+	int newSize = *indexSize ? *indexSize : MIN_INDEX_SIZE, id;
+	int *newIndex;
+
+	if (count * 2 <= *indexSize)
+	{
+		return TRUE;
+	}
+
+	/* Double the size until the ids fit */
+	while (count * 2 > newSize)
+	{
+		newSize *= 2;
+	}
 
-	while (g_cmdArr[i].name)
+	newIndex = (int *)calloc(newSize, sizeof(int));
+	if (!newIndex)
 	{
-		if (strcmp(cmdName, g_cmdArr[i].name) == 0)
+		return FALSE;
+	}
+	free(*index);
+	*index = newIndex;
+	*indexSize = newSize;
+
+	/* Add the ids again */
+	for (id = 0; id < count - 1; id++)
+	{
+		newIndex[findIndexSlot(ctx, newIndex, newSize, getName(ctx, id), strlen(getName(ctx, id)), getName)] = id + 1;
+	}
+	return TRUE;
+}
+
+/* Returns a pointer to the label with 'labelName' name (of 'length' chars) in ctx->labelArr or NULL if there isn't such label. */
+labelInfo *getLabelView(assemblerContext *ctx, const char *labelName, size_t length)
+{
+	int slot;
+
+	COUNT_STAT(ctx, symbolLookups);
+	if (ctx->labelIndexSize)
+	{
+		slot = findIndexSlot(ctx, ctx->labelIndex, ctx->labelIndexSize, labelName, length, getLabelName);
+		if (ctx->labelIndex[slot])
 		{
-			return i;
+			return &ctx->labelArr[ctx->labelIndex[slot] - 1];
 		}
-
-		i++;
 	}
-	return -1;
+	return NULL;
+}
+
+/* Returns a pointer to the label with 'labelName' name in ctx->labelArr or NULL if there isn't such label. */
+labelInfo *getLabel(assemblerContext *ctx, char *labelName)
+{
+	return labelName ? getLabelView(ctx, labelName, strlen(labelName)) : NULL;
 }
 
-/* Removes spaces from start */
-void trimLeftStr(char **ptStr)
+/* Adds the label with 'labelId' id (the last label) in ctx->labelArr to the labels hash index. Returns if it succeeded. */
+bool addLabelToIndex(assemblerContext *ctx, int labelId)
 {
-	/* Return if it's NULL */
-	if (!ptStr)
+	if (!reserveIndex(ctx, &ctx->labelIndex, &ctx->labelIndexSize, labelId + 1, getLabelName))
 	{
-		return;
+		return FALSE;
 	}
 
-	/* Get ptStr to the start of the actual text */
-	while (isspace(**ptStr))
+	ctx->labelIndex[findIndexSlot(ctx, ctx->labelIndex, ctx->labelIndexSize, ctx->labelArr[labelId].name, strlen(ctx->labelArr[labelId].name), getLabelName)] = labelId + 1;
+	return TRUE;
+}
+
+/* Removes the label with 'labelId' id from the labels hash index. */
+/* Only used for the last added label, so no other label was probed past its slot. */
+void removeLabelFromIndex(assemblerContext *ctx, int labelId)
+{
+	ctx->labelIndex[findIndexSlot(ctx, ctx->labelIndex, ctx->labelIndexSize, ctx->labelArr[labelId].name, strlen(ctx->labelArr[labelId].name), getLabelName)] = 0;
+}
+
+/* Adds the entry line with 'entryId' id (the last entry line) in ctx->entryLines to the entry labels hash index. */
+/* Returns if it succeeded. */
+bool addEntryToIndex(assemblerContext *ctx, int entryId)
+{
+	if (!reserveIndex(ctx, &ctx->entryIndex, &ctx->entryIndexSize, entryId + 1, getEntryName))
 	{
-		++*ptStr;
+		return FALSE;
 	}
+
+	ctx->entryIndex[findIndexSlot(ctx, ctx->entryIndex, ctx->entryIndexSize, getEntryName(ctx, entryId), strlen(getEntryName(ctx, entryId)), getEntryName)] = entryId + 1;
+	return TRUE;
 }
 
-/* Removes all the spaces from the edges of the string ptStr is pointing to. */
-void trimStr(char **ptStr)
+/* Returns a pointer to the macro with 'macroName' name in ctx->macroArr or NULL if there isn't such macro. */
+macroInfo *getMacro(assemblerContext *ctx, const char *macroName)
 {
-	char *eos;
+	int slot;
 
-	/* Return if it's NULL or empty string */
-	if (!ptStr || **ptStr == '\0')
+	if (ctx->macroIndexSize)
 	{
-		return;
+		slot = findIndexSlot(ctx, ctx->macroIndex, ctx->macroIndexSize, macroName, strlen(macroName), getMacroName);
+		if (ctx->macroIndex[slot])
+		{
+			return &ctx->macroArr[ctx->macroIndex[slot] - 1];
+		}
 	}
+	return NULL;
+}
 
-	trimLeftStr(ptStr);
+/* Adds a macro with an empty body (at the end of ctx->macroBodies) to ctx->macroArr and to the macros hash index. */
+/* Returns a pointer to the new macro, or NULL if there isn't enough memory. */
+macroInfo *addMacro(assemblerContext *ctx, const char *macroName)
+{
+	macroInfo *newMacroArr, *macro;
 
-	/* oes is pointing to the last char in str, before '\0' */
-	eos = *ptStr + strlen(*ptStr) - 1;
+	newMacroArr = (macroInfo *)reserveArray(ctx->macroArr, &ctx->macroCapacity, ctx->macroNum + 1, sizeof(macroInfo));
+	if (!newMacroArr)
+	{
+		return NULL;
+	}
+	ctx->macroArr = newMacroArr;
 
-	/* Remove spces from the end */
-	while (isspace(*eos) && eos != *ptStr)
+	macro = &ctx->macroArr[ctx->macroNum];
+	macro->name = arenaString(&ctx->arena, macroName);
+	macro->bodyStart = ctx->macroBodies.length;
+	macro->bodyLength = 0;
+	if (!macro->name || !reserveIndex(ctx, &ctx->macroIndex, &ctx->macroIndexSize, ctx->macroNum + 1, getMacroName))
 	{
-		*eos-- = '\0';
+		return NULL;
 	}
+
+	ctx->macroIndex[findIndexSlot(ctx, ctx->macroIndex, ctx->macroIndexSize, macroName, strlen(macroName), getMacroName)] = ++ctx->macroNum;
+	return macro;
 }
 
-/* Returns a pointer to the start of first token. */
-/* Also makes *endOfTok (if it's not NULL) to point at the last char after the token. */
-char *getFirstTok(char *str, char **endOfTok)
+/* Empties the labels, the entry labels and the macros hash indexes. */
+void clearIndexes(assemblerContext *ctx)
 {
-	char *tokStart = str;
-	char *tokEnd = NULL;
+	if (ctx->labelIndex)
+	{
+		memset(ctx->labelIndex, 0, ctx->labelIndexSize * sizeof(int));
+	}
+	if (ctx->entryIndex)
+	{
+		memset(ctx->entryIndex, 0, ctx->entryIndexSize * sizeof(int));
+	}
+	if (ctx->macroIndex)
+	{
+		memset(ctx->macroIndex, 0, ctx->macroIndexSize * sizeof(int));
+	}
+}
 
-	/* Trim the start */
-	trimLeftStr(&tokStart);
+/* Makes sure the array has room for 'needed' elements of 'elemSize' bytes, doubling its capacity if it doesn't. */
+/* Returns the (maybe moved) array, or NULL if there isn't enough memory (then the array isn't changed). */
+void *reserveArray(void *arr, int *capacity, int needed, size_t elemSize)
+{
+	int newCapacity;
+	void *newArr;
 
-	/* Find the end of the first word */
-	tokEnd = tokStart;
-	while (*tokEnd != '\0' && !isspace(*tokEnd))
+	/* An empty array is still allocated, so NULL always means there isn't enough memory */
+	if (needed <= *capacity && arr)
 	{
-		tokEnd++;
+		return arr;
 	}
 
-	/* Add \0 at the end if needed */
-	if (*tokEnd != '\0')
+	/* Grow geometrically, so appending is amortized O(1) */
+	newCapacity = *capacity ? *capacity * 2 : MIN_ARRAY_CAPACITY;
+	while (newCapacity < needed)
 	{
-		*tokEnd = '\0';
-		tokEnd++;
+		newCapacity *= 2;
 	}
 
-	/* Make *endOfTok (if it's not NULL) to point at the last char after the token */
-	if (endOfTok)
+	newArr = realloc(arr, newCapacity * elemSize);
+	if (!newArr)
 	{
-		*endOfTok = tokEnd;
+		return NULL;
 	}
-	return tokStart;
+
+	*capacity = newCapacity;
+	return newArr;
 }
 
-/* Returns if str contains only one word. */
-bool isOneWord(char *str)
+/* Returns the ID of the command with 'cmdName' name (of 'length' chars) in g_cmdArr or -1 if there isn't such command. */
+int getCmdId(const char *cmdName, size_t length)
 {
-	trimLeftStr(&str);							/* Skip the spaces at the start */
-	while (!isspace(*str) && *str) { str++; }	/* Skip the text at the middle */					
+	int id;
+
+	/* All the command names are CMD_NAME_LENGTH chars long */
+	if (length != CMD_NAME_LENGTH)
+	{
+		return -1;
+	}
 
-	/* Return if it's the end of the text or not. */
-	return isWhiteSpaces(str);
+	/* A single probe in the perfect hash table */
+	id = g_cmdHash[CMD_HASH(cmdName)];
+	if (id != -1 && strncmp(cmdName, g_cmdArr[id].name, CMD_NAME_LENGTH) == 0)
+	{
+		return id;
+	}
+	return -1;
 }
 
-/* Returns if str contains only white spaces. */
-bool isWhiteSpaces(char *str)
+/* Returns the ID of the directive with 'dircName' name in g_dircArr or -1 if there isn't such directive. */
+int getDircId(char *dircName)
 {
-	while (*str)
+	int id;
+
+	/* DIRC_HASH reads the first 4 chars, and all the directive names are at least that long */
+	if (strlen(dircName) < 4)
 	{
-		if (!isspace(*str++))
-		{
-			return FALSE;
-		}
+		return -1;
 	}
-	return TRUE;
+
+	/* A single probe in the perfect hash table */
+	id = g_dircHash[DIRC_HASH(dircName)];
+	if (id != -1 && strcmp(dircName, g_dircArr[id].name) == 0)
+	{
+		return id;
+	}
+	return -1;
 }
 
-/* Returns if labelStr is a legal label name. */
-bool isLegalLabel(char *labelStr, int lineNum, bool printErrors)
+/* Returns if the label (of 'length' chars, not '\0' terminated) is a legal label name. */
+bool isLegalLabelView(assemblerContext *ctx, const char *label, size_t length, int lineNum, bool printErrors)
 {
-	int labelLength = strlen(labelStr), i;
+	size_t i;
 
 	/* Check if the label is short enough */
-	if (strlen(labelStr) > MAX_LABEL_LENGTH)
+	if (length > MAX_LABEL_LENGTH)
 	{
-		if (printErrors) printError(lineNum, "Label is too long. Max label name length is %d.", MAX_LABEL_LENGTH);
+		if (printErrors) printError(ctx, lineNum, "Label is too long. Max label name length is %d.", MAX_LABEL_LENGTH);
 		return FALSE;
 	}
 
 	/* Check if the label isn't an empty string */
-	if (*labelStr == '\0')
+	if (length == 0)
 	{
-		if (printErrors) printError(lineNum, "Label name is empty.");
+		if (printErrors) printError(ctx, lineNum, "Label name is empty.");
 		return FALSE;
 	}
 
 	/* Check if the 1st char is a letter. */
-	if (isspace(*labelStr))
+	if (isspace(*label))
 	{
-		if (printErrors) printError(lineNum, "Label must start at the start of the line.");
+		if (printErrors) printError(ctx, lineNum, "Label must start at the start of the line.");
 		return FALSE;
 	}
 
 	/* Check if it's chars only. */
-	for (i = 1; i < labelLength; i++)
+	for (i = 1; i < length; i++)
 	{
-		if (!isalnum(labelStr[i]))
+		if (!isalnum(label[i]))
 		{
-			if (printErrors) printError(lineNum, "\"%s\" is illegal label - use letters and numbers only.", labelStr);
+			if (printErrors) printError(ctx, lineNum, "\"%.*s\" is illegal label - use letters and numbers only.", (int)length, label);
 			return FALSE;
 		}
 	}
 
 	/* Check if the 1st char is a letter. */
-	if (!isalpha(*labelStr))
+	if (!isalpha(*label))
 	{
-		if (printErrors) printError(lineNum, "\"%s\" is illegal label - first char must be a letter.", labelStr);
+		if (printErrors) printError(ctx, lineNum, "\"%.*s\" is illegal label - first char must be a letter.", (int)length, label);
 		return FALSE;
 	}
 
 	/* Check if it's not a name of a register */
-	if (isRegister(labelStr, NULL)) /* NULL since we don't have to save the register number */
+	if (isRegister(label, length, NULL)) /* NULL since we don't have to save the register number */
 	{
-		if (printErrors) printError(lineNum, "\"%s\" is illegal label - don't use a name of a register.", labelStr);
+		if (printErrors) printError(ctx, lineNum, "\"%.*s\" is illegal label - don't use a name of a register.", (int)length, label);
 		return FALSE;
 	}
 
 	/* Check if it's not a name of a command */
-	if (getCmdId(labelStr) != -1)
+	if (getCmdId(label, length) != -1)
 	{
-		if (printErrors) printError(lineNum, "\"%s\" is illegal label - don't use a name of a command.", labelStr);
+		if (printErrors) printError(ctx, lineNum, "\"%.*s\" is illegal label - don't use a name of a command.", (int)length, label);
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
+/* Returns if labelStr is a legal label name. */
+bool isLegalLabel(assemblerContext *ctx, char *labelStr, int lineNum, bool printErrors)
+{
+	return isLegalLabelView(ctx, labelStr, strlen(labelStr), lineNum, printErrors);
+}
+
 /* Returns if the label exists. */
-bool isExistingLabel(char *label)
+bool isExistingLabel(assemblerContext *ctx, char *label)
 {
-	if (getLabel(label))
+	if (getLabel(ctx, label))
 	{
 		return TRUE;
 	}
@@ -220,27 +357,19 @@ bool isExistingLabel(char *label)
 }
 
 /* Returns if the label is already in the entry lines array. */
-bool isExistingEntryLabel(char *labelName)
+bool isExistingEntryLabel(assemblerContext *ctx, char *labelName)
 {
-	int i = 0;
-
-	if (labelName)
+	if (labelName && ctx->entryIndexSize && ctx->entryIndex[findIndexSlot(ctx, ctx->entryIndex, ctx->entryIndexSize, labelName, strlen(labelName), getEntryName)])
 	{
-		for (i = 0; i < g_entryLabelsNum; i++)
-		{
-			if (strcmp(labelName, g_entryLines[i]->lineStr) == 0)
-			{
-				return TRUE;
-			}
-		}
+		return TRUE;
 	}
 	return FALSE;
 }
 
-/* Returns if str is a register name, and update value to be the register value. */
-bool isRegister(char *str, int *value)
+/* Returns if str (of 'length' chars) is a register name, and update value to be the register value. */
+bool isRegister(const char *str, size_t length, int *value)
 {
-	if (str[0] == 'r'  && str[1] >= '0' && str[1] - '0' <= MAX_REGISTER_DIGIT && str[2] == '\0') 
+	if (length == 2 && str[0] == 'r' && str[1] >= '0' && str[1] - '0' <= MAX_REGISTER_DIGIT)
 	{
 		/* Update value if it's not NULL */
 		if (value)
@@ -253,57 +382,67 @@ bool isRegister(char *str, int *value)
 	return FALSE;
 }
 
-/* Returns if str is a struct*/
-bool isStruct(char *val, int lineNum, bool printErrors)
-{
-	char *token;
-	char *valCopy = malloc(sizeof(val));;
-	char *strtolEnd;
-	int strtolInt;
-	
-	/* copy to save original value */
-	strcpy(valCopy ,val);
-	token = strtok(valCopy, ".");
-	
-	/* if is a legal label, check the number*/
-	if (isLegalLabel(token, lineNum, printErrors))
-	{
-	    token = strtok(NULL, ".");
-			if (token != NULL)
-			{
-			    strtolInt = strtol(token, &strtolEnd, 10);
-                if(strtolInt == 1 || strtolInt == 2)
-                    return TRUE;
-                else return FALSE;
-			}
-			else return FALSE;
+/* Returns if the operand is a struct field ("label.1" or "label.2"), and keeps the label and the field in it. */
+/* The label and the field are found in operand->str as they are, nothing is copied. */
+bool parseStructOperand(assemblerContext *ctx, operandInfo *operand, int lineNum)
+{
+	const char *pos = operand->str, *end = operand->str + operand->length, *label, *field;
+	long fieldNum;
+
+	/* The label is the first part between the dots (the dots before it are skipped) */
+	while (pos < end && *pos == '.')
+	{
+		pos++;
 	}
-	else
+	label = pos;
+	while (pos < end && *pos != '.')
+	{
+		pos++;
+	}
+	if (pos == label || !isLegalLabelView(ctx, label, pos - label, lineNum, FALSE))
+	{
+		return FALSE;
+	}
+	operand->structLabel = label;
+	operand->structLabelLength = pos - label;
+
+	/* The field is the number in the next part (strtol stops at the next dot or the '\0' at the end) */
+	while (pos < end && *pos == '.')
+	{
+		pos++;
+	}
+	field = pos;
+	if (field == end)
+	{
 		return FALSE;
+	}
+	fieldNum = strtol(field, NULL, 10);
+	operand->structField = (int)fieldNum;
+	return fieldNum == 1 || fieldNum == 2;
 }
 
 /* Return a bool, represent whether 'line' is a comment or not. */
 /* If the first char is ';' but it's not at the start of the line, it returns true and update line->isError to be TRUE. */
-bool isCommentOrEmpty(lineInfo *line)
+bool isCommentOrEmpty(assemblerContext *ctx, lineInfo *line)
 {
 	char *startOfText = line->lineStr; /* We don't want to change line->lineStr */
 
-	if (*line->lineStr == ';')
+	if (isCharClass(&ctx->scan, line->lineStr, CHAR_SEMICOLON))
 	{
 		/* Comment */
 		return TRUE;
 	}
 
-	trimLeftStr(&startOfText);
+	trimLeftStr(&ctx->scan, &startOfText);
 	if (*startOfText == '\0')
 	{
 		/* Empty line */
 		return TRUE;
 	}
-	if (*startOfText == ';')
+	if (isCharClass(&ctx->scan, startOfText, CHAR_SEMICOLON))
 	{
 		/* Illegal comment - ';' isn't at the start of the line */
-		printError(line->lineNum, "Comments must start with ';' at the start of the line.");
+		printError(ctx, line->lineNum, "Comments must start with ';' at the start of the line.");
 		line->isError = TRUE;
 		return TRUE;
 	}
@@ -312,44 +451,6 @@ bool isCommentOrEmpty(lineInfo *line)
 	return FALSE;
 }
 
-/* Returns a pointer to the start of the first operand in 'line' and change the end of it to '\0'. */
-/* Also makes *endOfOp (if it's not NULL) point at the next char after the operand. */
-char *getFirstOperand(char *line, char **endOfOp, bool *foundComma)
-{
-	if (!isWhiteSpaces(line))
-	{
-		/* Find the first comma */
-		char *end = strchr(line, ',');
-		if (end)
-		{
-			*foundComma = TRUE;
-			*end = '\0';
-			end++;
-		}
-		else
-		{
-			*foundComma = FALSE;
-		}
-
-		/* Set endOfOp (if it's not NULL) to point at the next char after the operand
-		(Or at the end of it if it's the end of the line) */
-		if (endOfOp)
-		{
-			if (end)
-			{
-				*endOfOp = end;
-			}
-			else
-			{
-				*endOfOp = strchr(line, '\0');
-			}
-		}
-	}
-
-	trimStr(&line);
-	return line;
-}
-
 /* Returns if the cmd is a directive. */
 bool isDirective(char *cmd)
 {
@@ -357,39 +458,42 @@ bool isDirective(char *cmd)
 }
 
 /* Returns if the strParam is a legal string param (enclosed in quotes), and remove the quotes. */
-bool isLegalStringParam(char **strParam, int lineNum)
+bool isLegalStringParam(assemblerContext *ctx, char **strParam, int lineNum)
 {
+	/* The last char of the string param (before its '\0') */
+	char *lastChar = findChars(&ctx->scan, *strParam, CHAR_END) - 1;
+
 	/* check if the string param is enclosed in quotes */
-	if ((*strParam)[0] == '"' && (*strParam)[strlen(*strParam) - 1] == '"')
+	if (isCharClass(&ctx->scan, *strParam, CHAR_QUOTE) && isCharClass(&ctx->scan, lastChar, CHAR_QUOTE))
 	{
 		/* remove the quotes */
-		(*strParam)[strlen(*strParam) - 1] = '\0';
+		setLineChar(&ctx->scan, lastChar, '\0');
 		++*strParam;
 		return TRUE;
 	}
 
 	if (**strParam == '\0')
 	{
-		printError(lineNum, "No parameter.");
+		printError(ctx, lineNum, "No parameter.");
 	}
 	else
 	{
-		printError(lineNum, "The parameter for .string must be enclosed in quotes.");
+		printError(ctx, lineNum, "The parameter for .string must be enclosed in quotes.");
 	}
 	return FALSE;
 }
 
 /* Returns if the num is a legal number param, and save it's value in *value. */
-bool isLegalNum(char *numStr, int numOfBits, int lineNum, int *value)
+bool isLegalNum(assemblerContext *ctx, char *numStr, int numOfBits, int lineNum, int *value)
 {
 	char *endOfNum;
 	/* maxNum is the max number you can represent with (MAX_LABEL_LENGTH - 1) bits 
 	 (-1 for the negative/positive bit) */
 	int maxNum = (1 << numOfBits) - 1;
 
-	if (isWhiteSpaces(numStr))
+	if (isWhiteSpaces(&ctx->scan, numStr))
 	{
-		printError(lineNum, "Empty parameter.");
+		printError(ctx, lineNum, "Empty parameter.");
 		return FALSE;
 	}
 
@@ -398,7 +502,7 @@ bool isLegalNum(char *numStr, int numOfBits, int lineNum, int *value)
 	/* Check if endOfNum is at the end of the string */
 	if (*endOfNum)
 	{
-		printError(lineNum, "\"%s\" isn't a valid number.", numStr);
+		printError(ctx, lineNum, "\"%s\" isn't a valid number.", numStr);
 		return FALSE;
 	}
 
@@ -406,123 +510,199 @@ bool isLegalNum(char *numStr, int numOfBits, int lineNum, int *value)
 	(if the absolute value of number is smaller than 'maxNum' */
 	if (*value > maxNum || *value < -maxNum)
 	{
-		printError(lineNum, "\"%s\" is too %s, must be between %d and %d.", numStr, (*value > 0) ? "big" : "small", -maxNum, maxNum);
+		printError(ctx, lineNum, "\"%s\" is too %s, must be between %d and %d.", numStr, (*value > 0) ? "big" : "small", -maxNum, maxNum);
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
-/* returns the label name part of the struct directive */
-char * getLabelStruct(char *val)
+/* Returns the first token in [str, end) (separated by whitespaces and commas), and puts its length in *tokLength. */
+/* Returns NULL if there are no tokens. */
+const char *getTokenSlice(const char *str, const char *end, size_t *tokLength)
 {
-	char *token;
-	char *valCopy = malloc(sizeof(val));
-	
-	/* copy to save original value */
-	strcpy(valCopy ,val);
-	token = strtok(valCopy, ".");
+	const char *separators = "\t\n, \r";
+	const char *token;
+
+	while (str < end && strchr(separators, *str))
+	{
+		str++;
+	}
+	if (str == end || *str == '\0')
+	{
+		return NULL;
+	}
+
+	token = str;
+	while (str < end && *str != '\0' && !strchr(separators, *str))
+	{
+		str++;
+	}
+
+	*tokLength = str - token;
 	return token;
 }
 
-/* removes macros from file and writes result into new .am file */
-int removeMacros(char *filename)
+/* Returns if the token slice equals str. */
+bool isTokenEqual(const char *token, size_t tokLength, const char *str)
+{
+	return strlen(str) == tokLength && strncmp(token, str, tokLength) == 0;
+}
+
+/* Starts streaming the lines of the source (of 'length' chars) after the macros expansion. */
+void initMacroExpander(macroExpander *expander, const char *source, size_t length)
 {
- 	FILE *amInputFile = openFile(filename, ".am", "wb");
- 	FILE *inputFile = openFile(filename, ".as", "r");
-    macroList * headMacroList;
-    char *separators = "\t\n, \r";
-	char *currentToken, *nameOfMacro, *nameOfMacroCopy;
-	char line[100];
-	char lineCopy[100];
-	int macroSpread = 0;
-	while (!feof(inputFile))
+	expander->reader.pos = source;
+	expander->reader.end = source + length;
+	expander->body.pos = NULL;
+	expander->body.end = NULL;
+}
+
+/* Reads the body of a macro definition (until "endmacro") into ctx->macroBodies. 'name' is the rest of the "macro" line. */
+void readMacro(assemblerContext *ctx, macroExpander *expander, const char *name, const char *endOfLine)
+{
+	char macroName[MAX_LINE_LENGTH + 2];
+	const char *line, *token;
+	size_t length, tokLength;
+	macroInfo *macro;
+
+	token = getTokenSlice(name, endOfLine, &tokLength);
+	if (!token)
 	{
-		if (readLine(inputFile, line, MAX_LINE_LENGTH + 2)) 
-		{
+		token = "";
+		tokLength = 0;
+	}
+	memcpy(macroName, token, tokLength);
+	macroName[tokLength] = '\0';
 
-	    if (line[0] == '\n')
-	        continue;
-		strcpy(lineCopy, line);
-		currentToken = strtok(lineCopy, separators);
-		if (strcmp(currentToken, "macro")==0)
+	macro = getMacro(ctx, macroName);
+	if (macro && macro->bodyStart + macro->bodyLength != ctx->macroBodies.length)
+	{
+		/* A macro that is defined again gets both bodies - move the old body to the end, so the body stays contiguous */
+		if (reserveText(&ctx->macroBodies, macro->bodyLength))
 		{
-		    nameOfMacro = strtok(NULL, separators);
-		    nameOfMacroCopy = malloc(sizeof(nameOfMacro));
-		    strcpy(nameOfMacroCopy, nameOfMacro);
-		    while (fgets(line, 80, inputFile) != NULL) 
-		    {
-		        strcpy(lineCopy, line);
-		        currentToken = strtok(lineCopy, separators);
-		        if (strcmp(currentToken, "endmacro")==0)
-		        {
-		            break;
-		        }
-		        else
-		        {
-		            addToMacroList(&headMacroList, nameOfMacroCopy, line);
-		        }
-		        
-		    }
-		    
+			appendText(&ctx->macroBodies, ctx->macroBodies.data + macro->bodyStart, macro->bodyLength);
+			macro->bodyStart = ctx->macroBodies.length - macro->bodyLength;
 		}
 		else
 		{
-		    macroList* pntList1;
-	        for (pntList1 = (headMacroList); pntList1; pntList1 = pntList1->next)
-	            {
-		            if (strcmp(pntList1->name, currentToken) == 0)
-		            {
-		                fprintf(amInputFile, "%s\n", pntList1->line);
-		                macroSpread = 1;
-		            }
-			                
-	            }
-	        if(macroSpread == 0)
-	            fprintf(amInputFile, "%s\n", line);
-	       macroSpread = 0;
+			macro = NULL;
+		}
+	}
+	else if (!macro)
+	{
+		macro = addMacro(ctx, macroName);
+	}
 
-	    }
-		}	
-    
-    
+	if (!macro)
+	{
+		appendFormat(&ctx->messages, "[Error] Not enough memory - malloc falied.\n");
 	}
-    fclose(inputFile);
-    fclose(amInputFile);
 
+	while ((line = nextLine(&expander->reader, &length)) != NULL)
+	{
+		/* A body line that is too long is cut after MAX_LINE_LENGTH + 1 chars, so it's still reported */
+		if (length > MAX_LINE_LENGTH + 1)
+		{
+			length = MAX_LINE_LENGTH + 1;
+		}
+
+		token = getTokenSlice(line, line + length, &tokLength);
+		if (token && isTokenEqual(token, tokLength, "endmacro"))
+		{
+			break;
+		}
+
+		/* Add the line to the end of the body */
+		if (macro && reserveText(&ctx->macroBodies, length + 1))
+		{
+			appendText(&ctx->macroBodies, line, length);
+			appendText(&ctx->macroBodies, "\n", 1);
+			macro->bodyLength += length + 1;
+		}
+	}
 }
 
-/*adds node to macroList*/
-int addToMacroList(macroList **head, char *label, char *val)
+/* Returns the next line of the source after the macros expansion (without the '\n'), and puts its length in *length. */
+/* Returns NULL at the end of the source. The lines are also added to ctx->expandedSource if ctx->keepExpandedSource is set. */
+const char *expandLine(assemblerContext *ctx, macroExpander *expander, size_t *length)
 {
-	macroList* tempNode = (macroList*)malloc(sizeof(macroList));
-	macroList* pntList1;
-	macroList* pntList2;
-	
-	if (!tempNode)
+	char macroName[MAX_LINE_LENGTH + 2];
+	const char *line, *token;
+	size_t tokLength;
+	macroInfo *macro;
+
+	FOREVER
 	{
-		/* error: can not allocate memory */
-		printf("allocate memory error!");
-		exit(0);
+		/* Continue the macro call with the next body line */
+		line = nextLine(&expander->body, length);
+		if (line)
+		{
+			break;
+		}
+
+		line = nextLine(&expander->reader, length);
+		if (!line)
+		{
+			return NULL;
+		}
+
+		/* Keep lines that are too long as they are, the first read reports them */
+		if (*length > MAX_LINE_LENGTH)
+		{
+			break;
+		}
+
+		token = getTokenSlice(line, line + *length, &tokLength);
+		if (!token)
+		{
+			break;
+		}
+
+		if (isTokenEqual(token, tokLength, "macro"))
+		{
+			/* Save the body of the macro, the definition isn't a part of the expanded source */
+			readMacro(ctx, expander, token + tokLength, line + *length);
+			continue;
+		}
+
+		/* Replace a macro call with the body of the macro (a call of a macro with an empty body is kept as it is) */
+		memcpy(macroName, token, tokLength);
+		macroName[tokLength] = '\0';
+		macro = getMacro(ctx, macroName);
+		if (!macro || macro->bodyLength == 0)
+		{
+			break;
+		}
+
+		expander->body.pos = ctx->macroBodies.data + macro->bodyStart;
+		expander->body.end = expander->body.pos + macro->bodyLength;
+		COUNT_STAT(ctx, macroCalls);
 	}
-	strcpy(tempNode->line, val);
-	strcpy(tempNode->name, label);
-    /* get last in list */
-	for (pntList1 = (*head); pntList1; pntList1 = pntList1->next)
+
+	if (ctx->keepExpandedSource)
 	{
-		pntList2 = pntList1;
+		appendText(&ctx->expandedSource, line, *length);
+		appendText(&ctx->expandedSource, "\n", 1);
 	}
-	 /*if the node is the first node in the list*/
-	if (pntList1 == (*head))
+
+	return line;
+}
+
+/* Returns the next line of the source after the macros expansion (see expandLine). */
+/* The expansion is done between the reads of the lines, so its time is measured here when there are stats. */
+const char *nextExpandedLine(assemblerContext *ctx, macroExpander *expander, size_t *length)
+{
+	const char *line;
+	double start;
+
+	if (!ctx->stats)
 	{
-		(*head) = tempNode;
-		tempNode->next = NULL;
-	}
-	else
-	{  
-	    /*add to end of list*/
-		pntList2->next = tempNode;
-		tempNode->next = NULL;
+		return expandLine(ctx, expander, length);
 	}
-	return 0;
+
+	start = getTime();
+	line = expandLine(ctx, expander, length);
+	ctx->stats->expandTime += getTime() - start;
+	return line;
 }
\ No newline at end of file